@@ -0,0 +1,147 @@
+/*
+ * Microbenchmark for the glue's command channel, runnable on a Linux host.
+ *
+ * Compares the eventfd + SPSC queue in android_app_cmd_queue.h against the
+ * one-byte pipe it replaced: commands per second with a free-running
+ * producer, and wakeup latency (push on one thread to pop on the other,
+ * through poll() as ALooper would) with one command in flight at a time.
+ *
+ *     cc -O2 -I mobile/src/main/jni mobile/src/main/bench/cmd_queue_bench.c -o cmd_queue_bench -lpthread
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "android_app_cmd_queue.h"
+
+#define THROUGHPUT_COMMANDS 1000000
+#define LATENCY_COMMANDS 20000
+
+struct channel {
+    int use_pipe;
+    struct android_app_cmd_queue queue;
+    int pipe_fds[2];
+
+    int ping_pong;
+    volatile int64_t sent_ns;
+    volatile uint32_t received;
+    int64_t* latencies;
+};
+
+static int64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int channel_wait_fd(struct channel* channel) {
+    return channel->use_pipe ? channel->pipe_fds[0] : channel->queue.eventfd;
+}
+
+static void channel_push(struct channel* channel, int8_t cmd) {
+    if (channel->use_pipe) {
+        if (write(channel->pipe_fds[1], &cmd, sizeof(cmd)) != sizeof(cmd)) {
+            abort();
+        }
+    } else {
+        android_app_cmd_queue_push(&channel->queue, cmd);
+    }
+}
+
+static int channel_pop(struct channel* channel, int8_t* cmd) {
+    if (channel->use_pipe) {
+        return read(channel->pipe_fds[0], cmd, sizeof(*cmd)) == sizeof(*cmd);
+    }
+    return android_app_cmd_queue_pop(&channel->queue, cmd);
+}
+
+static void* consumer(void* param) {
+    struct channel* channel = (struct channel*)param;
+    struct pollfd fd = { channel_wait_fd(channel), POLLIN, 0 };
+    uint32_t count = channel->ping_pong ? LATENCY_COMMANDS : THROUGHPUT_COMMANDS;
+    for (uint32_t i = 0; i < count; ++i) {
+        int8_t cmd;
+        do {
+            poll(&fd, 1, -1);
+        } while (!channel_pop(channel, &cmd));
+        if (channel->ping_pong) {
+            channel->latencies[i] = now_ns() - channel->sent_ns;
+            __atomic_store_n(&channel->received, i + 1, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+static int compare_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void open_channel(struct channel* channel, int use_pipe) {
+    channel->use_pipe = use_pipe;
+    if (use_pipe) {
+        if (pipe(channel->pipe_fds)) {
+            abort();
+        }
+    } else if (!android_app_cmd_queue_init(&channel->queue)) {
+        abort();
+    }
+}
+
+static void close_channel(struct channel* channel) {
+    if (channel->use_pipe) {
+        close(channel->pipe_fds[0]);
+        close(channel->pipe_fds[1]);
+    } else {
+        android_app_cmd_queue_destroy(&channel->queue);
+    }
+}
+
+static void run(int use_pipe) {
+    const char* name = use_pipe ? "pipe" : "eventfd_queue";
+
+    struct channel throughput = {0};
+    open_channel(&throughput, use_pipe);
+    pthread_t thread;
+    int64_t start = now_ns();
+    pthread_create(&thread, NULL, consumer, &throughput);
+    for (uint32_t i = 0; i < THROUGHPUT_COMMANDS; ++i) {
+        channel_push(&throughput, (int8_t)(i & 15));
+    }
+    pthread_join(thread, NULL);
+    int64_t elapsed = now_ns() - start;
+    close_channel(&throughput);
+
+    struct channel latency = {0};
+    open_channel(&latency, use_pipe);
+    latency.ping_pong = 1;
+    latency.latencies = (int64_t*)calloc(LATENCY_COMMANDS, sizeof(int64_t));
+    pthread_create(&thread, NULL, consumer, &latency);
+    for (uint32_t i = 0; i < LATENCY_COMMANDS; ++i) {
+        latency.sent_ns = now_ns();
+        channel_push(&latency, (int8_t)(i & 15));
+        while (__atomic_load_n(&latency.received, __ATOMIC_ACQUIRE) != i + 1) {
+            sched_yield();
+        }
+    }
+    pthread_join(thread, NULL);
+    close_channel(&latency);
+
+    qsort(latency.latencies, LATENCY_COMMANDS, sizeof(int64_t), compare_int64);
+    printf("%s commands_per_second=%.0f wakeup_median_ns=%lld wakeup_p99_ns=%lld\n",
+            name, THROUGHPUT_COMMANDS * 1.0e9 / elapsed,
+            (long long)latency.latencies[LATENCY_COMMANDS / 2],
+            (long long)latency.latencies[(LATENCY_COMMANDS * 99) / 100]);
+    free(latency.latencies);
+}
+
+int main(void) {
+    run(1);
+    run(0);
+    return 0;
+}
@@ -0,0 +1,216 @@
+// Prints a flight recorder file (see jni/app_flight.h) as a timeline.
+//
+// Records come out in the order they were written, oldest first, with their
+// time since the recording started.  Frames whose work took longer than
+// --slow milliseconds, and gaps of more than that between records, are
+// marked, and records lost to a write cut off halfway are counted.  The
+// timeline ends with the last thing the process did before it stopped
+// writing.
+//
+//     c++ -std=c++11 -O2 -I mobile/src/main/handmade -I mobile/src/main/jni
+//         mobile/src/main/bench/flight_decode.cpp -o flight_decode
+//
+//     adb shell run-as org.nxsy.ndk_handmade cat files/flight_recorder.prev.bin > flight.bin
+//     ./flight_decode flight.bin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "handmade_platform.h"
+
+#include "app_flight.h"
+
+// android_native_app_glue.h's APP_CMD_* values.
+global_variable char *command_names[] = {
+    "INPUT_CHANGED",
+    "INIT_WINDOW",
+    "TERM_WINDOW",
+    "WINDOW_RESIZED",
+    "WINDOW_REDRAW_NEEDED",
+    "CONTENT_RECT_CHANGED",
+    "GAINED_FOCUS",
+    "LOST_FOCUS",
+    "CONFIG_CHANGED",
+    "LOW_MEMORY",
+    "START",
+    "RESUME",
+    "SAVE_STATE",
+    "PAUSE",
+    "STOP",
+    "DESTROY",
+};
+
+global_variable char *stage_names[FLIGHT_STAGE_COUNT] = {"input", "update", "sound", "present"};
+
+internal int
+compare_sequence(const void *a, const void *b)
+{
+    uint64 x = (*(flight_record **)a)->sequence;
+    uint64 y = (*(flight_record **)b)->sequence;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+internal void
+print_record(flight_record *record, int64_t start_ns, real64 slow_ms)
+{
+    printf("%+12.6f %8llu  ", (record->time_ns - start_ns) / 1.0e9, (unsigned long long)record->sequence);
+    switch (record->type)
+    {
+        case FLIGHT_FRAME:
+        {
+            flight_frame *frame = &record->frame;
+            printf("frame %u work %.2f ms [", frame->frame, frame->work_us / 1000.0);
+            for (uint32 stage = 0; stage < FLIGHT_STAGE_COUNT; ++stage)
+            {
+                printf("%s%s %.2f", stage ? " " : "", stage_names[stage], frame->stage_us[stage] / 1000.0);
+            }
+            printf("] poll %d keys %04x/%04x transitions %u events %u game %u cpu %u%s%s%s\n",
+                frame->poll_result, frame->buttons_down[0], frame->buttons_down[1], frame->transitions,
+                frame->input_events, frame->game_code, frame->cpu, frame->migrated ? " migrated" : "",
+                frame->presented ? "" : " not presented",
+                (frame->work_us / 1000.0 > slow_ms) ? "  <-- SLOW" : "");
+            break;
+        }
+        case FLIGHT_COMMAND:
+        {
+            int32 command = record->command.command;
+            if ((command >= 0) && (command < (int32)ArrayCount(command_names)))
+            {
+                printf("command %s\n", command_names[command]);
+            }
+            else
+            {
+                printf("command %d\n", command);
+            }
+            break;
+        }
+        case FLIGHT_SUSPEND:
+        {
+            printf("resumed after %.3f s suspended, %.3f ms cpu\n",
+                record->suspend.wall_ns / 1.0e9, record->suspend.cpu_ns / 1.0e6);
+            break;
+        }
+        default:
+        {
+            printf("unknown record type %u\n", record->type);
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *path = 0;
+    real64 slow_ms = 50.0;
+    uint32 last = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--slow") && (i + 1 < argc))
+        {
+            slow_ms = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--last") && (i + 1 < argc))
+        {
+            last = (uint32)strtoul(argv[++i], 0, 10);
+        }
+        else if (!path)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = 0;
+            break;
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [--slow MS] [--last N] flight_recorder.bin\n", argv[0]);
+        return 2;
+    }
+
+    // Too big for the stack.
+    static flight_file file;
+    FILE *input = fopen(path, "rb");
+    size_t read = input ? fread(&file, 1, sizeof(file), input) : 0;
+    if (input)
+    {
+        fclose(input);
+    }
+    if ((read < sizeof(file.header)) || (file.header.magic != FLIGHT_MAGIC))
+    {
+        fprintf(stderr, "%s isn't a flight recording\n", path);
+        return 2;
+    }
+    if ((file.header.version != FLIGHT_VERSION) || (file.header.record_size != sizeof(flight_record)) ||
+        (file.header.record_count != FLIGHT_RECORD_COUNT))
+    {
+        fprintf(stderr, "%s is version %u with %u records of %u bytes; this reads version %u, %u of %u\n",
+            path, file.header.version, file.header.record_count, file.header.record_size,
+            FLIGHT_VERSION, FLIGHT_RECORD_COUNT, (uint32)sizeof(flight_record));
+        return 2;
+    }
+    uint32 readable_count = (uint32)((read - offsetof(flight_file, records)) / sizeof(flight_record));
+    if (read < offsetof(flight_file, records))
+    {
+        readable_count = 0;
+    }
+
+    static flight_record *records[FLIGHT_RECORD_COUNT];
+    uint32 record_count = 0;
+    for (uint32 i = 0; i < readable_count; ++i)
+    {
+        flight_record *record = &file.records[i];
+        // Anything else is empty, half written, or not where it should be.
+        if (record->sequence && ((record->sequence % FLIGHT_RECORD_COUNT) == i))
+        {
+            records[record_count++] = record;
+        }
+    }
+    qsort(records, record_count, sizeof(records[0]), compare_sequence);
+
+    time_t start_seconds = (time_t)(file.header.start_realtime_ns / 1000000000);
+    char start_text[64] = "?";
+    tm start_tm;
+    if (localtime_r(&start_seconds, &start_tm))
+    {
+        strftime(start_text, sizeof(start_text), "%Y-%m-%d %H:%M:%S", &start_tm);
+    }
+    printf("pid %d, recording started %s.%03d, %llu records written, %u kept\n",
+        file.header.pid, start_text, (int)((file.header.start_realtime_ns / 1000000) % 1000),
+        (unsigned long long)(file.header.next_sequence ? file.header.next_sequence - 1 : 0), record_count);
+
+    uint32 first = (last && (last < record_count)) ? (record_count - last) : 0;
+    uint64 lost = 0;
+    for (uint32 i = first; i < record_count; ++i)
+    {
+        flight_record *record = records[i];
+        if (i > first)
+        {
+            flight_record *previous = records[i - 1];
+            if (record->sequence != previous->sequence + 1)
+            {
+                uint64 missing = record->sequence - previous->sequence - 1;
+                lost += missing;
+                printf("%21s  (%llu records missing)\n", "", (unsigned long long)missing);
+            }
+            real64 gap_ms = (record->time_ns - previous->time_ns) / 1.0e6;
+            if (gap_ms > slow_ms)
+            {
+                printf("%21s  (%.1f ms gap)\n", "", gap_ms);
+            }
+        }
+        print_record(record, file.header.start_monotonic_ns, slow_ms);
+    }
+
+    if (record_count)
+    {
+        flight_record *final_record = records[record_count - 1];
+        printf("last record %.3f s into the recording%s\n",
+            (final_record->time_ns - file.header.start_monotonic_ns) / 1.0e9,
+            lost ? ", with records missing" : "");
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Compares two frame_stats recordings (see jni/app_frame_stats.h), for
+// gating platform changes on frame time.
+//
+// For each of frame interval, work time and swap time it prints the
+// baseline and candidate percentiles, then tests for a shift in the whole
+// distribution (Mann-Whitney U) and for a higher jank rate (two-proportion
+// z).  A regression is flagged only when the change is significant at
+// p < 0.001 and, for the shift, large enough to matter.  Swap time is only
+// there to explain the other two: blocking longer in the swap because the
+// work got faster isn't a regression, so it's printed but never gates.
+// Exits with 1 if interval or work regressed, 2 if a recording couldn't be
+// read.
+//
+//     c++ -std=c++11 -O2 -I mobile/src/main/handmade -I mobile/src/main/jni
+//         mobile/src/main/bench/frame_stats_compare.cpp -o frame_stats_compare
+//
+//     ./frame_stats_compare baseline.txt candidate.txt
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "handmade_platform.h"
+
+#include "app_frame_stats.h"
+
+internal void
+print_row(char *name, int64_t baseline_ns, int64_t candidate_ns)
+{
+    real64 change = baseline_ns ? (100.0 * (candidate_ns - baseline_ns)) / baseline_ns : 0.0;
+    printf("  %-6s %10.2f ms %10.2f ms %+8.1f%%\n", name, baseline_ns / 1.0e6, candidate_ns / 1.0e6, change);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s baseline.txt candidate.txt\n", argv[0]);
+        return 2;
+    }
+
+    // Too big for the stack.
+    static frame_stats baseline;
+    static frame_stats candidate;
+    if (!frame_stats_read(&baseline, argv[1]))
+    {
+        fprintf(stderr, "couldn't read %s\n", argv[1]);
+        return 2;
+    }
+    if (!frame_stats_read(&candidate, argv[2]))
+    {
+        fprintf(stderr, "couldn't read %s\n", argv[2]);
+        return 2;
+    }
+    if (baseline.budget_ns != candidate.budget_ns)
+    {
+        printf("warning: frame budgets differ (%lld vs %lld ns)\n",
+            (long long)baseline.budget_ns, (long long)candidate.budget_ns);
+    }
+
+    bool32 regressed = 0;
+    for (uint32 kind = 0; kind < FRAME_STATS_KIND_COUNT; ++kind)
+    {
+        frame_histogram *baseline_histogram = &baseline.histograms[kind];
+        frame_histogram *candidate_histogram = &candidate.histograms[kind];
+        frame_stats_summary b = frame_histogram_summarize(baseline_histogram);
+        frame_stats_summary c = frame_histogram_summarize(candidate_histogram);
+        frame_stats_comparison comparison = frame_histogram_compare(baseline_histogram, candidate_histogram);
+        bool32 gates = (kind != FRAME_STATS_SWAP);
+        char *flag = gates ? (char *)"  REGRESSION" : (char *)"  higher";
+
+        printf("%s: %llu vs %llu frames%s\n", frame_stats_kind_names[kind],
+            (unsigned long long)b.frames, (unsigned long long)c.frames, gates ? "" : " (informational)");
+        print_row((char *)"p50", b.p50_ns, c.p50_ns);
+        print_row((char *)"p90", b.p90_ns, c.p90_ns);
+        print_row((char *)"p99", b.p99_ns, c.p99_ns);
+        print_row((char *)"p99.9", b.p999_ns, c.p999_ns);
+        print_row((char *)"max", b.max_ns, c.max_ns);
+        printf("  jank   %10.3f %%   %10.3f %%  (big jank %llu vs %llu)\n",
+            b.frames ? (100.0 * b.jank_count) / b.frames : 0.0,
+            c.frames ? (100.0 * c.jank_count) / c.frames : 0.0,
+            (unsigned long long)b.big_jank_count, (unsigned long long)c.big_jank_count);
+        printf("  shift z=%.2f effect=%.3f%s\n", comparison.shift_z, comparison.shift_effect,
+            comparison.shift_regressed ? flag : "");
+        printf("  jank z=%.2f%s\n", comparison.jank_z,
+            comparison.jank_regressed ? flag : "");
+
+        if (gates)
+        {
+            regressed = regressed || comparison.shift_regressed || comparison.jank_regressed;
+        }
+    }
+
+    printf("result=%s\n", regressed ? "regressed" : "ok");
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,937 @@
+// Microbenchmarks for the platform layer's per-frame hot paths, built for a
+// Linux host against the same code the device runs.
+//
+// Every case runs a batch of iterations per sample, with the batch sized so a
+// sample takes at least BENCH_MIN_SAMPLE_NS, after one warm-up sample.  The
+// report is one line per case with per-iteration times:
+//
+//     case=<name> samples=<n> batch=<n> median_ns=<ns> p99_ns=<ns> iterations_per_second=<n>
+//
+// rgb565_quality is the exception: it reports how far the dithered RGB565
+// upload is from the exact RGBA8 one, and whether the SIMD conversion
+// matches the scalar reference.  So is resampler_check, which checks the
+// audio resampler; build with -fsanitize=address to have it catch reads
+// past the input it was given.  And present_lag_check, which checks that the
+// presentation time asked for stays within a frame of the swap, whatever the
+// swaps' real cadence.
+//
+// The GL cases use Mesa's surfaceless EGL platform, so on a host they
+// measure the software driver (llvmpipe); they are skipped when no context
+// can be made.  The upscale cases draw the game's buffer to 1080p and 2160p
+// surfaces in each scale mode, which is what a TV's GPU does every frame.
+//
+// The file cases go through the game's debug file calls, so they're only
+// built with HANDMADE_INTERNAL.
+//
+// The calling thread is placed like the game thread first.
+//
+//     c++ -std=c++11 -O2 -DHANDMADE_INTERNAL=1 -I mobile/src/main/handmade -I mobile/src/main/jni -I mobile/src/main/linux
+//         mobile/src/main/bench/platform_bench.cpp -o platform_bench -lEGL -lGLESv2 -lpthread
+//
+//     ./platform_bench [--samples N] [--case NAME]
+
+#include <dirent.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "handmade_platform.h"
+
+#include "android_app_cmd_queue.h"
+#include "app_gl.h"
+#include "app_input.h"
+#include "app_mixer.h"
+#include "app_overlay.h"
+#include "app_pixels.h"
+#include "app_present.h"
+#include "app_threads.h"
+#include "app_time.h"
+
+#include "linux_egl.h"
+#include "linux_files.h"
+
+#define BENCH_MIN_SAMPLE_NS (200 * 1000)
+#define BENCH_MAX_BATCH (1 << 20)
+#define BENCH_SMALL_FILE_BYTES (4 * 1024)
+#define BENCH_LARGE_FILE_BYTES (16 * 1024 * 1024)
+#define BENCH_ALLOCATION_BYTES (4 * 960 * 540)
+
+typedef void bench_function(void *param, uint32 iterations);
+
+struct bench_options
+{
+    uint32 samples;
+    char *only_case;
+};
+
+global_variable bench_options global_options;
+
+internal int
+compare_real64(const void *a, const void *b)
+{
+    real64 x = *(const real64 *)a;
+    real64 y = *(const real64 *)b;
+    return (x > y) - (x < y);
+}
+
+internal void
+run_bench(char *name, bench_function *function, void *param)
+{
+    if (global_options.only_case && strcmp(global_options.only_case, name))
+    {
+        return;
+    }
+
+    // Warm up while finding a batch size that keeps timer overhead out of
+    // the numbers.
+    uint32 batch = 1;
+    for (;;)
+    {
+        int64_t start = monotonic_nanoseconds();
+        function(param, batch);
+        int64_t elapsed = monotonic_nanoseconds() - start;
+        if ((elapsed >= BENCH_MIN_SAMPLE_NS) || (batch >= BENCH_MAX_BATCH))
+        {
+            break;
+        }
+        batch *= 2;
+    }
+
+    uint32 sample_count = global_options.samples;
+    real64 *samples = (real64 *)calloc(sample_count, sizeof(real64));
+    int64_t total_ns = 0;
+    for (uint32 i = 0; i < sample_count; ++i)
+    {
+        int64_t start = monotonic_nanoseconds();
+        function(param, batch);
+        int64_t elapsed = monotonic_nanoseconds() - start;
+        total_ns += elapsed;
+        samples[i] = (real64)elapsed / batch;
+    }
+    qsort(samples, sample_count, sizeof(real64), compare_real64);
+
+    printf("case=%s samples=%u batch=%u median_ns=%.1f p99_ns=%.1f iterations_per_second=%.0f\n",
+        name, sample_count, batch,
+        samples[sample_count / 2],
+        samples[(sample_count * 99) / 100],
+        (1.0e9 * sample_count * batch) / total_ns);
+    fflush(stdout);
+    free(samples);
+}
+
+//
+// Presentation
+//
+
+struct gl_bench
+{
+    gl_presenter *presenter;
+    gl_presenter rgba8;
+    gl_presenter rgb565;
+    uint8_t *texture_buffer;
+    uint16 *rgb565_buffer;
+    uint bgra_texture_id;
+    gl_program_cache *program_cache;
+};
+
+// glFinish is what makes the driver actually do the copy; otherwise we'd
+// only be timing how fast it can queue one.  Includes any conversion the
+// presenter's upload format needs.
+internal void
+bench_texture_upload(void *param, uint32 iterations)
+{
+    gl_bench *bench = (gl_bench *)param;
+    glBindTexture(GL_TEXTURE_2D, bench->presenter->texture_id);
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        gl_presenter_upload(bench->presenter, bench->texture_buffer, 0);
+        glFinish();
+    }
+}
+
+internal void
+bench_texture_upload_bgra(void *param, uint32 iterations)
+{
+    gl_bench *bench = (gl_bench *)param;
+    glBindTexture(GL_TEXTURE_2D, bench->bgra_texture_id);
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT,
+            GL_BGRA_EXT, GL_UNSIGNED_BYTE, bench->texture_buffer);
+        glFinish();
+    }
+}
+
+internal void
+bench_present_draw(void *param, uint32 iterations)
+{
+    gl_bench *bench = (gl_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        gl_presenter_draw(bench->presenter, bench->texture_buffer);
+        glFinish();
+    }
+}
+
+// The GPU's share of presenting: the scale from the game's buffer to the
+// surface, without the upload.
+internal void
+bench_upscale(void *param, uint32 iterations)
+{
+    gl_presenter *presenter = (gl_presenter *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        gl_presenter_blit(presenter);
+        glFinish();
+    }
+}
+
+// What a new window costs the presenter, with the program compiled from
+// source or loaded from the binary cache.
+internal void
+bench_presenter_init(void *param, uint32 iterations)
+{
+    gl_bench *bench = (gl_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        gl_presenter presenter = {};
+        gl_presenter_init(&presenter, bench->texture_buffer, bench->rgb565_buffer,
+            make_upload_strategy(UPLOAD_RGBA8, UPDATE_SUB_IMAGE), SCALE_STRETCH, bench->program_cache);
+        glFinish();
+        gl_presenter_destroy(&presenter);
+    }
+}
+
+internal void
+remove_directory(char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (dir)
+    {
+        dirent *entry;
+        while ((entry = readdir(dir)))
+        {
+            if (entry->d_name[0] != '.')
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+                unlink(path);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(directory);
+}
+
+struct swizzle_bench
+{
+    uint32 *source;
+    uint32 *dest;
+};
+
+// The game writes BGRA and GLES2 only takes RGBA without an extension; the
+// presenter swaps channels in the shader, this is what it costs on the CPU.
+internal void
+bench_bgra_swizzle(void *param, uint32 iterations)
+{
+    swizzle_bench *bench = (swizzle_bench *)param;
+    uint32 pixel_count = GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        uint32 *source = bench->source;
+        uint32 *dest = bench->dest;
+        for (uint32 pixel = 0; pixel < pixel_count; ++pixel)
+        {
+            uint32 bgra = source[pixel];
+            dest[pixel] = (bgra & 0xff00ff00) | ((bgra >> 16) & 0xff) | ((bgra & 0xff) << 16);
+        }
+        // Keep the compiler from dropping all but the last pass.
+        __asm__ __volatile__("" : : "r"(dest) : "memory");
+    }
+}
+
+struct overlay_bench
+{
+    perf_overlay overlay;
+    uint8_t *buffer;
+};
+
+// A full history and every line of text, as it is when left on.
+internal void
+bench_overlay_draw(void *param, uint32 iterations)
+{
+    overlay_bench *bench = (overlay_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        overlay_draw(&bench->overlay, bench->buffer, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT, GAME_BUFFER_WIDTH * 4);
+        __asm__ __volatile__("" : : "r"(bench->buffer) : "memory");
+    }
+}
+
+struct rgb565_bench
+{
+    uint32 *source;
+    uint16 *dest;
+};
+
+internal void
+bench_rgb565_scalar(void *param, uint32 iterations)
+{
+    rgb565_bench *bench = (rgb565_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        pixels_bgra_to_rgb565_scalar(bench->dest, bench->source, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT);
+        __asm__ __volatile__("" : : "r"(bench->dest) : "memory");
+    }
+}
+
+internal void
+bench_rgb565_simd(void *param, uint32 iterations)
+{
+    rgb565_bench *bench = (rgb565_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        pixels_bgra_to_rgb565_simd(bench->dest, bench->source, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT);
+        __asm__ __volatile__("" : : "r"(bench->dest) : "memory");
+    }
+}
+
+internal uint32
+expand_bits(uint32 value, uint32 bits)
+{
+    // What the GPU does when sampling: replicate the top bits into the
+    // bottom ones.
+    return (value << (8 - bits)) | (value >> (2 * bits - 8));
+}
+
+// How far the RGB565 texture ends up from the RGBA8 one, on a set of smooth
+// gradients (where banding would show).  Undithered truncation is listed
+// alongside for comparison; the RGBA8 path is exact.
+internal void
+report_rgb565_quality(rgb565_bench *bench)
+{
+    if (global_options.only_case && strcmp(global_options.only_case, "rgb565_quality"))
+    {
+        return;
+    }
+
+    uint32 width = GAME_BUFFER_WIDTH;
+    uint32 height = GAME_BUFFER_HEIGHT;
+    for (uint32 y = 0; y < height; ++y)
+    {
+        for (uint32 x = 0; x < width; ++x)
+        {
+            uint32 b = (x * 255) / (width - 1);
+            uint32 g = (y * 255) / (height - 1);
+            uint32 r = ((x + y) * 255) / (width + height - 2);
+            bench->source[y * width + x] = 0xff000000 | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    uint16 *reference = (uint16 *)malloc(sizeof(uint16) * width * height);
+    pixels_bgra_to_rgb565_scalar(reference, bench->source, width, height);
+    pixels_bgra_to_rgb565_simd(bench->dest, bench->source, width, height);
+    bool32 simd_matches = !memcmp(reference, bench->dest, sizeof(uint16) * width * height);
+
+    // The eye averages neighbouring pixels, so besides the per-pixel error
+    // the error of each 4x4 block's average is reported: that is where
+    // dithering wins and banding shows.
+    real64 squared_error[2] = {};
+    real64 error[2] = {};
+    real64 block_squared_error[2] = {};
+    for (uint32 block_y = 0; block_y < height; block_y += 4)
+    {
+        for (uint32 block_x = 0; block_x < width; block_x += 4)
+        {
+            int32 block_difference[2][3] = {};
+            for (uint32 y = block_y; y < block_y + 4; ++y)
+            {
+                for (uint32 x = block_x; x < block_x + 4; ++x)
+                {
+                    uint32 bgra = bench->source[y * width + x];
+                    uint32 packed = reference[y * width + x];
+                    int32 original[3] = {(int32)(bgra & 0xff), (int32)((bgra >> 8) & 0xff), (int32)((bgra >> 16) & 0xff)};
+                    int32 converted[2][3] =
+                    {
+                        {(int32)expand_bits(packed >> 11, 5), (int32)expand_bits((packed >> 5) & 0x3f, 6),
+                            (int32)expand_bits(packed & 0x1f, 5)},
+                        {(int32)expand_bits(original[0] >> 3, 5), (int32)expand_bits(original[1] >> 2, 6),
+                            (int32)expand_bits(original[2] >> 3, 5)},
+                    };
+                    for (uint32 method = 0; method < 2; ++method)
+                    {
+                        for (uint32 channel = 0; channel < 3; ++channel)
+                        {
+                            int32 difference = converted[method][channel] - original[channel];
+                            squared_error[method] += difference * difference;
+                            error[method] += difference;
+                            block_difference[method][channel] += difference;
+                        }
+                    }
+                }
+            }
+            for (uint32 method = 0; method < 2; ++method)
+            {
+                for (uint32 channel = 0; channel < 3; ++channel)
+                {
+                    real64 difference = block_difference[method][channel] / 16.0;
+                    block_squared_error[method] += difference * difference;
+                }
+            }
+        }
+    }
+
+    real64 samples = 3.0 * width * height;
+    real64 block_samples = samples / 16;
+    printf("case=rgb565_quality simd_matches_reference=%d"
+        " psnr_db=%.2f block_psnr_db=%.2f mean_error=%.3f"
+        " undithered_psnr_db=%.2f undithered_block_psnr_db=%.2f undithered_mean_error=%.3f"
+        " bytes_per_frame=%u rgba8_bytes_per_frame=%u\n",
+        simd_matches ? 1 : 0,
+        10.0 * log10((255.0 * 255.0) / (squared_error[0] / samples)),
+        10.0 * log10((255.0 * 255.0) / (block_squared_error[0] / block_samples)),
+        error[0] / samples,
+        10.0 * log10((255.0 * 255.0) / (squared_error[1] / samples)),
+        10.0 * log10((255.0 * 255.0) / (block_squared_error[1] / block_samples)),
+        error[1] / samples,
+        (uint32)(sizeof(uint16) * width * height), (uint32)(4 * width * height));
+    fflush(stdout);
+    free(reference);
+}
+
+//
+// Audio
+//
+
+#define BENCH_RESAMPLE_OUTPUT_FRAMES 4000
+
+internal int16
+resampler_check_sample(uint32 frame, uint32 channel)
+{
+    uint32 value = (frame * 2 + channel) * 2654435761u;
+    return (int16)(value >> 16);
+}
+
+// Resamples BENCH_RESAMPLE_OUTPUT_FRAMES frames of input, output_frames at
+// a time, into out.  Every input buffer is exactly the size asked for, and
+// so is the resampler's own work buffer.
+internal void
+resampler_check_run(memory_arena *scratch, uint32 input_rate, uint32 output_rate, uint32 output_frames,
+    float *out_l, float *out_r)
+{
+    uint32 max_input_frames = (uint32)(((uint64_t)output_frames * input_rate) / output_rate) + 2;
+    temporary_memory temporary = begin_temporary_memory(scratch);
+    mixer_resampler resampler = {};
+    if (!mixer_resampler_init(&resampler, scratch, input_rate, output_rate, max_input_frames))
+    {
+        end_temporary_memory(temporary);
+        return;
+    }
+    uint32 input_position = 0;
+    for (uint32 done = 0; done < BENCH_RESAMPLE_OUTPUT_FRAMES; done += output_frames)
+    {
+        uint32 frames = BENCH_RESAMPLE_OUTPUT_FRAMES - done;
+        frames = (frames < output_frames) ? frames : output_frames;
+        uint32 input_frames = mixer_resampler_input_frames(&resampler, frames);
+        Assert(input_frames <= max_input_frames);
+        int16 *input = (int16 *)malloc(2 * sizeof(int16) * (input_frames ? input_frames : 1));
+        for (uint32 frame = 0; frame < input_frames; ++frame)
+        {
+            input[2 * frame + 0] = resampler_check_sample(input_position + frame, 0);
+            input[2 * frame + 1] = resampler_check_sample(input_position + frame, 1);
+        }
+        mixer_resample(&resampler, 0, input, input_frames, out_l + done, out_r + done, frames);
+        input_position += input_frames;
+        free(input);
+    }
+    end_temporary_memory(temporary);
+}
+
+// Resampling a stream in pieces has to give exactly what resampling it in
+// one go does, whatever the size of the pieces, or the resampler is reading
+// input it wasn't given or losing track of what it consumed.
+internal void
+report_resampler_check(void)
+{
+    if (global_options.only_case && strcmp(global_options.only_case, "resampler_check"))
+    {
+        return;
+    }
+
+    // Poisoned, so a resampler that doesn't clear its history shows up too.
+    platform_memory memory;
+    if (!platform_memory_init(&memory, MEMORY_PAGE, 1024 * 1024, 1))
+    {
+        return;
+    }
+
+    uint32 rates[][2] = {{44100, 48000}, {48000, 44100}, {48000, 48000}, {22050, 48000}, {48000, 32000}};
+    size_t output_bytes = BENCH_RESAMPLE_OUTPUT_FRAMES * sizeof(float);
+    float *whole_l = (float *)malloc(output_bytes);
+    float *whole_r = (float *)malloc(output_bytes);
+    float *pieces_l = (float *)malloc(output_bytes);
+    float *pieces_r = (float *)malloc(output_bytes);
+    uint32 runs = 0;
+    uint32 mismatched_runs = 0;
+    for (uint32 rate = 0; rate < ArrayCount(rates); ++rate)
+    {
+        resampler_check_run(&memory.scratch, rates[rate][0], rates[rate][1], BENCH_RESAMPLE_OUTPUT_FRAMES,
+            whole_l, whole_r);
+        for (uint32 output_frames = 1; output_frames <= 400; ++output_frames)
+        {
+            resampler_check_run(&memory.scratch, rates[rate][0], rates[rate][1], output_frames, pieces_l, pieces_r);
+            ++runs;
+            if (memcmp(whole_l, pieces_l, output_bytes) || memcmp(whole_r, pieces_r, output_bytes))
+            {
+                ++mismatched_runs;
+            }
+        }
+    }
+    printf("case=resampler_check pieces_match_whole=%d runs=%u mismatched_runs=%u\n",
+        mismatched_runs ? 0 : 1, runs, mismatched_runs);
+    fflush(stdout);
+    free(whole_l);
+    free(whole_r);
+    free(pieces_l);
+    free(pieces_r);
+}
+
+//
+// Pacing
+//
+
+#define BENCH_PRESENT_LAG_FRAMES 5000
+
+// Swaps at a steady period_ns, which needn't be the pacer's frame_ns: the
+// manual loop sleeps in whole milliseconds, and a panel needn't be the 60 Hz
+// it's taken for.  Returns the most any frame asked to be held past its swap.
+internal int64_t
+present_lag_check_run(pacing_mode mode, int64_t period_ns)
+{
+    frame_pacer pacer;
+    frame_pacer_init(&pacer, mode, 60);
+    int64_t max_lag_ns = 0;
+    int64_t swap_start_ns = 1000000000;
+    for (uint32 frame = 0; frame < BENCH_PRESENT_LAG_FRAMES; ++frame)
+    {
+        frame_pacer_present_time(&pacer, swap_start_ns);
+        if (pacer.last_present_lag_ns > max_lag_ns)
+        {
+            max_lag_ns = pacer.last_present_lag_ns;
+        }
+        swap_start_ns += period_ns;
+    }
+    return max_lag_ns;
+}
+
+internal void
+report_present_lag_check(void)
+{
+    if (global_options.only_case && strcmp(global_options.only_case, "present_lag_check"))
+    {
+        return;
+    }
+
+    // Whole-millisecond sleeps at 30 Hz, then 90, 60, 59.94 and 50 Hz panels.
+    int64_t periods_ns[] = {33000000, 11111111, 16666666, 16683350, 20000000};
+    for (uint32 mode = 0; mode < PACING_MODE_COUNT; ++mode)
+    {
+        frame_pacer pacer;
+        frame_pacer_init(&pacer, (pacing_mode)mode, 60);
+        int64_t max_lag_ns = 0;
+        for (uint32 period = 0; period < ArrayCount(periods_ns); ++period)
+        {
+            int64_t lag_ns = present_lag_check_run((pacing_mode)mode, periods_ns[period]);
+            if (lag_ns > max_lag_ns)
+            {
+                max_lag_ns = lag_ns;
+            }
+        }
+        printf("case=present_lag_check mode=%s bounded=%d frames=%u max_lag_ms=%.2f\n", pacing_mode_names[mode],
+            (max_lag_ns <= pacer.frame_ns) ? 1 : 0, BENCH_PRESENT_LAG_FRAMES, max_lag_ns / 1.0e6);
+    }
+    fflush(stdout);
+}
+
+//
+// Input
+//
+
+struct input_bench
+{
+    game_input input[2];
+};
+
+internal void
+bench_button_copy(void *param, uint32 iterations)
+{
+    input_bench *bench = (input_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        game_input *new_input = &bench->input[i & 1];
+        game_input *old_input = &bench->input[(i & 1) ^ 1];
+        begin_keyboard_controller(new_input, old_input);
+        __asm__ __volatile__("" : : "r"(new_input) : "memory");
+    }
+}
+
+internal void
+bench_process_events(void *param, uint32 iterations)
+{
+    input_bench *bench = (input_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        game_input *new_input = &bench->input[i & 1];
+        game_input *old_input = &bench->input[(i & 1) ^ 1];
+        real32 stick_x = (i & 2) ? 1.0f : -1.0f;
+        process_stick_buttons(stick_x, -stick_x, new_input, old_input);
+        __asm__ __volatile__("" : : "r"(new_input) : "memory");
+    }
+}
+
+internal void
+bench_process_keyboard_message(void *param, uint32 iterations)
+{
+    input_bench *bench = (input_bench *)param;
+    // Cycles through the four direction keys, down then up.
+    int keycodes[] = {19, 20, 21, 22};
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        process_game_key(&bench->input[0], keycodes[(i >> 1) & 3], !(i & 1));
+        __asm__ __volatile__("" : : "r"(&bench->input[0]) : "memory");
+    }
+}
+
+//
+// Files
+//
+
+#if HANDMADE_INTERNAL
+internal void
+bench_read_file(void *param, uint32 iterations)
+{
+    char *filename = (char *)param;
+    thread_context t = {};
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        debug_read_file_result result = debug_read_entire_file(&t, filename);
+        debug_free_file_memory(&t, result.Contents);
+    }
+}
+#endif
+
+// A buffer the size of the game's frame, written once as a loaded bitmap
+// would be.  malloc hands anything this big to mmap, so every round trip
+// faults its pages in again; a pool block stays mapped.
+internal void
+bench_allocate_malloc(void *param, uint32 iterations)
+{
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        uint8 *block = (uint8 *)malloc(BENCH_ALLOCATION_BYTES);
+        memset(block, (uint8)i, BENCH_ALLOCATION_BYTES);
+        __asm__ __volatile__("" : : "r"(block) : "memory");
+        free(block);
+    }
+}
+
+internal void
+bench_allocate_pool(void *param, uint32 iterations)
+{
+    platform_memory *memory = (platform_memory *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        uint8 *block = (uint8 *)memory_allocate(memory, BENCH_ALLOCATION_BYTES);
+        memset(block, (uint8)i, BENCH_ALLOCATION_BYTES);
+        __asm__ __volatile__("" : : "r"(block) : "memory");
+        memory_free(memory, block);
+    }
+}
+
+#if HANDMADE_INTERNAL
+internal bool32
+write_bench_file(char *directory, char *filename, uint32 size)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", directory, filename);
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+    uint8 *contents = (uint8 *)malloc(size);
+    for (uint32 i = 0; i < size; ++i)
+    {
+        contents[i] = (uint8)(i * 31);
+    }
+    bool32 result = fwrite(contents, 1, size, file) == size;
+    fclose(file);
+    free(contents);
+    return result;
+}
+#endif
+
+//
+// Glue command channel
+//
+
+// Mirrors android_app_write_cmd: the main thread doesn't continue until the
+// app thread has taken the command and answered.  Here the answer comes
+// back through a second queue rather than the glue's condition variable.
+struct cmd_bench
+{
+    android_app_cmd_queue request;
+    android_app_cmd_queue reply;
+    pthread_t app_thread;
+};
+
+internal int8_t
+wait_cmd(android_app_cmd_queue *queue)
+{
+    pollfd fd = {queue->eventfd, POLLIN, 0};
+    int8_t cmd;
+    do
+    {
+        poll(&fd, 1, -1);
+    } while (!android_app_cmd_queue_pop(queue, &cmd));
+    return cmd;
+}
+
+internal void *
+cmd_bench_app_thread(void *param)
+{
+    cmd_bench *bench = (cmd_bench *)param;
+    for (;;)
+    {
+        int8_t cmd = wait_cmd(&bench->request);
+        android_app_cmd_queue_push(&bench->reply, cmd);
+        if (cmd < 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+internal void
+bench_cmd_round_trip(void *param, uint32 iterations)
+{
+    cmd_bench *bench = (cmd_bench *)param;
+    for (uint32 i = 0; i < iterations; ++i)
+    {
+        android_app_cmd_queue_push(&bench->request, (int8_t)(i & 15));
+        wait_cmd(&bench->reply);
+    }
+}
+
+internal void
+usage(char *program)
+{
+    fprintf(stderr, "usage: %s [--samples N] [--case NAME]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    global_options.samples = 200;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--samples") && (i + 1 < argc))
+        {
+            global_options.samples = (uint32)strtoul(argv[++i], 0, 10);
+        }
+        else if (!strcmp(argv[i], "--case") && (i + 1 < argc))
+        {
+            global_options.only_case = argv[++i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!global_options.samples)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cpu_topology topology;
+    detect_cpu_topology(&topology);
+    place_current_thread(&topology, THREAD_ROLE_GAME);
+
+    uint32 pixel_count = GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT;
+    uint32 *texture_buffer = (uint32 *)malloc(4 * pixel_count);
+    for (uint32 pixel = 0; pixel < pixel_count; ++pixel)
+    {
+        texture_buffer[pixel] = pixel * 2654435761u;
+    }
+
+    linux_egl egl = {};
+    platform_memory gl_memory;
+    if (platform_memory_init(&gl_memory, GAME_BUFFER_RGB565_SIZE, 1024 * 1024, 0) &&
+        linux_egl_init(&egl, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT))
+    {
+        gl_bench gl = {};
+        gl.texture_buffer = (uint8_t *)texture_buffer;
+        gl.rgb565_buffer = (uint16 *)memory_push_permanent(&gl_memory, GAME_BUFFER_RGB565_SIZE, MEMORY_PAGE);
+        glViewport(0, 0, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT);
+        gl_presenter_init(&gl.rgb565, gl.texture_buffer, gl.rgb565_buffer,
+            make_upload_strategy(UPLOAD_RGB565, UPDATE_SUB_IMAGE), SCALE_STRETCH, 0);
+        gl_presenter_init(&gl.rgba8, gl.texture_buffer, gl.rgb565_buffer,
+            make_upload_strategy(UPLOAD_RGBA8, UPDATE_SUB_IMAGE), SCALE_STRETCH, 0);
+        gl.presenter = &gl.rgba8;
+
+        run_bench((char *)"texture_upload", bench_texture_upload, &gl);
+        if (strstr((char *)glGetString(GL_EXTENSIONS), "GL_EXT_texture_format_BGRA8888"))
+        {
+            glGenTextures(1, &gl.bgra_texture_id);
+            glBindTexture(GL_TEXTURE_2D, gl.bgra_texture_id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT, 0,
+                GL_BGRA_EXT, GL_UNSIGNED_BYTE, gl.texture_buffer);
+            run_bench((char *)"texture_upload_bgra_ext", bench_texture_upload_bgra, &gl);
+        }
+        run_bench((char *)"present_draw", bench_present_draw, &gl);
+
+        gl.presenter = &gl.rgb565;
+        run_bench((char *)"texture_upload_rgb565", bench_texture_upload, &gl);
+        run_bench((char *)"present_draw_rgb565", bench_present_draw, &gl);
+
+        run_bench((char *)"presenter_init", bench_presenter_init, &gl);
+        char program_directory[] = "/tmp/platform_bench_programs.XXXXXX";
+        gl_program_cache program_cache;
+        if (mkdtemp(program_directory) && gl_program_cache_init(&program_cache, program_directory, &gl_memory.scratch))
+        {
+            gl.program_cache = &program_cache;
+            run_bench((char *)"presenter_init_cached", bench_presenter_init, &gl);
+            gl.program_cache = 0;
+            remove_directory(program_directory);
+        }
+        else
+        {
+            fprintf(stderr, "no program binaries, skipping presenter_init_cached\n");
+        }
+
+        // A TV's 1080p and 4K surfaces.
+        int32 outputs[][2] = {{1920, 1080}, {3840, 2160}};
+        for (uint32 output = 0; output < ArrayCount(outputs); ++output)
+        {
+            int32 width = outputs[output][0];
+            int32 height = outputs[output][1];
+            if (!linux_egl_resize(&egl, width, height))
+            {
+                fprintf(stderr, "no %dx%d pbuffer, skipping its upscale cases\n", width, height);
+                continue;
+            }
+            glViewport(0, 0, width, height);
+            for (uint32 scale = 0; scale < SCALE_MODE_COUNT; ++scale)
+            {
+                gl_presenter presenter = {};
+                gl_presenter_init(&presenter, gl.texture_buffer, gl.rgb565_buffer,
+                    make_upload_strategy(UPLOAD_RGBA8, UPDATE_SUB_IMAGE), (scale_mode)scale, 0);
+                gl_presenter_set_output(&presenter, width, height);
+                char name[64];
+                snprintf(name, sizeof(name), "upscale_%s_%dp", scale_mode_names[scale], height);
+                run_bench(name, bench_upscale, &presenter);
+                gl_presenter_destroy(&presenter);
+            }
+        }
+    }
+    else
+    {
+        fprintf(stderr, "no EGL context, skipping GL cases\n");
+    }
+
+    swizzle_bench swizzle = {};
+    swizzle.source = texture_buffer;
+    swizzle.dest = (uint32 *)malloc(4 * pixel_count);
+    run_bench((char *)"bgra_swizzle", bench_bgra_swizzle, &swizzle);
+
+    rgb565_bench rgb565 = {};
+    rgb565.source = texture_buffer;
+    rgb565.dest = (uint16 *)malloc(sizeof(uint16) * pixel_count);
+    run_bench((char *)"rgb565_convert_scalar", bench_rgb565_scalar, &rgb565);
+    run_bench((char *)"rgb565_convert_simd", bench_rgb565_simd, &rgb565);
+    // Overwrites the buffer with gradients, so goes after everything else
+    // that uses it.
+    report_rgb565_quality(&rgb565);
+
+    report_resampler_check();
+    report_present_lag_check();
+
+    overlay_bench *overlay = (overlay_bench *)calloc(1, sizeof(overlay_bench));
+    overlay_init(&overlay->overlay, 33333333, 30.0f, 1);
+    for (uint32 frame = 0; frame < OVERLAY_HISTORY_COUNT; ++frame)
+    {
+        overlay_record_frame(&overlay->overlay, (frame * 7919) % 40000000);
+    }
+    for (uint32 stage = 0; stage < OVERLAY_STAGE_COUNT; ++stage)
+    {
+        overlay_record_stage(&overlay->overlay, (overlay_stage)stage, (stage + 1) * 1000000);
+    }
+    overlay->buffer = (uint8_t *)swizzle.dest;
+    run_bench((char *)"overlay_draw", bench_overlay_draw, overlay);
+
+    input_bench *input = (input_bench *)calloc(1, sizeof(input_bench));
+    run_bench((char *)"button_copy", bench_button_copy, input);
+    run_bench((char *)"process_events", bench_process_events, input);
+    run_bench((char *)"process_keyboard_message", bench_process_keyboard_message, input);
+
+    platform_memory *allocation_memory = (platform_memory *)calloc(1, sizeof(platform_memory));
+    if (platform_memory_init(allocation_memory, MEMORY_PAGE, MEMORY_PAGE, 0))
+    {
+        run_bench((char *)"allocate_frame_malloc", bench_allocate_malloc, 0);
+        run_bench((char *)"allocate_frame_pool", bench_allocate_pool, allocation_memory);
+    }
+
+#if HANDMADE_INTERNAL
+    char directory[] = "/tmp/platform_bench.XXXXXX";
+    if (mkdtemp(directory) &&
+        write_bench_file(directory, (char *)"small.bin", BENCH_SMALL_FILE_BYTES) &&
+        write_bench_file(directory, (char *)"large.bin", BENCH_LARGE_FILE_BYTES))
+    {
+        global_asset_root = directory;
+        run_bench((char *)"read_entire_file_small", bench_read_file, (void *)"small.bin");
+        run_bench((char *)"read_entire_file_large", bench_read_file, (void *)"large.bin");
+
+        platform_memory memory;
+        if (platform_memory_init(&memory, MEMORY_PAGE, MEMORY_PAGE, 0))
+        {
+            global_file_memory = &memory;
+            run_bench((char *)"read_entire_file_small_pooled", bench_read_file, (void *)"small.bin");
+            global_file_memory = 0;
+        }
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/small.bin", directory);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/large.bin", directory);
+        unlink(path);
+        rmdir(directory);
+    }
+    else
+    {
+        fprintf(stderr, "couldn't write files under /tmp, skipping file cases\n");
+    }
+#endif
+
+    cmd_bench cmd = {};
+    if (android_app_cmd_queue_init(&cmd.request) && android_app_cmd_queue_init(&cmd.reply))
+    {
+        pthread_create(&cmd.app_thread, 0, cmd_bench_app_thread, &cmd);
+        run_bench((char *)"cmd_round_trip", bench_cmd_round_trip, &cmd);
+        android_app_cmd_queue_push(&cmd.request, -1);
+        pthread_join(cmd.app_thread, 0);
+        android_app_cmd_queue_destroy(&cmd.request);
+        android_app_cmd_queue_destroy(&cmd.reply);
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#ifndef _ANDROID_APP_CMD_QUEUE_H
+#define _ANDROID_APP_CMD_QUEUE_H
+
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Command channel from the activity's main thread to the app thread.
+ *
+ * Commands go into a single-producer single-consumer ring; the only
+ * producer is the main thread (every ANativeActivity callback runs on it),
+ * the only consumer is the thread running android_main().  Commands come
+ * out one at a time in the order they went in, as they did through the old
+ * pipe.
+ *
+ * After each push the producer bumps an eventfd, which is what the app
+ * thread's ALooper waits on.  The consumer only resets the eventfd once it
+ * has drained the ring, so a burst of commands costs one read() instead of
+ * one per command.
+ */
+
+#define APP_CMD_QUEUE_SIZE 256
+
+struct android_app_cmd_queue {
+    int8_t cmds[APP_CMD_QUEUE_SIZE];
+
+    // Free-running counters; head is only stored by the producer and tail
+    // only by the consumer.
+    uint32_t head;
+    uint32_t tail;
+
+    int eventfd;
+};
+
+static inline int android_app_cmd_queue_init(struct android_app_cmd_queue* queue) {
+    queue->head = 0;
+    queue->tail = 0;
+    queue->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    return queue->eventfd >= 0;
+}
+
+static inline void android_app_cmd_queue_destroy(struct android_app_cmd_queue* queue) {
+    close(queue->eventfd);
+    queue->eventfd = -1;
+}
+
+/**
+ * Producer side.  Returns 0 if the eventfd could not be signalled.
+ */
+static inline int android_app_cmd_queue_push(struct android_app_cmd_queue* queue, int8_t cmd) {
+    uint32_t head = queue->head;
+    // The app thread is stuck if it hasn't taken a command out of a full
+    // queue; waiting is the same thing a full pipe would have done.
+    while (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= APP_CMD_QUEUE_SIZE) {
+        sched_yield();
+    }
+    queue->cmds[head % APP_CMD_QUEUE_SIZE] = cmd;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+    uint64_t one = 1;
+    return write(queue->eventfd, &one, sizeof(one)) == sizeof(one);
+}
+
+/**
+ * Consumer side, called when the eventfd polls readable.  Returns 0 if
+ * there was nothing to take, which can happen when a producer's signal
+ * lands just after the consumer already took its command.
+ */
+static inline int android_app_cmd_queue_pop(struct android_app_cmd_queue* queue, int8_t* cmd) {
+    uint32_t tail = queue->tail;
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    int result = 0;
+    if (head != tail) {
+        *cmd = queue->cmds[tail % APP_CMD_QUEUE_SIZE];
+        __atomic_store_n(&queue->tail, ++tail, __ATOMIC_RELEASE);
+        result = 1;
+    }
+    if (head == tail) {
+        // Looks drained, so clear the signal.  A push whose signal we just
+        // swallowed published its command before signalling, so it is
+        // visible now; put the signal back for it.
+        uint64_t count;
+        read(queue->eventfd, &count, sizeof(count));
+        if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) != tail) {
+            uint64_t one = 1;
+            write(queue->eventfd, &one, sizeof(one));
+        }
+    }
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ANDROID_APP_CMD_QUEUE_H */
@@ -47,15 +47,13 @@ static void free_saved_state(struct android_app* android_app) {
 
 int8_t android_app_read_cmd(struct android_app* android_app) {
     int8_t cmd;
-    if (read(android_app->msgread, &cmd, sizeof(cmd)) == sizeof(cmd)) {
+    if (android_app_cmd_queue_pop(&android_app->cmdQueue, &cmd)) {
         switch (cmd) {
             case APP_CMD_SAVE_STATE:
                 free_saved_state(android_app);
                 break;
         }
         return cmd;
-    } else {
-        LOGE("No data on command pipe!");
     }
     return -1;
 }
@@ -199,6 +197,9 @@ static void process_input(struct android_app* app, struct android_poll_source* s
 
 static void process_cmd(struct android_app* app, struct android_poll_source* source) {
     int8_t cmd = android_app_read_cmd(app);
+    if (cmd < 0) {
+        return;
+    }
     android_app_pre_exec_cmd(app, cmd);
     if (app->onAppCmd != NULL) app->onAppCmd(app, cmd);
     android_app_post_exec_cmd(app, cmd);
@@ -220,7 +221,7 @@ static void* android_app_entry(void* param) {
     android_app->inputPollSource.process = process_input;
 
     ALooper* looper = ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
-    ALooper_addFd(looper, android_app->msgread, LOOPER_ID_MAIN, ALOOPER_EVENT_INPUT, NULL,
+    ALooper_addFd(looper, android_app->cmdQueue.eventfd, LOOPER_ID_MAIN, ALOOPER_EVENT_INPUT, NULL,
             &android_app->cmdPollSource);
     android_app->looper = looper;
 
@@ -254,13 +255,10 @@ static struct android_app* android_app_create(ANativeActivity* activity,
         memcpy(android_app->savedState, savedState, savedStateSize);
     }
 
-    int msgpipe[2];
-    if (pipe(msgpipe)) {
-        LOGE("could not create pipe: %s", strerror(errno));
+    if (!android_app_cmd_queue_init(&android_app->cmdQueue)) {
+        LOGE("could not create eventfd: %s", strerror(errno));
         return NULL;
     }
-    android_app->msgread = msgpipe[0];
-    android_app->msgwrite = msgpipe[1];
 
     pthread_attr_t attr; 
     pthread_attr_init(&attr);
@@ -278,7 +276,7 @@ static struct android_app* android_app_create(ANativeActivity* activity,
 }
 
 static void android_app_write_cmd(struct android_app* android_app, int8_t cmd) {
-    if (write(android_app->msgwrite, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+    if (!android_app_cmd_queue_push(&android_app->cmdQueue, cmd)) {
         LOGE("Failure writing android_app cmd: %s\n", strerror(errno));
     }
 }
@@ -325,8 +323,7 @@ static void android_app_free(struct android_app* android_app) {
     }
     pthread_mutex_unlock(&android_app->mutex);
 
-    close(android_app->msgread);
-    close(android_app->msgwrite);
+    android_app_cmd_queue_destroy(&android_app->cmdQueue);
     pthread_cond_destroy(&android_app->cond);
     pthread_mutex_destroy(&android_app->mutex);
     free(android_app);
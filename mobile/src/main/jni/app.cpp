@@ -7,12 +7,136 @@
 #include <GLES2/gl2.h>
 
 #include <android/log.h>
+#include <sys/system_properties.h>
 #include "android_native_app_glue.h"
 
 #include "handmade_platform.h"
 
 #include "handmade.cpp"
 
+#include "app_audio.h"
+#include "app_counters.h"
+#include "app_flight.h"
+#include "app_frame.h"
+#include "app_frame_stats.h"
+#include "app_game_code.h"
+#include "app_gl.h"
+#include "app_gl_tune.h"
+#include "app_hot_path.h"
+#include "app_input.h"
+#include "app_latency.h"
+#include "app_lifecycle.h"
+#include "app_memory.h"
+#include "app_mixer.h"
+#include "app_overlay.h"
+#include "app_persist.h"
+#include "app_present.h"
+#include "app_profiler.h"
+#include "app_threads.h"
+#include "app_timed_blocks.h"
+
+#ifndef HANDMADE_LATE_LATCH
+#define HANDMADE_LATE_LATCH 0
+#endif
+
+#ifndef HANDMADE_AUDIO_OUTPUT_HZ
+#define HANDMADE_AUDIO_OUTPUT_HZ 48000
+#endif
+
+// 0 paces with a sleep and doesn't wait for vsync, 1 swaps on every vblank
+// (the game runs at the refresh rate), 2 on every second one.
+#ifndef HANDMADE_PACING
+#define HANDMADE_PACING 0
+#endif
+
+// Upload the game's buffer as dithered RGB565 instead of RGBA8, for half
+// the memory bandwidth.
+#ifndef HANDMADE_UPLOAD_RGB565
+#define HANDMADE_UPLOAD_RGB565 0
+#endif
+
+// How the game's buffer is scaled to the window (see app_gl.h): 0 stretches
+// it over the whole window, 1 takes the largest whole multiple that fits, 2
+// keeps the aspect ratio with sharp bilinear filtering.  The tv module
+// builds with HANDMADE_TV, for which sharp is the default.
+#ifndef HANDMADE_SCALING
+#if HANDMADE_TV
+#define HANDMADE_SCALING 2
+#else
+#define HANDMADE_SCALING 0
+#endif
+#endif
+
+// Time the upload strategies on first launch and use the fastest; 0 always
+// uses the plain one above.
+#ifndef HANDMADE_UPLOAD_TUNING
+#define HANDMADE_UPLOAD_TUNING 1
+#endif
+
+// Keep linked shader binaries in the internal data directory, so a new
+// window doesn't have to compile them again.
+#ifndef HANDMADE_PROGRAM_CACHE
+#define HANDMADE_PROGRAM_CACHE 1
+#endif
+
+// Keep the EGL context, and the program and texture in it, while there's
+// no window; 0 tears everything down in term() as it used to.
+#ifndef HANDMADE_KEEP_CONTEXT
+#define HANDMADE_KEEP_CONTEXT 1
+#endif
+
+// Show the performance overlay from the start.  Either way the ` key or a
+// three finger tap toggles it.
+#ifndef HANDMADE_OVERLAY
+#define HANDMADE_OVERLAY 0
+#endif
+
+// Switch to the next build of the game code (see app_game_code.h) every
+// this many frames; 0 leaves it to the F2 key.
+#ifndef HANDMADE_GAME_SWAP_FRAMES
+#define HANDMADE_GAME_SWAP_FRAMES 0
+#endif
+
+// Map PermanentStorage from a file in the internal data directory, so the
+// game carries on where it was after the process is killed.  Only for games
+// that keep all their state, pointers included, inside it.
+#ifndef HANDMADE_PERSISTENT_STORAGE
+#define HANDMADE_PERSISTENT_STORAGE 0
+#endif
+
+// Poison freed platform memory and check it when it's reused (see
+// app_memory.h).
+#ifndef HANDMADE_MEMORY_POISON
+#if HANDMADE_SLOW
+#define HANDMADE_MEMORY_POISON 1
+#else
+#define HANDMADE_MEMORY_POISON 0
+#endif
+#endif
+
+// Keep the last few thousand frames' timings, input and lifecycle commands
+// in flight_recorder.bin, where they survive a crash.
+#ifndef HANDMADE_FLIGHT_RECORDER
+#define HANDMADE_FLIGHT_RECORDER 1
+#endif
+
+// Sample the game thread this many times a second of its CPU time (see
+// app_profiler.h) into profile.folded, written whenever the activity pauses;
+// 0 doesn't profile.
+#ifndef HANDMADE_PROFILER_HZ
+#define HANDMADE_PROFILER_HZ 0
+#endif
+
+// Count cycles, instructions, cache and branch misses and page faults per
+// frame stage (see app_counters.h), logged every 150 frames.
+#ifndef HANDMADE_COUNTERS
+#define HANDMADE_COUNTERS 0
+#endif
+
+#ifndef HANDMADE_SYNTHETIC_INPUT
+#define HANDMADE_SYNTHETIC_INPUT 0
+#endif
+
 struct pan_state {
     bool32 in_pan;
     v2 start_pos;
@@ -27,21 +151,36 @@ struct motion_state {
 struct user_data {
     char app_name[64];
     EGLDisplay display;
+    EGLConfig config;
     EGLSurface surface;
     EGLContext context;
 
     bool drawable;
-
-    uint program;
-    uint a_pos_id;
-    uint a_tex_coord_id;
-    uint texture_id;
-    uint sampler_id;
-
+    int64_t window_start_ns;
+    lifecycle_state lifecycle;
+    perf_overlay overlay;
+    flight_recorder flight;
+    sampling_profiler *profiler;
+    perf_counters counters;
+    hot_path_tracker hot_path;
+    timed_block_set timed_blocks;
+    uint32 frame_input_events;
+
+    gl_presenter gl;
+    gl_program_cache program_cache;
+    upload_strategy upload;
+    bool32 upload_tuned;
+    char upload_tuning_path[1024];
+    frame_pacer pacer;
+
+    platform_memory memory;
     uint8_t *texture_buffer;
+    uint16 *rgb565_buffer;
 
     uint64_t total_size;
     void *game_memory_block;
+    persistent_storage persist;
+    game_code_set games;
 
     char binary_name[1024];
     char *one_past_binary_filename_slash;
@@ -50,6 +189,23 @@ struct user_data {
 
     game_input *new_input;
     game_input *old_input;
+
+    audio_output audio;
+    audio_mixer mixer;
+    mixer_stream *game_sound;
+
+    cpu_topology topology;
+    thread_placement game_thread;
+    thread_sched_stats game_thread_sched;
+
+    latency_probe latency;
+    late_latch_state latch;
+
+    frame_stats frames;
+    char frame_stats_path[1024];
+#if HANDMADE_SYNTHETIC_INPUT
+    synthetic_input_injector synthetic_input;
+#endif
 };
 
 char *cmd_names[] = {
@@ -71,10 +227,9 @@ char *cmd_names[] = {
     "APP_CMD_DESTROY",
 };
 
-void init(android_app *app)
+internal void
+egl_create_context(user_data *p)
 {
-    user_data *p = (user_data *)app->userData;
-
     p->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     eglInitialize(p->display, 0, 0);
 
@@ -87,120 +242,163 @@ void init(android_app *app)
         EGL_NONE
     };
 
-    EGLConfig config;
     int num_config;
-    eglChooseConfig(p->display, attrib_list, &config, 1, &num_config);
-
-    int format;
-    eglGetConfigAttrib(p->display, config, EGL_NATIVE_VISUAL_ID, &format);
-
-    ANativeWindow_setBuffersGeometry(app->window, 0, 0, format);
-    p->surface = eglCreateWindowSurface(p->display, config, app->window, 0);
+    eglChooseConfig(p->display, attrib_list, &p->config, 1, &num_config);
 
     const int context_attribs[] = {
         EGL_CONTEXT_CLIENT_VERSION, 2,
         EGL_NONE
     };
     eglBindAPI(EGL_OPENGL_ES_API);
-    p->context = eglCreateContext(p->display, config, EGL_NO_CONTEXT, context_attribs);
-
-    eglMakeCurrent(p->display, p->surface, p->surface, p->context);
+    p->context = eglCreateContext(p->display, p->config, EGL_NO_CONTEXT, context_attribs);
+}
 
-    p->program = glCreateProgram();
-    char *vertex_shader_source =
-        "attribute vec2 a_pos; \n"
-        "attribute vec2 a_tex_coord; \n"
-        "varying vec2 v_tex_coord; \n"
-        "void main() \n"
-        "{ \n"
-        " gl_Position = vec4(a_pos, 0, 1); \n"
-        " v_tex_coord = a_tex_coord; \n"
-        "} \n";
-
-
-    char *fragment_shader_source =
-        "precision mediump float;\n"
-        "varying vec2 v_tex_coord;\n"
-        "uniform sampler2D tex;\n"
-        "void main() \n"
-        "{ \n"
-        " vec4 texture_color = vec4(texture2D( tex, v_tex_coord ).bgr, 1.0);\n"
-        " gl_FragColor = texture_color;\n"
-        "} \n";
-
-    uint vertex_shader_id;
-    uint fragment_shader_id;
-
-    {
-        uint shader = vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-        int compiled;
-        glShaderSource(shader, 1, (const char* const *)&vertex_shader_source, 0);
-        glCompileShader(shader);
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-        if (!compiled)
-        {
-            char info_log[1024];
-            glGetShaderInfoLog(shader, sizeof(info_log), 0, info_log);
-            __android_log_print(ANDROID_LOG_INFO, p->app_name, "vertex shader failed to compile: %s", info_log);
-        }
+// Also used when the context is lost, so doesn't ask GL to delete anything.
+internal void
+egl_destroy_context(user_data *p)
+{
+    eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (p->surface != EGL_NO_SURFACE)
+    {
+        eglDestroySurface(p->display, p->surface);
     }
+    eglDestroyContext(p->display, p->context);
+    eglTerminate(p->display);
+    p->surface = EGL_NO_SURFACE;
+    p->context = EGL_NO_CONTEXT;
+    p->display = EGL_NO_DISPLAY;
+    gl_presenter_forget(&p->gl);
+}
+
+// A context only sets its viewport the first time it's made current, and a
+// window can change size under the same surface.
+internal void
+egl_update_output(user_data *p)
+{
+    int width;
+    int height;
+    eglQuerySurface(p->display, p->surface, EGL_WIDTH, &width);
+    eglQuerySurface(p->display, p->surface, EGL_HEIGHT, &height);
+    glViewport(0, 0, width, height);
+    if ((width != p->gl.output_width) || (height != p->gl.output_height))
     {
-        uint shader = fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-        int compiled;
-        glShaderSource(shader, 1, (const char* const *)&fragment_shader_source, 0);
-        glCompileShader(shader);
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-        if (!compiled)
-        {
-            char info_log[1024];
-            glGetShaderInfoLog(shader, sizeof(info_log), 0, info_log);
-            __android_log_print(ANDROID_LOG_INFO, p->app_name, "fragment shader failed to compile: %s", info_log);
-        }
+        __android_log_print(ANDROID_LOG_INFO, p->app_name, "Output %dx%d, %s scaling", width, height,
+            scale_mode_names[HANDMADE_SCALING]);
     }
-    glAttachShader(p->program, vertex_shader_id);
-    glAttachShader(p->program, fragment_shader_id);
-    glLinkProgram(p->program);
+    gl_presenter_set_output(&p->gl, width, height);
+}
+
+// Returns 0 if the context couldn't be made current with the new surface.
+internal bool32
+egl_attach_window(user_data *p, ANativeWindow *window)
+{
+    int format;
+    eglGetConfigAttrib(p->display, p->config, EGL_NATIVE_VISUAL_ID, &format);
 
-    int linked;
-    glGetProgramiv(p->program, GL_LINK_STATUS, &linked);
-    if (!linked)
+    ANativeWindow_setBuffersGeometry(window, 0, 0, format);
+    p->surface = eglCreateWindowSurface(p->display, p->config, window, 0);
+    if (!eglMakeCurrent(p->display, p->surface, p->surface, p->context))
     {
-        char info_log[1024];
-        glGetProgramInfoLog(p->program, sizeof(info_log), 0, info_log);
-        __android_log_print(ANDROID_LOG_INFO, p->app_name, "program failed to link: %s", info_log);
+        return 0;
     }
 
-    glUseProgram(p->program);
-    p->a_pos_id = glGetAttribLocation(p->program, "a_pos");
-    p->a_tex_coord_id = glGetAttribLocation(p->program, "a_tex_coord");
-    p->sampler_id = glGetAttribLocation(p->program, "tex");
-    glEnableVertexAttribArray(p->a_pos_id);
-    glEnableVertexAttribArray(p->a_tex_coord_id);
+    egl_update_output(p);
+    return 1;
+}
+
+void init(android_app *app)
+{
+    user_data *p = (user_data *)app->userData;
+    int64_t init_start_ns = monotonic_nanoseconds();
+    p->window_start_ns = init_start_ns;
+
+    bool32 kept_context = (p->context != EGL_NO_CONTEXT);
+    if (kept_context && !egl_attach_window(p, app->window))
+    {
+        __android_log_print(ANDROID_LOG_INFO, p->app_name, "Couldn't reuse the EGL context (0x%x), rebuilding",
+            eglGetError());
+        egl_destroy_context(p);
+        kept_context = 0;
+    }
+    if (!kept_context)
+    {
+        egl_create_context(p);
+        egl_attach_window(p, app->window);
+    }
 
-    glGenTextures(1, &p->texture_id);
-    glBindTexture(GL_TEXTURE_2D, p->texture_id);
+    frame_pacer_attach(&p->pacer, p->display);
+    __android_log_print(ANDROID_LOG_INFO, p->app_name, "Pacing %s, swap interval %d, presentation time %s",
+        pacing_mode_names[p->pacer.mode], p->pacer.swap_interval, p->pacer.presentation_time ? "on" : "off");
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-        960, 540, 0,
-        GL_RGBA, GL_UNSIGNED_BYTE, p->texture_buffer);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if (!p->gl.program)
+    {
+        gl_program_cache_init(&p->program_cache, HANDMADE_PROGRAM_CACHE ? (char *)app->activity->internalDataPath : 0,
+            &p->memory.scratch);
 
-    glDepthFunc(GL_ALWAYS);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_CULL_FACE);
+        if (HANDMADE_UPLOAD_TUNING && !p->upload_tuned)
+        {
+            char device[PROP_VALUE_MAX] = {};
+            __system_property_get("ro.build.fingerprint", device);
+            upload_tuning tuning = upload_tune(p->upload_tuning_path[0] ? p->upload_tuning_path : 0,
+                device, p->upload, p->texture_buffer, p->rgb565_buffer, &p->program_cache);
+            p->upload = tuning.strategy;
+            p->upload_tuned = 1;
+
+            char name[32];
+            upload_strategy_name(p->upload, name, sizeof(name));
+            __android_log_print(ANDROID_LOG_INFO, p->app_name, "Upload %s, %.3f ms a frame (%s)",
+                name, tuning.frame_ns / 1.0e6, tuning.from_cache ? "cached" : "probed");
+        }
+        gl_presenter_init(&p->gl, p->texture_buffer, p->rgb565_buffer, p->upload, (scale_mode)HANDMADE_SCALING,
+            &p->program_cache);
+    }
 
     p->drawable = 1;
+    __android_log_print(ANDROID_LOG_INFO, p->app_name,
+        "init took %.3f ms, context %s, program cache %s (%u hits, %u misses)",
+        (monotonic_nanoseconds() - init_start_ns) / 1.0e6, kept_context ? "kept" : "created",
+        gl_program_cache_enabled(&p->program_cache) ? "on" : "off", p->program_cache.hits, p->program_cache.misses);
 }
 
+// Only the surface belongs to the window.
 void term(android_app *app)
 {
     user_data *p = (user_data *)app->userData;
     p->drawable = 0;
     eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    eglDestroyContext(p->display, p->context);
     eglDestroySurface(p->display, p->surface);
-    eglTerminate(p->display);
+    p->surface = EGL_NO_SURFACE;
+    if (!HANDMADE_KEEP_CONTEXT)
+    {
+        egl_destroy_context(p);
+    }
+}
+
+internal void
+write_frame_stats(user_data *p)
+{
+    if (!p->frame_stats_path[0])
+    {
+        return;
+    }
+    frame_stats_summary summary = frame_histogram_summarize(&p->frames.histograms[FRAME_STATS_INTERVAL]);
+    bool32 written = frame_stats_write(&p->frames, p->frame_stats_path) &&
+        timed_blocks_write(&p->timed_blocks, p->frame_stats_path);
+    __android_log_print(ANDROID_LOG_INFO, p->app_name,
+        "Frame stats over %" PRIu64 " frames: p50 %.1f p99 %.1f p99.9 %.1f max %.1f ms, %" PRIu64 " jank; %s %s",
+        summary.frames, summary.p50_ns / 1.0e6, summary.p99_ns / 1.0e6, summary.p999_ns / 1.0e6,
+        summary.max_ns / 1.0e6, summary.jank_count, written ? "wrote" : "failed to write", p->frame_stats_path);
+}
+
+internal void
+seal_persistent_storage(user_data *p)
+{
+    if (persist_enabled(&p->persist) && !p->persist.header->sealed)
+    {
+        persist_seal(&p->persist);
+        __android_log_print(ANDROID_LOG_INFO, p->app_name, "Sealed persistent storage in %.3f ms",
+            p->persist.seal_ns / 1.0e6);
+    }
 }
 
 void on_app_cmd(android_app *app, int32_t cmd) {
@@ -213,6 +411,8 @@ void on_app_cmd(android_app *app, int32_t cmd) {
     {
         __android_log_print(ANDROID_LOG_INFO, p->app_name, "unknown cmd is %d", cmd);
     }
+    lifecycle_on_cmd(&p->lifecycle, cmd);
+    flight_record_command(&p->flight, cmd);
     if (cmd == APP_CMD_INIT_WINDOW)
     {
         init(app);
@@ -221,8 +421,27 @@ void on_app_cmd(android_app *app, int32_t cmd) {
     {
         term(app);
     }
+    if (((cmd == APP_CMD_WINDOW_RESIZED) || (cmd == APP_CMD_CONFIG_CHANGED)) && p->drawable)
+    {
+        egl_update_output(p);
+    }
+    if (cmd == APP_CMD_PAUSE)
+    {
+        audio_set_playing(&p->audio, 0);
+        // We may not get another chance before the process is killed.
+        write_frame_stats(p);
+        platform_memory_log(&p->memory);
+        profiler_request_write(p->profiler);
+    }
+    // Pausing always suspends the frame loop, which seals it there.
+    if ((cmd == APP_CMD_SAVE_STATE) || (cmd == APP_CMD_DESTROY))
+    {
+        seal_persistent_storage(p);
+    }
     if (cmd == APP_CMD_DESTROY)
     {
+        audio_stop(&p->audio);
+        write_frame_stats(p);
         exit(0);
     }
 }
@@ -247,10 +466,16 @@ int32_t on_motion_event(android_app *app, AInputEvent *event)
     user_data *p = (user_data *)app->userData;
     pan_state *pan = &p->motion.pan;
 
+    latency_note_input(&p->latency, AMotionEvent_getEventTime(event));
+
     pan->stick = {};
 
     uint action = AMotionEvent_getAction(event);
     uint num_pointers = AMotionEvent_getPointerCount(event);
+    if (((action & AMOTION_EVENT_ACTION_MASK) == AMOTION_EVENT_ACTION_POINTER_DOWN) && (num_pointers == 3))
+    {
+        overlay_toggle(&p->overlay);
+    }
     if (num_pointers != 2 || action == AMOTION_EVENT_ACTION_UP || action == AMOTION_EVENT_ACTION_CANCEL)
     {
         if (pan->in_pan)
@@ -297,21 +522,37 @@ int32_t on_motion_event(android_app *app, AInputEvent *event)
     return 1;
 }
 
-internal void
-process_keyboard_message(game_button_state *new_state, bool32 is_down)
+internal int32_t
+hh_handle_key(user_data *p, int keycode, bool32 is_down, int meta_state)
 {
-    if (new_state->EndedDown != is_down)
+    if (keycode == 4)
+    {
+        return 0;
+    }
+    else if (keycode == 68)
+    {
+        if (is_down)
+        {
+            overlay_toggle(&p->overlay);
+        }
+    }
+    else if (keycode == 132)
+    {
+        if (is_down)
+        {
+            game_code_next(&p->games);
+        }
+    }
+    else if (!process_game_key(p->new_input, keycode, is_down))
     {
-        new_state->EndedDown = is_down;
-        ++new_state->HalfTransitionCount;
+        __android_log_print(ANDROID_LOG_INFO, p->app_name, "key event: down %d, keycode %d, meta_state %x", is_down, keycode, meta_state);
     }
+    return 1;
 }
 
 int32_t on_key_event(android_app *app, AInputEvent *event)
 {
     user_data *p = (user_data *)app->userData;
-    game_controller_input *old_keyboard_controller = GetController(p->old_input, 0);
-    game_controller_input *new_keyboard_controller = GetController(p->new_input, 0);
 
     uint action = AKeyEvent_getAction(event);
     if (action == AKEY_EVENT_ACTION_MULTIPLE)
@@ -322,36 +563,18 @@ int32_t on_key_event(android_app *app, AInputEvent *event)
 
     int keycode = AKeyEvent_getKeyCode(event);
     int meta_state = AKeyEvent_getMetaState(event);
-    if (keycode == 4)
-    {
-        return 0;
-    }
-    else if ((keycode == 51) || (keycode == 19))
-    {
-        process_keyboard_message(&new_keyboard_controller->MoveUp, is_down);
-    }
-    else if ((keycode == 29) || (keycode == 21))
+    int32_t handled = hh_handle_key(p, keycode, is_down, meta_state);
+    if (handled)
     {
-        process_keyboard_message(&new_keyboard_controller->MoveLeft, is_down);
-    }
-    else if ((keycode == 47) || (keycode == 20))
-    {
-        process_keyboard_message(&new_keyboard_controller->MoveDown, is_down);
-    }
-    else if ((keycode == 32) || (keycode == 22))
-    {
-        process_keyboard_message(&new_keyboard_controller->MoveRight, is_down);
-    }
-    else
-    {
-        __android_log_print(ANDROID_LOG_INFO, p->app_name, "key event: down %d, keycode %d, meta_state %x", is_down, keycode, meta_state);
+        latency_note_input(&p->latency, AKeyEvent_getEventTime(event));
     }
-    return 1;
+    return handled;
 }
 
 int32_t on_input_event(android_app *app, AInputEvent *event) {
     user_data *p = (user_data *)app->userData;
     int event_type = AInputEvent_getType(event);
+    ++p->frame_input_events;
 
     switch (event_type)
     {
@@ -372,71 +595,41 @@ int32_t on_input_event(android_app *app, AInputEvent *event) {
     return 0;
 }
 
-void draw(android_app *app)
+bool32 draw(void *platform, bool32 *swapped)
 {
+    android_app *app = (android_app *)platform;
     user_data *p = (user_data *)app->userData;
     if (!p->drawable)
     {
-        return;
+        return 0;
     }
     eglMakeCurrent(p->display, p->surface, p->surface, p->context);
-    static uint8_t grey_value = 0;
-    grey_value += 1;
-
-    glClearColor(grey_value / 255.0, grey_value / 255.0, grey_value / 255.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+    gl_presenter_draw(&p->gl, p->texture_buffer);
 
-    float vertexCoords[] =
+    if (!frame_pacer_swap(&p->pacer, p->display, p->surface) && (eglGetError() == EGL_CONTEXT_LOST))
     {
-        -1, 1,
-        -1, -1,
-        1, 1,
-        1, -1,
-    };
-    float texCoords[] =
-    {
-        0.0, 0.0,
-        0.0, 1.0,
-        1.0, 0.0,
-        1.0, 1.0,
-    };
-
-    uint16_t indices[] = { 0, 1, 2, 1, 2, 3 };
-
-    glUseProgram(p->program);
-
-    uint a_pos_id = glGetAttribLocation(p->program, "a_pos");
-    uint a_tex_coord_id = glGetAttribLocation(p->program, "a_tex_coord");
-    uint sampler_id = glGetAttribLocation(p->program, "tex");
+        // Power management can take the context away; everything in it has
+        // to be made again.
+        __android_log_print(ANDROID_LOG_INFO, p->app_name, "EGL context lost, rebuilding");
+        egl_destroy_context(p);
+        init(app);
+        return 0;
+    }
 
-    if (!((a_pos_id == p->a_pos_id) && (a_tex_coord_id == p->a_tex_coord_id) && (sampler_id == p->sampler_id)))
+    if (p->window_start_ns)
     {
-        __android_log_print(ANDROID_LOG_INFO, "org.nxsy.ndk_handmade", "program mismatch: pos_id %d/%d, tex_coord %d/%d, sampler_id %d/%d", a_pos_id, p->a_pos_id, a_tex_coord_id, p->a_tex_coord_id, sampler_id, p->sampler_id);
+        __android_log_print(ANDROID_LOG_INFO, p->app_name, "First frame %.3f ms after the window arrived",
+            (monotonic_nanoseconds() - p->window_start_ns) / 1.0e6);
+        p->window_start_ns = 0;
     }
-
-    glVertexAttribPointer(p->a_pos_id, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), vertexCoords);
-    glVertexAttribPointer(p->a_tex_coord_id, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), texCoords);
-    glEnableVertexAttribArray(p->a_pos_id);
-    glEnableVertexAttribArray(p->a_tex_coord_id);
-    glBindTexture(GL_TEXTURE_2D, p->texture_id);
-    glTexSubImage2D(GL_TEXTURE_2D,
-        0,
-        0,
-        0,
-        960,
-        540,
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        p->texture_buffer);
-
-    glUniform1i(p->sampler_id, 0);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
-
-    eglSwapBuffers(p->display, p->surface);
+    *swapped = 1;
+    return 1;
 }
 
 static AAssetManager *asset_manager;
+static platform_memory *file_memory;
 
+#if HANDMADE_INTERNAL
 DEBUG_PLATFORM_READ_ENTIRE_FILE(debug_read_entire_file)
 {
     debug_read_file_result result = {};
@@ -451,7 +644,7 @@ DEBUG_PLATFORM_READ_ENTIRE_FILE(debug_read_entire_file)
 
     uint64_t asset_size = AAsset_getLength64(asset);
 
-    char *buf = (char *)malloc(asset_size + 1);
+    char *buf = (char *)memory_allocate(file_memory, asset_size + 1);
     AAsset_read(asset, buf, asset_size);
     AAsset_close(asset);
 
@@ -463,26 +656,79 @@ DEBUG_PLATFORM_READ_ENTIRE_FILE(debug_read_entire_file)
     return(result);
 }
 
-internal void
-process_button(bool down, game_button_state *old_state, game_button_state *new_state)
+DEBUG_PLATFORM_FREE_FILE_MEMORY(debug_free_file_memory)
 {
-    new_state->EndedDown = down;
-    new_state->HalfTransitionCount = (old_state->EndedDown != new_state->EndedDown) ? 1 : 0;
+    memory_free(file_memory, Memory);
 }
+#endif
 
 internal void
 hh_process_events(android_app *app, game_input *new_input, game_input *old_input)
 {
-    game_controller_input *old_controller = GetController(old_input, 1);
-    game_controller_input *new_controller = GetController(new_input, 1);
-
     user_data *p = (user_data *)app->userData;
     pan_state *pan = &p->motion.pan;
 
-    process_button((pan->stick.X > 0), &old_controller->MoveRight, &new_controller->MoveRight);
-    process_button((pan->stick.X < 0), &old_controller->MoveLeft, &new_controller->MoveLeft);
-    process_button((pan->stick.Y > 0), &old_controller->MoveUp, &new_controller->MoveUp);
-    process_button((pan->stick.Y < 0), &old_controller->MoveDown, &new_controller->MoveDown);
+    process_stick_buttons(pan->stick.X, pan->stick.Y, new_input, old_input);
+}
+
+// The frame's input: everything the looper has, then the synthetic input.
+internal frame_poll
+hh_poll_input(void *platform, game_input *new_input, game_input *old_input)
+{
+    android_app *app = (android_app *)platform;
+    user_data *p = (user_data *)app->userData;
+    frame_poll result = {};
+
+    int events;
+    android_poll_source *source;
+    while((result.poll_result = ALooper_pollAll(0, 0, &events, (void**)&source)) >= 0)
+    {
+        source->process(app, source);
+    }
+
+    switch (result.poll_result)
+    {
+        case ALOOPER_POLL_WAKE:
+        {
+            __android_log_print(ANDROID_LOG_INFO, p->app_name, "poll_result was ALOOPER_POLL_WAKE");
+            break;
+        }
+        case ALOOPER_POLL_CALLBACK:
+        {
+            __android_log_print(ANDROID_LOG_INFO, p->app_name, "poll_result was ALOOPER_POLL_CALLBACK");
+            break;
+        }
+        case ALOOPER_POLL_TIMEOUT:
+        {
+            //__android_log_print(ANDROID_LOG_INFO, p->app_name, "poll_result was ALOOPER_POLL_TIMEOUT");
+            break;
+        }
+        case ALOOPER_POLL_ERROR:
+        {
+            __android_log_print(ANDROID_LOG_INFO, p->app_name, "poll_result was ALOOPER_POLL_ERROR");
+            break;
+        }
+        default:
+        {
+            __android_log_print(ANDROID_LOG_INFO, p->app_name, "poll_result was %d", result.poll_result);
+            break;
+        }
+    }
+
+#if HANDMADE_SYNTHETIC_INPUT
+    synthetic_input_event synthetic_event;
+    while (synthetic_input_next(&p->synthetic_input, &synthetic_event))
+    {
+        hh_handle_key(p, synthetic_event.keycode, synthetic_event.is_down, 0);
+        latency_note_input(&p->latency, synthetic_event.event_ns);
+    }
+#endif
+
+    hh_process_events(app, new_input, old_input);
+
+    result.input_events = p->frame_input_events;
+    p->frame_input_events = 0;
+    return result;
 }
 
 void android_main(android_app *app) {
@@ -491,13 +737,29 @@ void android_main(android_app *app) {
     asset_manager = app->activity->assetManager;
 
     user_data p = {};
-    p.texture_buffer = (uint8_t *)malloc(4 * 960 * 540);
     strcpy(p.app_name, "org.nxsy.ndk_handmade");
+    if (!platform_memory_init(&p.memory, 8 * 1024 * 1024, 1024 * 1024, HANDMADE_MEMORY_POISON))
+    {
+        return;
+    }
+    file_memory = &p.memory;
+    p.texture_buffer = (uint8_t *)memory_push_permanent(&p.memory, 4 * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT,
+        MEMORY_PAGE);
+    // Only committed if an RGB565 upload is ever used.
+    p.rgb565_buffer = (uint16 *)memory_push_permanent(&p.memory, GAME_BUFFER_RGB565_SIZE, MEMORY_PAGE);
     app->userData = &p;
 
     app->onAppCmd = on_app_cmd;
     app->onInputEvent = on_input_event;
-    uint64_t counter;
+
+    // This thread also does all of the GL work, so it gets the game role.
+    detect_cpu_topology(&p.topology);
+    p.game_thread = place_current_thread(&p.topology, THREAD_ROLE_GAME);
+    __android_log_print(ANDROID_LOG_INFO, p.app_name,
+        "Game thread %d: %u big and %u little cores, pinned %d, nice %d, timer slack %d",
+        p.game_thread.tid, p.topology.big_count, p.topology.little_count,
+        p.game_thread.pinned, p.game_thread.nice, p.game_thread.timer_slack_set);
+    thread_sched_stats_begin(&p.game_thread_sched);
     uint start_row = 0;
     uint start_col = 0;
 
@@ -505,116 +767,202 @@ void android_main(android_app *app) {
     m.PermanentStorageSize = 64 * 1024 * 1024;
     m.TransientStorageSize = 64 * 1024 * 1024;
     p.total_size = m.PermanentStorageSize + m.TransientStorageSize;
-    p.game_memory_block = calloc(p.total_size, sizeof(uint8));
-    m.PermanentStorage = (uint8 *)p.game_memory_block;
-    m.TransientStorage =
-        (uint8_t *)m.PermanentStorage + m.TransientStorageSize;
+#if HANDMADE_PERSISTENT_STORAGE
+    if (app->activity->internalDataPath)
+    {
+        char persist_path[1024];
+        snprintf(persist_path, sizeof(persist_path), "%s/permanent_storage.bin", app->activity->internalDataPath);
+        // The game and platform are one build, so this is the game's too.
+        char build_id[] = __DATE__ " " __TIME__;
+        uint64 build_hash = persist_checksum(build_id, sizeof(build_id));
+        if (persist_open(&p.persist, persist_path, m.PermanentStorageSize, build_hash))
+        {
+            __android_log_print(ANDROID_LOG_INFO, p.app_name, "Persistent storage %s in %.3f ms",
+                p.persist.restored ? "restored" : "started", p.persist.open_ns / 1.0e6);
+        }
+    }
+#endif
+    if (persist_enabled(&p.persist))
+    {
+        m.PermanentStorage = p.persist.storage;
+        m.IsInitialized = p.persist.restored;
+        p.game_memory_block = calloc(m.TransientStorageSize, sizeof(uint8));
+        m.TransientStorage = (uint8_t *)p.game_memory_block;
+    }
+    else
+    {
+        p.game_memory_block = calloc(p.total_size, sizeof(uint8));
+        m.PermanentStorage = (uint8 *)p.game_memory_block;
+        m.TransientStorage =
+            (uint8_t *)m.PermanentStorage + m.TransientStorageSize;
+    }
 
-#ifdef HANDMADE_INTERNAL
+#if HANDMADE_INTERNAL
     m.DEBUGPlatformReadEntireFile = debug_read_entire_file;
+    m.DEBUGPlatformFreeFileMemory = debug_free_file_memory;
 #endif
 
     thread_context t = {};
 
+    game_code_init(&p.games, GameUpdateAndRender, GameGetSoundSamples);
+    if (app->activity->internalDataPath)
+    {
+        char games_path[1024];
+        snprintf(games_path, sizeof(games_path), "%s/games", app->activity->internalDataPath);
+        uint32 loaded = game_code_add_directory(&p.games, games_path);
+        __android_log_print(ANDROID_LOG_INFO, p.app_name, "Loaded %u game code variants from %s", loaded, games_path);
+    }
+    timed_blocks_init(&p.timed_blocks);
+    timed_blocks_attach(&p.timed_blocks, &p.games);
+
     game_input input[2] = {};
     p.new_input = &input[0];
     p.old_input = &input[1];
 
     int monitor_refresh_hz = 60;
-    real32 game_update_hz = (monitor_refresh_hz / 2.0f); // Should almost always be an int...
+    frame_pacer_init(&p.pacer, (pacing_mode)HANDMADE_PACING, monitor_refresh_hz);
+    real32 game_update_hz = frame_pacer_update_hz(&p.pacer); // Should almost always be an int...
     long target_nanoseconds_per_frame = (1000 * 1000 * 1000) / game_update_hz;
+    overlay_init(&p.overlay, target_nanoseconds_per_frame, game_update_hz, HANDMADE_OVERLAY);
+
+    uint32 game_samples_per_second = 48000;
+    uint32 audio_samples_per_second = HANDMADE_AUDIO_OUTPUT_HZ;
+    uint32 audio_frames_per_update = audio_samples_per_second / game_update_hz;
+    memory_arena *permanent = &p.memory.permanent;
+    if (!audio_allocate(&p.audio, permanent, audio_samples_per_second, 240, 3840, 2 * audio_frames_per_update) ||
+        !mixer_init(&p.mixer, permanent, audio_samples_per_second, 2 * audio_frames_per_update) ||
+        !(p.game_sound = mixer_add_stream(&p.mixer, permanent, game_samples_per_second, 1.0f)))
+    {
+        __android_log_print(ANDROID_LOG_INFO, p.app_name, "Failed to allocate audio buffers");
+    }
+    else if (!audio_start(&p.audio))
+    {
+        __android_log_print(ANDROID_LOG_INFO, p.app_name, "Failed to start OpenSL ES audio output");
+    }
 
-    while (++counter) {
-        timespec start_time = {};
-        clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
-
-        game_controller_input *old_keyboard_controller = GetController(p.old_input, 0);
-        game_controller_input *new_keyboard_controller = GetController(p.new_input, 0);
-        *new_keyboard_controller = {};
-        new_keyboard_controller->IsConnected = true;
-        for (
-                uint button_index = 0;
-                button_index < ArrayCount(new_keyboard_controller->Buttons);
-                ++button_index)
-        {
-            new_keyboard_controller->Buttons[button_index].EndedDown =
-                old_keyboard_controller->Buttons[button_index].EndedDown;
-        }
+#if HANDMADE_INTERNAL
+    {
+        // Before the first frame, so scratch is free.
+        mixer_check_result check = mixer_check(&p.memory.scratch, audio_samples_per_second,
+            (audio_samples_per_second == 48000) ? 44100 : 48000, audio_frames_per_update, 30);
+        __android_log_print(ANDROID_LOG_INFO, p.app_name,
+            "Mixer check: max difference %d, reference %.0f frames/s, simd %.0f frames/s",
+            check.max_difference, check.reference_frames_per_second, check.simd_frames_per_second);
+        Assert(check.max_difference <= 1);
+    }
+#endif
 
-        int poll_result, events;
-        android_poll_source *source;
+    p.latch.enabled = HANDMADE_LATE_LATCH && frame_pacer_sleeps(&p.pacer);
+    if (HANDMADE_LATE_LATCH && !p.latch.enabled)
+    {
+        __android_log_print(ANDROID_LOG_INFO, p.app_name, "Late latching needs manual pacing, not %s; it's off",
+            pacing_mode_names[p.pacer.mode]);
+    }
+    p.latch.frame_ns = p.pacer.frame_ns;
+    p.latch.margin_ns = 2 * 1000000;
 
-        while((poll_result = ALooper_pollAll(0, 0, &events, (void**)&source)) >= 0)
+    frame_stats_init(&p.frames, target_nanoseconds_per_frame);
+    if (app->activity->internalDataPath)
+    {
+        snprintf(p.frame_stats_path, sizeof(p.frame_stats_path), "%s/frame_stats.txt", app->activity->internalDataPath);
+        snprintf(p.upload_tuning_path, sizeof(p.upload_tuning_path), "%s/upload_tuning.txt", app->activity->internalDataPath);
+#if HANDMADE_FLIGHT_RECORDER
+        char flight_path[1024];
+        char previous_flight_path[1024];
+        snprintf(flight_path, sizeof(flight_path), "%s/flight_recorder.bin", app->activity->internalDataPath);
+        snprintf(previous_flight_path, sizeof(previous_flight_path), "%s/flight_recorder.prev.bin",
+            app->activity->internalDataPath);
+        flight_open(&p.flight, flight_path, previous_flight_path);
+#endif
+#if HANDMADE_PROFILER_HZ
+        char profile_path[1024];
+        snprintf(profile_path, sizeof(profile_path), "%s/profile.folded", app->activity->internalDataPath);
+        p.profiler = (sampling_profiler *)memory_push_permanent(&p.memory, sizeof(sampling_profiler),
+            MEMORY_CACHE_LINE);
+        if (p.profiler && profiler_start(p.profiler, HANDMADE_PROFILER_HZ, profile_path))
         {
-            source->process(app, source);
+            __android_log_print(ANDROID_LOG_INFO, p.app_name, "Profiling the game thread at %d Hz into %s",
+                HANDMADE_PROFILER_HZ, profile_path);
         }
+#endif
+    }
+    p.upload = make_upload_strategy(HANDMADE_UPLOAD_RGB565 ? UPLOAD_RGB565 : UPLOAD_RGBA8, UPDATE_SUB_IMAGE);
+
+#if HANDMADE_COUNTERS
+    perf_counters_open(&p.counters);
+#endif
+#if HANDMADE_HOT_PATH
+    hot_path_start(&p.hot_path);
+#endif
 
-        switch (poll_result)
+#if HANDMADE_SYNTHETIC_INPUT
+    synthetic_input_start(&p.synthetic_input, 22, 50 * 1000000, 400 * 1000000);
+#endif
+
+    frame_loop loop = {};
+    loop.platform = app;
+    loop.poll = hh_poll_input;
+    loop.present = draw;
+    loop.thread = &t;
+    loop.storage = &m;
+    loop.memory = &p.memory;
+    loop.texture_buffer = p.texture_buffer;
+    loop.games = &p.games;
+    loop.persist = &p.persist;
+    loop.audio = &p.audio;
+    loop.mixer = &p.mixer;
+    loop.game_sound = p.game_sound;
+    loop.game_samples_per_second = game_samples_per_second;
+    loop.audio_frames_per_update = audio_frames_per_update;
+    loop.overlay = &p.overlay;
+    loop.counters = &p.counters;
+    loop.hot_path = &p.hot_path;
+    loop.timed_blocks = &p.timed_blocks;
+    loop.sched = &p.game_thread_sched;
+    loop.latency = &p.latency;
+    loop.latch = &p.latch;
+    loop.pacer = &p.pacer;
+    loop.frames = &p.frames;
+    loop.flight = &p.flight;
+    loop.target_ns_per_frame = target_nanoseconds_per_frame;
+    loop.game_swap_frames = HANDMADE_GAME_SWAP_FRAMES;
+    loop.log_interval = 150;
+
+    for (;;)
+    {
+        if (!lifecycle_running(&p.lifecycle))
         {
-            case ALOOPER_POLL_WAKE:
-            {
-                __android_log_print(ANDROID_LOG_INFO, p.app_name, "poll_result was ALOOPER_POLL_WAKE");
-                break;
-            }
-            case ALOOPER_POLL_CALLBACK:
-            {
-                __android_log_print(ANDROID_LOG_INFO, p.app_name, "poll_result was ALOOPER_POLL_CALLBACK");
-                break;
-            }
-            case ALOOPER_POLL_TIMEOUT:
+            // Nothing would feed the audio, so it would only underrun.
+            __android_log_print(ANDROID_LOG_INFO, p.app_name, "Suspending simulation");
+            audio_set_playing(&p.audio, 0);
+            seal_persistent_storage(&p);
+            lifecycle_suspension suspension = lifecycle_wait_until_running(&p.lifecycle, app);
+            flight_record_suspend(&p.flight, suspension.wall_ns, suspension.cpu_ns);
+            __android_log_print(ANDROID_LOG_INFO, p.app_name,
+                "Resuming simulation after %.3f s, %.3f ms of CPU meanwhile",
+                suspension.wall_ns / 1.0e9, suspension.cpu_ns / 1.0e6);
+            audio_set_playing(&p.audio, 1);
+
+            // Start timing over, so nothing sees the gap as one long frame,
+            // and forget input from while we weren't looking.
+            frame_stats_restart_interval(&p.frames);
+            frame_pacer_restart(&p.pacer);
+            late_latch_restart(&p.latch);
+            latency_end_frame(&p.latency, 0, 0);
+            release_keyboard_controller(p.old_input);
+#if HANDMADE_SYNTHETIC_INPUT
+            synthetic_input_event stale_event;
+            while (synthetic_input_next(&p.synthetic_input, &stale_event))
             {
-                //__android_log_print(ANDROID_LOG_INFO, p.app_name, "poll_result was ALOOPER_POLL_TIMEOUT");
-                break;
-            }
-            case ALOOPER_POLL_ERROR:
-            {
-                __android_log_print(ANDROID_LOG_INFO, p.app_name, "poll_result was ALOOPER_POLL_ERROR");
-                break;
-            }
-            default:
-            {
-                __android_log_print(ANDROID_LOG_INFO, p.app_name, "poll_result was %d", poll_result);
-                break;
             }
+#endif
         }
 
-        p.new_input->dtForFrame = target_nanoseconds_per_frame / (1024.0 * 1024 * 1024);
-
-        hh_process_events(app, p.new_input, p.old_input);
-
-        game_offscreen_buffer game_buffer = {};
-        game_buffer.Memory = p.texture_buffer;
-        game_buffer.Width = 960;
-        game_buffer.Height = 540;
-        game_buffer.Pitch = 960 * 4;
-        game_buffer.BytesPerPixel = 4;
-
-        GameUpdateAndRender(&t, &m, p.new_input, &game_buffer);
-        draw(app);
-
-        timespec end_time = {};
-        clock_gettime(CLOCK_MONOTONIC_RAW, &end_time);
-
-        end_time.tv_sec -= start_time.tv_sec;
-        start_time.tv_sec -= start_time.tv_sec;
-
-        int64_t time_taken = ((end_time.tv_sec * 1000000000 + end_time.tv_nsec) -
-            (start_time.tv_sec * 1000000000 + start_time.tv_nsec));
-
-        int64_t time_to_sleep = 33 * 1000000;
-        if (time_taken <= time_to_sleep)
+        p.overlay.upload_bytes = gl_presenter_upload_bytes(&p.gl);
+        frame_step(&loop, p.new_input, p.old_input);
+        if (frame_stats_dump_requested())
         {
-            timespec sleep_time = {};
-            sleep_time.tv_nsec = time_to_sleep - time_taken;
-            timespec remainder = {};
-            nanosleep(&sleep_time, &remainder);
-        }
-        else
-        {
-            if (counter % 10 == 0)
-            {
-                __android_log_print(ANDROID_LOG_INFO, p.app_name, "Skipped frame!  Took %" PRId64 " ns total", time_taken);
-            }
+            write_frame_stats(&p);
         }
 
         game_input *temp_input = p.new_input;
@@ -0,0 +1,489 @@
+#ifndef APP_AUDIO_H
+#define APP_AUDIO_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __ANDROID__
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "app_memory.h"
+#include "app_time.h"
+
+// Audio output.
+//
+// The game thread calls GameGetSoundSamples once per frame and pushes the
+// result into a single-producer single-consumer ring.  A dedicated output
+// thread (OpenSL ES's buffer queue callback on Android, a paced writer
+// thread into a WAV file on a Linux host) pulls one device period at a time
+// out of the ring.  The output side only touches atomics and memory that was
+// allocated up front: no locks, no allocation, no logging.
+//
+// The device period starts small and doubles whenever the output thread
+// reports an underrun.  After a stretch of clean playback it's halved again,
+// and each time that brings the underruns back the stretch doubles, so we
+// settle on the smallest period that stays glitch-free on this device.
+// Only time spent playing counts: nothing is rendered while paused.
+
+#define AUDIO_CHANNELS 2
+#define AUDIO_BYTES_PER_FRAME (AUDIO_CHANNELS * sizeof(int16))
+#define AUDIO_PERIOD_BUFFER_COUNT 2
+// Clean playback before the period is first halved again.
+#define AUDIO_PERIOD_DECAY_SECONDS 10
+
+struct audio_ring
+{
+    int16 *samples;
+    uint32 capacity_frames; // power of two
+
+    // Free-running frame counters.  write_frame is only stored by the game
+    // thread, read_frame only by the output thread.
+    uint32 write_frame;
+    uint32 read_frame;
+};
+
+struct audio_output
+{
+    audio_ring ring;
+    uint32 samples_per_second;
+
+    uint32 period_frames;
+    uint32 min_period_frames;
+    uint32 max_period_frames;
+
+    int16 *period_buffers[AUDIO_PERIOD_BUFFER_COUNT];
+    uint32 next_period_buffer;
+
+    uint32 underrun_count;
+    uint32 underruns_seen;
+    // In frames the device has played, taken from ring.read_frame.
+    uint32 clean_since_frame;
+    uint32 decay_frames;
+    bool32 period_just_halved;
+
+    int16 *staging;
+    uint32 staging_frames;
+
+    bool32 playing;
+
+#ifdef __ANDROID__
+    SLObjectItf engine_object;
+    SLEngineItf engine;
+    SLObjectItf output_mix_object;
+    SLObjectItf player_object;
+    SLPlayItf player;
+    SLAndroidSimpleBufferQueueItf queue;
+#else
+    int file;
+    uint32 file_data_bytes;
+    pthread_t thread;
+    volatile bool32 running;
+#endif
+};
+
+internal uint32
+audio_ring_queued_frames(audio_ring *ring)
+{
+    uint32 read_frame = __atomic_load_n(&ring->read_frame, __ATOMIC_ACQUIRE);
+    uint32 write_frame = __atomic_load_n(&ring->write_frame, __ATOMIC_ACQUIRE);
+    return write_frame - read_frame;
+}
+
+// Game thread only.
+internal void
+audio_ring_write(audio_ring *ring, int16 *samples, uint32 frame_count)
+{
+    uint32 write_frame = ring->write_frame;
+    uint32 mask = ring->capacity_frames - 1;
+    for (uint32 frame_index = 0; frame_index < frame_count; )
+    {
+        uint32 offset = (write_frame + frame_index) & mask;
+        uint32 run = ring->capacity_frames - offset;
+        if (run > frame_count - frame_index)
+        {
+            run = frame_count - frame_index;
+        }
+        memcpy(ring->samples + offset * AUDIO_CHANNELS,
+            samples + frame_index * AUDIO_CHANNELS,
+            run * AUDIO_BYTES_PER_FRAME);
+        frame_index += run;
+    }
+    __atomic_store_n(&ring->write_frame, write_frame + frame_count, __ATOMIC_RELEASE);
+}
+
+// Output thread only.  Returns the number of frames actually read; the rest
+// of out is left untouched.
+internal uint32
+audio_ring_read(audio_ring *ring, int16 *out, uint32 frame_count)
+{
+    uint32 read_frame = ring->read_frame;
+    uint32 write_frame = __atomic_load_n(&ring->write_frame, __ATOMIC_ACQUIRE);
+    uint32 available = write_frame - read_frame;
+    if (frame_count > available)
+    {
+        frame_count = available;
+    }
+    uint32 mask = ring->capacity_frames - 1;
+    for (uint32 frame_index = 0; frame_index < frame_count; )
+    {
+        uint32 offset = (read_frame + frame_index) & mask;
+        uint32 run = ring->capacity_frames - offset;
+        if (run > frame_count - frame_index)
+        {
+            run = frame_count - frame_index;
+        }
+        memcpy(out + frame_index * AUDIO_CHANNELS,
+            ring->samples + offset * AUDIO_CHANNELS,
+            run * AUDIO_BYTES_PER_FRAME);
+        frame_index += run;
+    }
+    __atomic_store_n(&ring->read_frame, read_frame + frame_count, __ATOMIC_RELEASE);
+    return frame_count;
+}
+
+// Output thread only.  Fills the next period buffer and returns it.
+internal int16 *
+audio_render_period(audio_output *audio, uint32 *out_frames)
+{
+    uint32 period_frames = __atomic_load_n(&audio->period_frames, __ATOMIC_ACQUIRE);
+    int16 *buffer = audio->period_buffers[audio->next_period_buffer];
+    audio->next_period_buffer = (audio->next_period_buffer + 1) % AUDIO_PERIOD_BUFFER_COUNT;
+
+    uint32 got = audio_ring_read(&audio->ring, buffer, period_frames);
+    if (got < period_frames)
+    {
+        memset(buffer + got * AUDIO_CHANNELS, 0, (period_frames - got) * AUDIO_BYTES_PER_FRAME);
+        // Before the game thread has written anything, or while it's paused,
+        // there is nothing to be late for.
+        if (__atomic_load_n(&audio->ring.write_frame, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&audio->playing, __ATOMIC_RELAXED))
+        {
+            __atomic_add_fetch(&audio->underrun_count, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    *out_frames = period_frames;
+    return buffer;
+}
+
+// The buffers come out of arena, which has to keep them for as long as the
+// output runs.
+internal bool32
+audio_allocate(audio_output *audio, memory_arena *arena, uint32 samples_per_second,
+    uint32 min_period_frames, uint32 max_period_frames, uint32 max_frames_per_update)
+{
+    audio->samples_per_second = samples_per_second;
+    audio->min_period_frames = min_period_frames;
+    audio->max_period_frames = max_period_frames;
+    audio->period_frames = min_period_frames;
+    audio->decay_frames = AUDIO_PERIOD_DECAY_SECONDS * samples_per_second;
+
+    // Room for a whole update's worth of samples on top of everything the
+    // device could have queued at its largest period.
+    uint32 capacity = 1;
+    while (capacity < max_frames_per_update + AUDIO_PERIOD_BUFFER_COUNT * max_period_frames)
+    {
+        capacity <<= 1;
+    }
+    audio->ring.capacity_frames = capacity;
+    audio->ring.samples = (int16 *)arena_push(arena, capacity * AUDIO_BYTES_PER_FRAME, MEMORY_PAGE);
+
+    for (uint32 buffer_index = 0; buffer_index < AUDIO_PERIOD_BUFFER_COUNT; ++buffer_index)
+    {
+        audio->period_buffers[buffer_index] = (int16 *)arena_push(arena, max_period_frames * AUDIO_BYTES_PER_FRAME,
+            MEMORY_CACHE_LINE);
+    }
+
+    audio->staging_frames = max_frames_per_update;
+    audio->staging = (int16 *)arena_push(arena, max_frames_per_update * AUDIO_BYTES_PER_FRAME, MEMORY_CACHE_LINE);
+
+    return audio->ring.samples && audio->period_buffers[AUDIO_PERIOD_BUFFER_COUNT - 1] && audio->staging;
+}
+
+// Game thread.  How many frames should be generated this update to keep
+// the ring topped up until the next one.
+internal uint32
+audio_frames_wanted(audio_output *audio, uint32 frames_per_update)
+{
+    uint32 period_frames = __atomic_load_n(&audio->period_frames, __ATOMIC_ACQUIRE);
+    uint32 target = frames_per_update + AUDIO_PERIOD_BUFFER_COUNT * period_frames;
+    uint32 queued = audio_ring_queued_frames(&audio->ring);
+    uint32 result = (target > queued) ? target - queued : 0;
+    uint32 space = audio->ring.capacity_frames - queued;
+    if (result > space)
+    {
+        result = space;
+    }
+    if (result > audio->staging_frames)
+    {
+        result = audio->staging_frames;
+    }
+    return result;
+}
+
+// Game thread.  Grows the device period if the output thread has reported
+// underruns since the last call, or shrinks it after decay_frames of clean
+// playback.  Returns 1 if the period changed.
+internal bool32
+audio_adapt_period(audio_output *audio)
+{
+    uint32 read_frame = __atomic_load_n(&audio->ring.read_frame, __ATOMIC_ACQUIRE);
+    uint32 underruns = __atomic_load_n(&audio->underrun_count, __ATOMIC_RELAXED);
+    uint32 period_frames = audio->period_frames;
+    if (underruns != audio->underruns_seen)
+    {
+        audio->underruns_seen = underruns;
+        audio->clean_since_frame = read_frame;
+        if (audio->period_just_halved)
+        {
+            // The smaller period didn't hold; wait twice as long before
+            // trying it again, up to about an hour.
+            if (audio->decay_frames < 360 * AUDIO_PERIOD_DECAY_SECONDS * audio->samples_per_second)
+            {
+                audio->decay_frames *= 2;
+            }
+            audio->period_just_halved = 0;
+        }
+        period_frames *= 2;
+        if (period_frames > audio->max_period_frames)
+        {
+            period_frames = audio->max_period_frames;
+        }
+    }
+    else if ((period_frames > audio->min_period_frames) &&
+        (read_frame - audio->clean_since_frame >= audio->decay_frames))
+    {
+        audio->clean_since_frame = read_frame;
+        audio->period_just_halved = 1;
+        period_frames /= 2;
+        if (period_frames < audio->min_period_frames)
+        {
+            period_frames = audio->min_period_frames;
+        }
+    }
+    else
+    {
+        if (audio->period_just_halved && (read_frame - audio->clean_since_frame >= audio->decay_frames))
+        {
+            // Held for a whole stretch at the smallest period.
+            audio->period_just_halved = 0;
+        }
+        return 0;
+    }
+
+    if (period_frames == audio->period_frames)
+    {
+        return 0;
+    }
+    __atomic_store_n(&audio->period_frames, period_frames, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Approximate time from a sample being written by the game to it leaving
+// the device: everything in the ring plus the periods in flight.
+internal real32
+audio_latency_ms(audio_output *audio)
+{
+    uint32 frames = audio_ring_queued_frames(&audio->ring) +
+        AUDIO_PERIOD_BUFFER_COUNT * __atomic_load_n(&audio->period_frames, __ATOMIC_ACQUIRE);
+    return (1000.0f * frames) / audio->samples_per_second;
+}
+
+#ifdef __ANDROID__
+
+internal void
+audio_buffer_queue_callback(SLAndroidSimpleBufferQueueItf queue, void *context)
+{
+    audio_output *audio = (audio_output *)context;
+    uint32 frames;
+    int16 *buffer = audio_render_period(audio, &frames);
+    (*queue)->Enqueue(queue, buffer, frames * AUDIO_BYTES_PER_FRAME);
+}
+
+internal bool32
+audio_start(audio_output *audio)
+{
+    SLresult result = slCreateEngine(&audio->engine_object, 0, 0, 0, 0, 0);
+    if (result != SL_RESULT_SUCCESS)
+    {
+        return 0;
+    }
+    (*audio->engine_object)->Realize(audio->engine_object, SL_BOOLEAN_FALSE);
+    (*audio->engine_object)->GetInterface(audio->engine_object, SL_IID_ENGINE, &audio->engine);
+
+    (*audio->engine)->CreateOutputMix(audio->engine, &audio->output_mix_object, 0, 0, 0);
+    (*audio->output_mix_object)->Realize(audio->output_mix_object, SL_BOOLEAN_FALSE);
+
+    SLDataLocator_AndroidSimpleBufferQueue locator_queue = {
+        SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, AUDIO_PERIOD_BUFFER_COUNT
+    };
+    SLDataFormat_PCM format_pcm = {
+        SL_DATAFORMAT_PCM, AUDIO_CHANNELS, audio->samples_per_second * 1000,
+        SL_PCMSAMPLEFORMAT_FIXED_16, SL_PCMSAMPLEFORMAT_FIXED_16,
+        SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT, SL_BYTEORDER_LITTLEENDIAN
+    };
+    SLDataSource source = {&locator_queue, &format_pcm};
+
+    SLDataLocator_OutputMix locator_output_mix = {SL_DATALOCATOR_OUTPUTMIX, audio->output_mix_object};
+    SLDataSink sink = {&locator_output_mix, 0};
+
+    const SLInterfaceID ids[] = {SL_IID_ANDROIDSIMPLEBUFFERQUEUE};
+    const SLboolean required[] = {SL_BOOLEAN_TRUE};
+    result = (*audio->engine)->CreateAudioPlayer(audio->engine, &audio->player_object,
+        &source, &sink, 1, ids, required);
+    if (result != SL_RESULT_SUCCESS)
+    {
+        return 0;
+    }
+    (*audio->player_object)->Realize(audio->player_object, SL_BOOLEAN_FALSE);
+    (*audio->player_object)->GetInterface(audio->player_object, SL_IID_PLAY, &audio->player);
+    (*audio->player_object)->GetInterface(audio->player_object, SL_IID_ANDROIDSIMPLEBUFFERQUEUE, &audio->queue);
+    (*audio->queue)->RegisterCallback(audio->queue, audio_buffer_queue_callback, audio);
+
+    // Keep every buffer in the queue busy; from here on each completed
+    // buffer is refilled and re-enqueued from the callback.
+    for (uint32 buffer_index = 0; buffer_index < AUDIO_PERIOD_BUFFER_COUNT; ++buffer_index)
+    {
+        audio_buffer_queue_callback(audio->queue, audio);
+    }
+
+    (*audio->player)->SetPlayState(audio->player, SL_PLAYSTATE_PLAYING);
+    audio->playing = 1;
+    return 1;
+}
+
+internal void
+audio_set_playing(audio_output *audio, bool32 playing)
+{
+    if (audio->player && (audio->playing != playing))
+    {
+        // Before pausing, so a callback already on its way isn't counted as
+        // an underrun.
+        __atomic_store_n(&audio->playing, playing, __ATOMIC_RELAXED);
+        (*audio->player)->SetPlayState(audio->player, playing ? SL_PLAYSTATE_PLAYING : SL_PLAYSTATE_PAUSED);
+    }
+}
+
+internal void
+audio_stop(audio_output *audio)
+{
+    if (audio->player_object)
+    {
+        (*audio->player_object)->Destroy(audio->player_object);
+        audio->player_object = 0;
+        audio->player = 0;
+        audio->queue = 0;
+    }
+    if (audio->output_mix_object)
+    {
+        (*audio->output_mix_object)->Destroy(audio->output_mix_object);
+        audio->output_mix_object = 0;
+    }
+    if (audio->engine_object)
+    {
+        (*audio->engine_object)->Destroy(audio->engine_object);
+        audio->engine_object = 0;
+        audio->engine = 0;
+    }
+    audio->playing = 0;
+}
+
+#else
+
+// Host sink: a thread that wakes once per period, like a device interrupt
+// would, and appends the period to a WAV file.
+
+internal void
+audio_write_wav_header(audio_output *audio)
+{
+    uint32 byte_rate = audio->samples_per_second * AUDIO_BYTES_PER_FRAME;
+    uint8 header[44];
+    memcpy(header + 0, "RIFF", 4);
+    *(uint32 *)(header + 4) = 36 + audio->file_data_bytes;
+    memcpy(header + 8, "WAVEfmt ", 8);
+    *(uint32 *)(header + 16) = 16;
+    *(uint16 *)(header + 20) = 1;
+    *(uint16 *)(header + 22) = AUDIO_CHANNELS;
+    *(uint32 *)(header + 24) = audio->samples_per_second;
+    *(uint32 *)(header + 28) = byte_rate;
+    *(uint16 *)(header + 32) = AUDIO_BYTES_PER_FRAME;
+    *(uint16 *)(header + 34) = 16;
+    memcpy(header + 36, "data", 4);
+    *(uint32 *)(header + 40) = audio->file_data_bytes;
+    pwrite(audio->file, header, sizeof(header), 0);
+}
+
+internal void *
+audio_file_sink_thread(void *param)
+{
+    audio_output *audio = (audio_output *)param;
+    int64_t next_period_ns = monotonic_nanoseconds();
+    while (audio->running)
+    {
+        if (!__atomic_load_n(&audio->playing, __ATOMIC_RELAXED))
+        {
+            // Like a stopped device: no periods, so nothing is pulled out of
+            // the ring or counted as an underrun.
+            uint32 period_frames = __atomic_load_n(&audio->period_frames, __ATOMIC_ACQUIRE);
+            sleep_until_nanoseconds(monotonic_nanoseconds() +
+                ((int64_t)period_frames * 1000000000) / audio->samples_per_second);
+            next_period_ns = monotonic_nanoseconds();
+            continue;
+        }
+        uint32 frames;
+        int16 *buffer = audio_render_period(audio, &frames);
+        if (write(audio->file, buffer, frames * AUDIO_BYTES_PER_FRAME) > 0)
+        {
+            audio->file_data_bytes += frames * AUDIO_BYTES_PER_FRAME;
+        }
+        next_period_ns += ((int64_t)frames * 1000000000) / audio->samples_per_second;
+        sleep_until_nanoseconds(next_period_ns);
+    }
+    return 0;
+}
+
+internal bool32
+audio_start(audio_output *audio, char *path)
+{
+    audio->file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (audio->file < 0)
+    {
+        return 0;
+    }
+    audio_write_wav_header(audio);
+    lseek(audio->file, 44, SEEK_SET);
+
+    audio->playing = 1;
+    audio->running = 1;
+    pthread_create(&audio->thread, 0, audio_file_sink_thread, audio);
+    return 1;
+}
+
+internal void
+audio_set_playing(audio_output *audio, bool32 playing)
+{
+    __atomic_store_n(&audio->playing, playing, __ATOMIC_RELAXED);
+}
+
+internal void
+audio_stop(audio_output *audio)
+{
+    if (audio->running)
+    {
+        audio->running = 0;
+        pthread_join(audio->thread, 0);
+        audio_write_wav_header(audio);
+        close(audio->file);
+    }
+    audio->playing = 0;
+}
+
+#endif
+
+#endif
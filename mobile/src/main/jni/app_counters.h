@@ -0,0 +1,307 @@
+#ifndef APP_COUNTERS_H
+#define APP_COUNTERS_H
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "app_log.h"
+#include "app_time.h"
+
+// Performance counters per frame stage, for telling a stage that's waiting
+// on memory from one that's short of instructions.
+//
+// The counters are opened on the calling thread, user space only, as one
+// perf_event_open group, so a single read returns all of them as of the same
+// moment.  The frame loop marks where a stage starts and ends; what each
+// counter moved in between is added to that stage's totals, and every so
+// often the totals are logged as IPC, misses per thousand instructions and
+// so on, per frame.
+//
+// Each event is opened on its own terms.  Hardware events are often not
+// allowed (containers, VMs, Android's perf_event_paranoid of 3), and then
+// stages are still told apart by the software events, CPU time and page
+// faults.  If perf_event_open isn't allowed at all, those two come from the
+// thread's CPU clock and getrusage instead.  Events that couldn't be counted
+// are left out of the log.
+//
+// On Android, "adb shell setprop security.perf_harden 0" lets an app at the
+// hardware events until the next reboot.
+
+#define COUNTER_MAX_STAGES 8
+
+enum counter_event
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_TASK_CLOCK,
+    COUNTER_PAGE_FAULTS,
+
+    COUNTER_EVENT_COUNT,
+};
+
+global_variable char *counter_event_names[COUNTER_EVENT_COUNT] = {
+    "cycles", "instructions", "cache-misses", "branch-misses", "task-clock", "page-faults",
+};
+
+struct perf_counters
+{
+    int group;
+    int files[COUNTER_EVENT_COUNT];
+    uint64 ids[COUNTER_EVENT_COUNT];
+    // Counted by perf_event_open, or by the fallback for the two software
+    // events.
+    bool32 perf_event[COUNTER_EVENT_COUNT];
+    bool32 available[COUNTER_EVENT_COUNT];
+
+    uint64 last[COUNTER_EVENT_COUNT];
+    uint64 totals[COUNTER_MAX_STAGES][COUNTER_EVENT_COUNT];
+    uint64 frames;
+    // The group had to share the PMU with other groups, so counts are only
+    // for part of the time.
+    bool32 multiplexed;
+    int64_t read_ns;
+    uint64 reads;
+};
+
+internal int
+counters_open_event(uint32 type, uint64 config, int group)
+{
+    perf_event_attr attributes = {};
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &attributes, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Opens what it can on the calling thread.  Always succeeds; see available.
+internal void
+perf_counters_open(perf_counters *counters)
+{
+    *counters = {};
+    counters->group = -1;
+
+    struct
+    {
+        uint32 type;
+        uint64 config;
+    } events[COUNTER_EVENT_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    };
+    int first_error = 0;
+    for (uint32 event = 0; event < COUNTER_EVENT_COUNT; ++event)
+    {
+        int file = counters_open_event(events[event].type, events[event].config, counters->group);
+        counters->files[event] = file;
+        if (file < 0)
+        {
+            first_error = first_error ? first_error : errno;
+            continue;
+        }
+        if (ioctl(file, PERF_EVENT_IOC_ID, &counters->ids[event]) != 0)
+        {
+            close(file);
+            counters->files[event] = -1;
+            continue;
+        }
+        if (counters->group < 0)
+        {
+            counters->group = file;
+        }
+        counters->perf_event[event] = 1;
+        counters->available[event] = 1;
+    }
+    counters->available[COUNTER_TASK_CLOCK] = 1;
+    counters->available[COUNTER_PAGE_FAULTS] = 1;
+
+    char opened[256] = "";
+    for (uint32 event = 0; event < COUNTER_EVENT_COUNT; ++event)
+    {
+        if (counters->perf_event[event])
+        {
+            size_t length = strlen(opened);
+            snprintf(opened + length, sizeof(opened) - length, "%s%s", length ? " " : "", counter_event_names[event]);
+        }
+    }
+    if (first_error)
+    {
+        app_log("Counters: perf_event_open gave %s for some events; counting %s%s", strerror(first_error),
+            opened[0] ? opened : "none",
+            counters->perf_event[COUNTER_TASK_CLOCK] ? "" : ", CPU time and page faults from the thread clock");
+    }
+    else
+    {
+        app_log("Counters: %s", opened);
+    }
+}
+
+inline bool32
+perf_counters_enabled(perf_counters *counters)
+{
+    return counters->available[COUNTER_TASK_CLOCK];
+}
+
+internal void
+perf_counters_read(perf_counters *counters, uint64 *values)
+{
+    int64_t start_ns = monotonic_nanoseconds();
+    if (counters->group >= 0)
+    {
+        uint64 buffer[3 + 2 * COUNTER_EVENT_COUNT];
+        ssize_t bytes = read(counters->group, buffer, sizeof(buffer));
+        if (bytes >= (ssize_t)(3 * sizeof(uint64)))
+        {
+            uint64 count = buffer[0];
+            if (buffer[2] < buffer[1])
+            {
+                counters->multiplexed = 1;
+            }
+            for (uint64 i = 0; (i < count) && (i < COUNTER_EVENT_COUNT); ++i)
+            {
+                uint64 value = buffer[3 + 2 * i];
+                uint64 id = buffer[3 + 2 * i + 1];
+                for (uint32 event = 0; event < COUNTER_EVENT_COUNT; ++event)
+                {
+                    if (counters->perf_event[event] && (counters->ids[event] == id))
+                    {
+                        values[event] = value;
+                    }
+                }
+            }
+        }
+    }
+    if (!counters->perf_event[COUNTER_TASK_CLOCK])
+    {
+        values[COUNTER_TASK_CLOCK] = (uint64)get_nanoseconds(CLOCK_THREAD_CPUTIME_ID);
+    }
+    if (!counters->perf_event[COUNTER_PAGE_FAULTS])
+    {
+        rusage usage = {};
+#ifdef RUSAGE_THREAD
+        getrusage(RUSAGE_THREAD, &usage);
+#else
+        getrusage(RUSAGE_SELF, &usage);
+#endif
+        values[COUNTER_PAGE_FAULTS] = (uint64)(usage.ru_minflt + usage.ru_majflt);
+    }
+    counters->read_ns += monotonic_nanoseconds() - start_ns;
+    ++counters->reads;
+}
+
+// Starts a stage, or skips something that isn't one.
+inline void
+perf_counters_mark(perf_counters *counters)
+{
+    if (perf_counters_enabled(counters))
+    {
+        perf_counters_read(counters, counters->last);
+    }
+}
+
+// Ends stage, which started at the last mark or end of stage.
+internal void
+perf_counters_end_stage(perf_counters *counters, uint32 stage)
+{
+    if (!perf_counters_enabled(counters) || (stage >= COUNTER_MAX_STAGES))
+    {
+        return;
+    }
+    uint64 values[COUNTER_EVENT_COUNT];
+    memcpy(values, counters->last, sizeof(values));
+    perf_counters_read(counters, values);
+    for (uint32 event = 0; event < COUNTER_EVENT_COUNT; ++event)
+    {
+        counters->totals[stage][event] += values[event] - counters->last[event];
+        counters->last[event] = values[event];
+    }
+}
+
+inline void
+perf_counters_end_frame(perf_counters *counters)
+{
+    ++counters->frames;
+}
+
+// Logs each stage's counts per frame since the last log, then starts over.
+internal void
+perf_counters_log(perf_counters *counters, char **stage_names, uint32 stage_count)
+{
+    if (!perf_counters_enabled(counters) || !counters->frames)
+    {
+        return;
+    }
+    real64 frames = (real64)counters->frames;
+    app_log("Counters over %llu frames, per frame%s, reads %.2f us each:", (unsigned long long)counters->frames,
+        counters->multiplexed ? " (multiplexed, hardware counts are partial)" : "",
+        counters->reads ? (counters->read_ns / 1000.0) / counters->reads : 0.0);
+    for (uint32 stage = 0; (stage < stage_count) && (stage < COUNTER_MAX_STAGES); ++stage)
+    {
+        uint64 *totals = counters->totals[stage];
+        char line[256];
+        int length = snprintf(line, sizeof(line), "  %-8s cpu %.3f ms, %.1f faults",
+            stage_names[stage], totals[COUNTER_TASK_CLOCK] / 1.0e6 / frames, totals[COUNTER_PAGE_FAULTS] / frames);
+        if (counters->available[COUNTER_CYCLES] && counters->available[COUNTER_INSTRUCTIONS])
+        {
+            length += snprintf(line + length, sizeof(line) - length, ", %.0fk instructions, IPC %.2f",
+                totals[COUNTER_INSTRUCTIONS] / 1.0e3 / frames,
+                totals[COUNTER_CYCLES] ? (real64)totals[COUNTER_INSTRUCTIONS] / totals[COUNTER_CYCLES] : 0.0);
+        }
+        real64 kilo_instructions = totals[COUNTER_INSTRUCTIONS] / 1.0e3;
+        if (counters->available[COUNTER_CACHE_MISSES])
+        {
+            length += snprintf(line + length, sizeof(line) - length, ", %.0f cache misses",
+                totals[COUNTER_CACHE_MISSES] / frames);
+            if (counters->available[COUNTER_INSTRUCTIONS] && (kilo_instructions > 0))
+            {
+                length += snprintf(line + length, sizeof(line) - length, " (%.2f MPKI)",
+                    totals[COUNTER_CACHE_MISSES] / kilo_instructions);
+            }
+        }
+        if (counters->available[COUNTER_BRANCH_MISSES])
+        {
+            length += snprintf(line + length, sizeof(line) - length, ", %.0f branch misses",
+                totals[COUNTER_BRANCH_MISSES] / frames);
+            if (counters->available[COUNTER_INSTRUCTIONS] && (kilo_instructions > 0))
+            {
+                length += snprintf(line + length, sizeof(line) - length, " (%.2f MPKI)",
+                    totals[COUNTER_BRANCH_MISSES] / kilo_instructions);
+            }
+        }
+        app_log("%s", line);
+    }
+    memset(counters->totals, 0, sizeof(counters->totals));
+    counters->frames = 0;
+    counters->multiplexed = 0;
+    counters->read_ns = 0;
+    counters->reads = 0;
+}
+
+internal void
+perf_counters_close(perf_counters *counters)
+{
+    for (uint32 event = 0; event < COUNTER_EVENT_COUNT; ++event)
+    {
+        if (counters->perf_event[event])
+        {
+            close(counters->files[event]);
+        }
+    }
+    *counters = {};
+}
+
+#endif
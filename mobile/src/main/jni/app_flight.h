@@ -0,0 +1,252 @@
+#ifndef APP_FLIGHT_H
+#define APP_FLIGHT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "app_log.h"
+#include "app_time.h"
+
+// Flight recorder: the last few thousand frames, kept where a crash can't
+// take them.
+//
+// A fixed ring of 64 byte records in a file mapped MAP_SHARED.  Stores into
+// it land in the page cache, so whatever was written before the process
+// died or hung is still in the file afterwards, and can be pulled off the
+// device and read with bench/flight_decode.  Each frame appends its stage
+// times, poll result, an input summary and the core it ended on, flagged
+// when that's a different one from the frame before; lifecycle commands and
+// suspensions get records of their own.
+//
+// A record's sequence number is cleared before it's written and set after,
+// so a record cut off halfway reads as empty, not as garbage.
+
+#define FLIGHT_MAGIC 0x46524848 // "HHRF"
+#define FLIGHT_VERSION 2
+#define FLIGHT_RECORD_COUNT 4096
+
+enum flight_record_type
+{
+    FLIGHT_FRAME = 1,
+    FLIGHT_COMMAND,
+    FLIGHT_SUSPEND,
+};
+
+enum flight_stage
+{
+    FLIGHT_STAGE_INPUT,
+    FLIGHT_STAGE_UPDATE,
+    FLIGHT_STAGE_SOUND,
+    FLIGHT_STAGE_PRESENT,
+
+    FLIGHT_STAGE_COUNT,
+};
+
+struct flight_frame
+{
+    uint32 frame;
+    uint32 stage_us[FLIGHT_STAGE_COUNT];
+    uint32 work_us;
+    int32 poll_result;
+    // EndedDown of each button of controllers 0 (keyboard) and 1 (touch).
+    uint16 buttons_down[2];
+    uint16 transitions;
+    uint16 input_events;
+    uint8 presented;
+    uint8 game_code;
+    uint8 cpu;
+    uint8 migrated;
+};
+
+struct flight_command
+{
+    int32 command;
+};
+
+struct flight_suspend
+{
+    int64_t wall_ns;
+    int64_t cpu_ns;
+};
+
+struct flight_record
+{
+    uint64 sequence;
+    int64_t time_ns;
+    uint32 type;
+    uint32 reserved;
+    union
+    {
+        flight_frame frame;
+        flight_command command;
+        flight_suspend suspend;
+        uint8 payload[40];
+    };
+};
+
+struct flight_header
+{
+    uint32 magic;
+    uint32 version;
+    uint32 record_size;
+    uint32 record_count;
+    // The same moment on both clocks, to line records up with a bug report.
+    int64_t start_monotonic_ns;
+    int64_t start_realtime_ns;
+    int32 pid;
+    uint32 reserved;
+    uint64 next_sequence;
+};
+
+struct flight_file
+{
+    flight_header header;
+    uint8 padding[64 - sizeof(flight_header)];
+    flight_record records[FLIGHT_RECORD_COUNT];
+};
+
+struct flight_recorder
+{
+    flight_file *file;
+    uint64 next_sequence;
+};
+
+// Starts a new recording in path.  The last one is moved to previous_path
+// first, as the session that crashed is usually the one before the one
+// that gets to report it.  Returns 0 and records nothing if that fails.
+internal bool32
+flight_open(flight_recorder *recorder, char *path, char *previous_path)
+{
+    *recorder = {};
+    rename(path, previous_path);
+    int file = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (file < 0)
+    {
+        app_log("Couldn't open flight recorder %s: %s", path, strerror(errno));
+        return 0;
+    }
+    void *mapping = MAP_FAILED;
+    if (ftruncate(file, sizeof(flight_file)) == 0)
+    {
+        mapping = mmap(0, sizeof(flight_file), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    // The mapping keeps the file.
+    close(file);
+    if (mapping == MAP_FAILED)
+    {
+        app_log("Couldn't map flight recorder %s: %s", path, strerror(errno));
+        return 0;
+    }
+
+    flight_header *header = &((flight_file *)mapping)->header;
+    header->version = FLIGHT_VERSION;
+    header->record_size = sizeof(flight_record);
+    header->record_count = FLIGHT_RECORD_COUNT;
+    header->start_monotonic_ns = monotonic_nanoseconds();
+    header->start_realtime_ns = get_nanoseconds(CLOCK_REALTIME);
+    header->pid = getpid();
+    __atomic_store_n(&header->magic, FLIGHT_MAGIC, __ATOMIC_RELEASE);
+
+    recorder->file = (flight_file *)mapping;
+    recorder->next_sequence = 1;
+    return 1;
+}
+
+inline bool32
+flight_enabled(flight_recorder *recorder)
+{
+    return recorder->file != 0;
+}
+
+// Returns the record to fill in, already typed and timestamped, or 0.
+// Finish it with flight_commit.
+inline flight_record *
+flight_begin(flight_recorder *recorder, flight_record_type type)
+{
+    if (!recorder->file)
+    {
+        return 0;
+    }
+    flight_record *record = &recorder->file->records[recorder->next_sequence % FLIGHT_RECORD_COUNT];
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->time_ns = monotonic_nanoseconds();
+    record->type = type;
+    record->reserved = 0;
+    memset(record->payload, 0, sizeof(record->payload));
+    return record;
+}
+
+inline void
+flight_commit(flight_recorder *recorder, flight_record *record)
+{
+    __atomic_store_n(&record->sequence, recorder->next_sequence, __ATOMIC_RELEASE);
+    ++recorder->next_sequence;
+    __atomic_store_n(&recorder->file->header.next_sequence, recorder->next_sequence, __ATOMIC_RELEASE);
+}
+
+inline uint32
+flight_microseconds(int64_t ns)
+{
+    return (ns <= 0) ? 0 : ((ns / 1000 > 0xffffffff) ? 0xffffffff : (uint32)(ns / 1000));
+}
+
+internal uint16
+flight_buttons_down(game_controller_input *controller)
+{
+    uint16 result = 0;
+    for (uint32 button = 0; (button < ArrayCount(controller->Buttons)) && (button < 16); ++button)
+    {
+        if (controller->Buttons[button].EndedDown)
+        {
+            result |= (uint16)(1 << button);
+        }
+    }
+    return result;
+}
+
+// Fills in the input summary from the input the game was given.
+internal void
+flight_summarize_input(flight_frame *frame, game_input *input)
+{
+    uint32 transitions = 0;
+    for (uint32 controller_index = 0; controller_index < 2; ++controller_index)
+    {
+        game_controller_input *controller = GetController(input, controller_index);
+        frame->buttons_down[controller_index] = flight_buttons_down(controller);
+        for (uint32 button = 0; button < ArrayCount(controller->Buttons); ++button)
+        {
+            transitions += controller->Buttons[button].HalfTransitionCount;
+        }
+    }
+    frame->transitions = (uint16)((transitions > 0xffff) ? 0xffff : transitions);
+}
+
+internal void
+flight_record_command(flight_recorder *recorder, int32 command)
+{
+    flight_record *record = flight_begin(recorder, FLIGHT_COMMAND);
+    if (record)
+    {
+        record->command.command = command;
+        flight_commit(recorder, record);
+    }
+}
+
+internal void
+flight_record_suspend(flight_recorder *recorder, int64_t wall_ns, int64_t cpu_ns)
+{
+    flight_record *record = flight_begin(recorder, FLIGHT_SUSPEND);
+    if (record)
+    {
+        record->suspend.wall_ns = wall_ns;
+        record->suspend.cpu_ns = cpu_ns;
+        flight_commit(recorder, record);
+    }
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef APP_FRAME_H
+#define APP_FRAME_H
+
+#include <inttypes.h>
+#include <time.h>
+
+#include "app_audio.h"
+#include "app_counters.h"
+#include "app_flight.h"
+#include "app_frame_stats.h"
+#include "app_game_code.h"
+#include "app_gl.h"
+#include "app_hot_path.h"
+#include "app_input.h"
+#include "app_latency.h"
+#include "app_log.h"
+#include "app_memory.h"
+#include "app_mixer.h"
+#include "app_overlay.h"
+#include "app_persist.h"
+#include "app_present.h"
+#include "app_threads.h"
+#include "app_time.h"
+#include "app_timed_blocks.h"
+
+// One frame of the game loop, the same on the device and the Linux host:
+// input, update, sound and present, each a stage for the overlay, the
+// counters and the hot path, then the bookkeeping and the sleep until the
+// next frame.
+//
+// The platform owns the modules and points a frame_loop at them once.  What
+// differs is behind two hooks:
+//
+//   poll     fills in new_input from whatever the platform has
+//   present  puts the game's buffer wherever this platform shows it
+//
+// What happens between frames (suspending, dumping stats on request) is
+// still the platform's, as is swapping the inputs afterwards.
+
+struct frame_poll
+{
+    int32 poll_result;
+    uint32 input_events;
+};
+
+typedef frame_poll frame_poll_hook(void *platform, game_input *new_input, game_input *old_input);
+// Returns 0 if nothing was presented.  Sets swapped if it went through the
+// pacer's swap, so the frame can take the time blocked there back out.
+typedef bool32 frame_present_hook(void *platform, bool32 *swapped);
+
+struct frame_loop
+{
+    void *platform;
+    frame_poll_hook *poll;
+    frame_present_hook *present;
+
+    thread_context *thread;
+    game_memory *storage;
+    platform_memory *memory;
+    uint8_t *texture_buffer;
+    game_code_set *games;
+    persistent_storage *persist;
+
+    audio_output *audio;
+    audio_mixer *mixer;
+    // 0 without sound.
+    mixer_stream *game_sound;
+    uint32 game_samples_per_second;
+    uint32 audio_frames_per_update;
+
+    perf_overlay *overlay;
+    perf_counters *counters;
+    hot_path_tracker *hot_path;
+    timed_block_set *timed_blocks;
+    thread_sched_stats *sched;
+    latency_probe *latency;
+    late_latch_state *latch;
+    frame_pacer *pacer;
+    frame_stats *frames;
+    flight_recorder *flight;
+
+    int64_t target_ns_per_frame;
+    // Moves on to the next game code every this many frames; 0 never does.
+    uint64_t game_swap_frames;
+    // Logs each module's window every this many frames; 0 leaves logging
+    // to the platform.
+    uint32 log_interval;
+    bool32 unpaced;
+
+    uint64_t frame_count;
+    uint64_t total_work_ns;
+    int64_t max_work_ns;
+    uint64_t over_budget_frames;
+};
+
+internal void
+frame_log_windows(frame_loop *loop)
+{
+    thread_sched_stats *sched = loop->sched;
+    app_log("Game thread over %" PRIu64 " frames: %" PRIu64 " migrations, %" PRIu64 " frames on a new cpu, "
+        "%" PRIu64 " involuntary switches, on cpu %d",
+        sched->window_frames, sched->window_migrations, sched->window_migrated_frames,
+        sched->window_involuntary_switches, sched->frame_cpu);
+    thread_sched_stats_reset_window(sched);
+
+    if (loop->latency->history_count)
+    {
+        latency_summary latency = latency_summarize(loop->latency);
+        app_log("Input latency over %u frames: min %" PRId64 " p50 %" PRId64 " p95 %" PRId64 " max %" PRId64 " us%s",
+            latency.sample_count, latency.min_ns / 1000, latency.p50_ns / 1000,
+            latency.p95_ns / 1000, latency.max_ns / 1000, loop->latch->enabled ? " (late latch)" : "");
+    }
+
+    frame_pacer *pacer = loop->pacer;
+    if (pacer->window_frames)
+    {
+        app_log("Pacing %s over %u frames: swap blocked avg %.2f max %.2f ms, interval jitter %.2f ms, "
+            "present lag max %.2f ms",
+            pacing_mode_names[pacer->mode], pacer->window_frames,
+            (pacer->window_swap_ns / 1.0e6) / pacer->window_frames, pacer->window_max_swap_ns / 1.0e6,
+            frame_pacer_window_jitter_ms(pacer), pacer->window_max_present_lag_ns / 1.0e6);
+        frame_pacer_reset_window(pacer);
+    }
+
+    if (loop->games->count > 1)
+    {
+        game_code_log_stats(loop->games);
+    }
+
+    perf_counters_log(loop->counters, overlay_stage_names, OVERLAY_STAGE_COUNT);
+    timed_blocks_log(loop->timed_blocks);
+    hot_path_log(loop->hot_path, overlay_stage_names, OVERLAY_STAGE_COUNT);
+
+    audio_output *audio = loop->audio;
+    if (loop->game_sound && audio->playing)
+    {
+        app_log("Audio: period %u frames, latency %.1f ms, %u underruns",
+            audio->period_frames, audio_latency_ms(audio), audio->underruns_seen);
+    }
+}
+
+// Runs one frame, sleeping afterwards unless something else paces it.
+// Returns whether it presented.
+internal bool32
+frame_step(frame_loop *loop, game_input *new_input, game_input *old_input)
+{
+    uint64_t frame = ++loop->frame_count;
+    perf_overlay *overlay = loop->overlay;
+    perf_counters *counters = loop->counters;
+    hot_path_tracker *hot_path = loop->hot_path;
+    late_latch_state *latch = loop->latch;
+    frame_pacer *pacer = loop->pacer;
+
+    if (latch->enabled && !loop->unpaced)
+    {
+        late_latch_wait(latch);
+    }
+
+    platform_memory_begin_frame(loop->memory);
+
+    int64_t frame_start_ns = get_nanoseconds(CLOCK_MONOTONIC_RAW);
+    int64_t stage_start_ns = monotonic_nanoseconds();
+    perf_counters_mark(counters);
+    hot_path_stage(hot_path, OVERLAY_STAGE_INPUT);
+
+    begin_keyboard_controller(new_input, old_input);
+    frame_poll poll = loop->poll(loop->platform, new_input, old_input);
+    new_input->dtForFrame = loop->target_ns_per_frame / (1024.0 * 1024 * 1024);
+
+    int64_t update_start_ns = monotonic_nanoseconds();
+    overlay_record_stage(overlay, OVERLAY_STAGE_INPUT, update_start_ns - stage_start_ns);
+    perf_counters_end_stage(counters, OVERLAY_STAGE_INPUT);
+    hot_path_stage(hot_path, OVERLAY_STAGE_UPDATE);
+
+    game_offscreen_buffer game_buffer = {};
+    game_buffer.Memory = loop->texture_buffer;
+    game_buffer.Width = GAME_BUFFER_WIDTH;
+    game_buffer.Height = GAME_BUFFER_HEIGHT;
+    game_buffer.Pitch = GAME_BUFFER_WIDTH * 4;
+    game_buffer.BytesPerPixel = 4;
+
+    if (loop->game_swap_frames && (frame % loop->game_swap_frames == 0))
+    {
+        game_code_next(loop->games);
+    }
+    game_code *game = game_code_current(loop->games);
+    persist_unseal(loop->persist);
+    game->update_and_render(loop->thread, loop->storage, new_input, &game_buffer);
+
+    int64_t sound_start_ns = monotonic_nanoseconds();
+    game_code_record(loop->games, sound_start_ns - update_start_ns);
+    overlay_record_stage(overlay, OVERLAY_STAGE_UPDATE, sound_start_ns - update_start_ns);
+    perf_counters_end_stage(counters, OVERLAY_STAGE_UPDATE);
+    hot_path_stage(hot_path, OVERLAY_STAGE_SOUND);
+
+    audio_output *audio = loop->audio;
+    mixer_stream *game_sound = loop->game_sound;
+    uint32 audio_frames = game_sound ? audio_frames_wanted(audio, loop->audio_frames_per_update) : 0;
+    if (audio_frames)
+    {
+        mixer_begin(loop->mixer, audio_frames);
+
+        game_sound_output_buffer sound_buffer = {};
+        sound_buffer.SamplesPerSecond = loop->game_samples_per_second;
+        sound_buffer.SampleCount = mixer_resampler_input_frames(&game_sound->resampler, audio_frames);
+        sound_buffer.Samples = game_sound->input;
+        game->get_sound_samples(loop->thread, loop->storage, &sound_buffer);
+        mixer_mix_stream(loop->mixer, game_sound);
+
+        mixer_end(loop->mixer, audio->staging);
+        audio_ring_write(&audio->ring, audio->staging, audio_frames);
+    }
+    if (game_sound && audio_adapt_period(audio))
+    {
+        app_log("Audio period now %u frames", audio->period_frames);
+    }
+
+    overlay_record_stage(overlay, OVERLAY_STAGE_SOUND, monotonic_nanoseconds() - sound_start_ns);
+    perf_counters_end_stage(counters, OVERLAY_STAGE_SOUND);
+    // For the hot path, the overlay is part of presenting.
+    hot_path_stage(hot_path, OVERLAY_STAGE_PRESENT);
+    overlay_draw(overlay, loop->texture_buffer, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT, GAME_BUFFER_WIDTH * 4);
+
+    // The overlay isn't part of any stage.
+    perf_counters_mark(counters);
+    int64_t present_start_ns = monotonic_nanoseconds();
+    bool32 swapped = 0;
+    bool32 presented = loop->present(loop->platform, &swapped);
+    overlay_record_stage(overlay, OVERLAY_STAGE_PRESENT, monotonic_nanoseconds() - present_start_ns);
+    perf_counters_end_stage(counters, OVERLAY_STAGE_PRESENT);
+    perf_counters_end_frame(counters);
+    hot_path_end_frame(hot_path);
+    latency_end_frame(loop->latency, presented, monotonic_nanoseconds());
+
+    int64_t time_taken = get_nanoseconds(CLOCK_MONOTONIC_RAW) - frame_start_ns;
+    if (latch->enabled)
+    {
+        late_latch_end_frame(latch, time_taken);
+    }
+
+    frame_stats_record(loop->frames, frame_start_ns, time_taken);
+    if (swapped)
+    {
+        frame_stats_record_swap(loop->frames, pacer->last_swap_ns);
+    }
+
+    thread_sched_stats_frame(loop->sched);
+    overlay_update_memory(overlay);
+    timed_blocks_collect(loop->timed_blocks);
+    if (loop->log_interval && (frame % loop->log_interval == 0))
+    {
+        frame_log_windows(loop);
+    }
+
+    // When the swap waited for vsync, the wait doesn't count against the
+    // frame.  Without a swap there was nothing to wait in, so we sleep
+    // whatever the pacing.
+    bool32 paced_by_swap = swapped && !frame_pacer_sleeps(pacer);
+    int64_t frame_busy_ns = paced_by_swap ? (time_taken - pacer->last_swap_ns) : time_taken;
+    loop->total_work_ns += frame_busy_ns;
+    if (frame_busy_ns > loop->max_work_ns)
+    {
+        loop->max_work_ns = frame_busy_ns;
+    }
+    overlay_record_frame(overlay, frame_busy_ns);
+
+    flight_record *flight = flight_begin(loop->flight, FLIGHT_FRAME);
+    if (flight)
+    {
+        flight->frame.frame = (uint32)frame;
+        // The overlay's stages are in the same order.
+        for (uint32 stage = 0; stage < FLIGHT_STAGE_COUNT; ++stage)
+        {
+            flight->frame.stage_us[stage] = flight_microseconds(overlay->stage_ns[stage]);
+        }
+        flight->frame.work_us = flight_microseconds(frame_busy_ns);
+        flight->frame.poll_result = poll.poll_result;
+        flight_summarize_input(&flight->frame, new_input);
+        flight->frame.input_events = (uint16)poll.input_events;
+        flight->frame.presented = (uint8)presented;
+        flight->frame.game_code = (uint8)loop->games->current;
+        flight->frame.cpu = (uint8)loop->sched->frame_cpu;
+        flight->frame.migrated = (uint8)loop->sched->frame_migrated;
+        flight_commit(loop->flight, flight);
+    }
+
+    // Whole milliseconds, as the pacer always has.
+    int64_t time_to_sleep = (pacer->frame_ns / 1000000) * 1000000;
+    if (frame_busy_ns <= time_to_sleep)
+    {
+        // With late latching, the sleep happened at the top of the frame.
+        if (!loop->unpaced && !latch->enabled && !paced_by_swap)
+        {
+            timespec sleep_time = {};
+            sleep_time.tv_nsec = time_to_sleep - time_taken;
+            timespec remainder = {};
+            nanosleep(&sleep_time, &remainder);
+        }
+    }
+    else
+    {
+        ++loop->over_budget_frames;
+        if (loop->log_interval && (frame % 10 == 0))
+        {
+            app_log("Skipped frame!  Took %" PRId64 " ns total", frame_busy_ns);
+        }
+    }
+
+    return presented;
+}
+
+#endif
@@ -0,0 +1,386 @@
+#ifndef APP_FRAME_STATS_H
+#define APP_FRAME_STATS_H
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+// Session frame-time recorder.
+//
+// Every frame's interval (start to start, which is what the player sees),
+// work time (start to the end of present) and time blocked in the swap go
+// into fixed width histograms covering the whole session, so recording is
+// one increment and percentiles stay good to a bucket however long we run.
+// Recordings are written as text so they can be pulled off a device and
+// compared against a baseline with bench/frame_stats_compare.
+//
+// Besides on exit, a recording can be asked for at any time by sending the
+// process SIGUSR2 (ART keeps SIGUSR1 for itself); the frame loop notices at
+// the end of the frame.
+//
+// A frame is jank when it takes more than one and a half frame budgets (so a
+// frame was shown twice), and big jank past three budgets.
+
+#define FRAME_STATS_BUCKET_NS 100000
+// Anything past 204.8 ms goes in the last bucket; max_ns keeps the real value.
+#define FRAME_STATS_BUCKET_COUNT 2048
+#define FRAME_STATS_VERSION 1
+
+// One-sided p < 0.001.
+#define FRAME_STATS_SIGNIFICANT_Z 3.09
+// Vargha-Delaney A; 0.56 is the usual threshold for a small effect.  Below
+// that, a significant shift is too small to care about.
+#define FRAME_STATS_MIN_EFFECT 0.56
+
+enum frame_stats_kind
+{
+    FRAME_STATS_INTERVAL,
+    FRAME_STATS_WORK,
+    FRAME_STATS_SWAP,
+
+    FRAME_STATS_KIND_COUNT,
+};
+
+global_variable char *frame_stats_kind_names[FRAME_STATS_KIND_COUNT] = {"interval", "work", "swap"};
+
+struct frame_histogram
+{
+    uint32 counts[FRAME_STATS_BUCKET_COUNT];
+    uint64_t count;
+    int64_t max_ns;
+    uint64_t jank_count;
+    uint64_t big_jank_count;
+};
+
+struct frame_stats
+{
+    int64_t budget_ns;
+    int64_t last_start_ns;
+    frame_histogram histograms[FRAME_STATS_KIND_COUNT];
+};
+
+struct frame_stats_summary
+{
+    uint64_t frames;
+    int64_t p50_ns;
+    int64_t p90_ns;
+    int64_t p99_ns;
+    int64_t p999_ns;
+    int64_t max_ns;
+    uint64_t jank_count;
+    uint64_t big_jank_count;
+};
+
+struct frame_stats_comparison
+{
+    // Mann-Whitney U over the two histograms; positive z means the
+    // candidate is slower.
+    real64 shift_z;
+    // Probability that a random candidate frame is slower than a random
+    // baseline frame.
+    real64 shift_effect;
+    // Two-proportion z for the jank rate; positive means more jank.
+    real64 jank_z;
+
+    bool32 shift_regressed;
+    bool32 jank_regressed;
+};
+
+global_variable volatile sig_atomic_t global_frame_stats_dump_requested;
+
+internal void
+frame_stats_on_signal(int signal_number)
+{
+    global_frame_stats_dump_requested = 1;
+}
+
+internal void
+frame_stats_init(frame_stats *stats, int64_t budget_ns)
+{
+    *stats = {};
+    stats->budget_ns = budget_ns;
+
+    struct sigaction action = {};
+    action.sa_handler = frame_stats_on_signal;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, 0);
+}
+
+internal bool32
+frame_stats_dump_requested()
+{
+    if (global_frame_stats_dump_requested)
+    {
+        global_frame_stats_dump_requested = 0;
+        return 1;
+    }
+    return 0;
+}
+
+internal void
+frame_histogram_add(frame_histogram *histogram, int64_t budget_ns, int64_t ns)
+{
+    int64_t bucket = ns / FRAME_STATS_BUCKET_NS;
+    if (bucket < 0)
+    {
+        bucket = 0;
+    }
+    if (bucket >= FRAME_STATS_BUCKET_COUNT)
+    {
+        bucket = FRAME_STATS_BUCKET_COUNT - 1;
+    }
+    ++histogram->counts[bucket];
+    ++histogram->count;
+    if (ns > histogram->max_ns)
+    {
+        histogram->max_ns = ns;
+    }
+    if (2 * ns > 3 * budget_ns)
+    {
+        ++histogram->jank_count;
+    }
+    if (ns > 3 * budget_ns)
+    {
+        ++histogram->big_jank_count;
+    }
+}
+
+// Call once per frame with the frame's start time and how long its work
+// took.  The first frame only sets the start for the next interval.
+internal void
+frame_stats_record(frame_stats *stats, int64_t start_ns, int64_t work_ns)
+{
+    if (stats->last_start_ns)
+    {
+        frame_histogram_add(&stats->histograms[FRAME_STATS_INTERVAL], stats->budget_ns,
+            start_ns - stats->last_start_ns);
+    }
+    stats->last_start_ns = start_ns;
+    frame_histogram_add(&stats->histograms[FRAME_STATS_WORK], stats->budget_ns, work_ns);
+}
+
+internal void
+frame_stats_record_swap(frame_stats *stats, int64_t swap_ns)
+{
+    frame_histogram_add(&stats->histograms[FRAME_STATS_SWAP], stats->budget_ns, swap_ns);
+}
+
+// After a pause the next interval means nothing; start over from the next
+// frame.
+internal void
+frame_stats_restart_interval(frame_stats *stats)
+{
+    stats->last_start_ns = 0;
+}
+
+// Reported as the top of the bucket the percentile falls in, so we never
+// claim a frame was faster than it was.
+internal int64_t
+frame_histogram_percentile(frame_histogram *histogram, real64 fraction)
+{
+    if (!histogram->count)
+    {
+        return 0;
+    }
+    uint64_t wanted = (uint64_t)ceil(fraction * histogram->count);
+    if (wanted < 1)
+    {
+        wanted = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32 bucket = 0; bucket < FRAME_STATS_BUCKET_COUNT; ++bucket)
+    {
+        seen += histogram->counts[bucket];
+        if (seen >= wanted)
+        {
+            int64_t top = (int64_t)(bucket + 1) * FRAME_STATS_BUCKET_NS;
+            return (top < histogram->max_ns) ? top : histogram->max_ns;
+        }
+    }
+    return histogram->max_ns;
+}
+
+internal frame_stats_summary
+frame_histogram_summarize(frame_histogram *histogram)
+{
+    frame_stats_summary result = {};
+    result.frames = histogram->count;
+    result.p50_ns = frame_histogram_percentile(histogram, 0.5);
+    result.p90_ns = frame_histogram_percentile(histogram, 0.9);
+    result.p99_ns = frame_histogram_percentile(histogram, 0.99);
+    result.p999_ns = frame_histogram_percentile(histogram, 0.999);
+    result.max_ns = histogram->max_ns;
+    result.jank_count = histogram->jank_count;
+    result.big_jank_count = histogram->big_jank_count;
+    return result;
+}
+
+// Text format: a version line, one summary line per kind for people, then
+// one line per non-empty bucket for frame_stats_read.
+internal bool32
+frame_stats_write(frame_stats *stats, char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fprintf(file, "frame_stats version=%d bucket_ns=%d budget_ns=%lld\n",
+        FRAME_STATS_VERSION, FRAME_STATS_BUCKET_NS, (long long)stats->budget_ns);
+    for (uint32 kind = 0; kind < FRAME_STATS_KIND_COUNT; ++kind)
+    {
+        frame_histogram *histogram = &stats->histograms[kind];
+        frame_stats_summary summary = frame_histogram_summarize(histogram);
+        fprintf(file, "summary kind=%s frames=%llu p50_ns=%lld p90_ns=%lld p99_ns=%lld p999_ns=%lld max_ns=%lld jank=%llu big_jank=%llu\n",
+            frame_stats_kind_names[kind], (unsigned long long)summary.frames,
+            (long long)summary.p50_ns, (long long)summary.p90_ns, (long long)summary.p99_ns,
+            (long long)summary.p999_ns, (long long)summary.max_ns,
+            (unsigned long long)summary.jank_count, (unsigned long long)summary.big_jank_count);
+    }
+    for (uint32 kind = 0; kind < FRAME_STATS_KIND_COUNT; ++kind)
+    {
+        frame_histogram *histogram = &stats->histograms[kind];
+        for (uint32 bucket = 0; bucket < FRAME_STATS_BUCKET_COUNT; ++bucket)
+        {
+            if (histogram->counts[bucket])
+            {
+                fprintf(file, "bucket kind=%s index=%u count=%u\n",
+                    frame_stats_kind_names[kind], bucket, histogram->counts[bucket]);
+            }
+        }
+    }
+
+    bool32 result = !ferror(file);
+    result = (fclose(file) == 0) && result;
+    return result;
+}
+
+internal uint32
+frame_stats_find_kind(char *name)
+{
+    uint32 kind = 0;
+    while ((kind < FRAME_STATS_KIND_COUNT) && strcmp(name, frame_stats_kind_names[kind]))
+    {
+        ++kind;
+    }
+    return kind;
+}
+
+internal bool32
+frame_stats_read(frame_stats *stats, char *path)
+{
+    *stats = {};
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    bool32 result = 0;
+    char line[512];
+    char kind_name[32];
+    int version;
+    int bucket_ns;
+    long long budget_ns;
+    if (fgets(line, sizeof(line), file) &&
+        (sscanf(line, "frame_stats version=%d bucket_ns=%d budget_ns=%lld", &version, &bucket_ns, &budget_ns) == 3) &&
+        (version == FRAME_STATS_VERSION) && (bucket_ns == FRAME_STATS_BUCKET_NS))
+    {
+        result = 1;
+        stats->budget_ns = budget_ns;
+    }
+
+    while (result && fgets(line, sizeof(line), file))
+    {
+        uint32 kind;
+        unsigned long long frames, jank, big_jank;
+        long long p50, p90, p99, p999, max_ns;
+        uint32 index, count;
+        if (sscanf(line, "summary kind=%31s frames=%llu p50_ns=%lld p90_ns=%lld p99_ns=%lld p999_ns=%lld max_ns=%lld jank=%llu big_jank=%llu",
+                kind_name, &frames, &p50, &p90, &p99, &p999, &max_ns, &jank, &big_jank) == 9)
+        {
+            kind = frame_stats_find_kind(kind_name);
+            if (kind < FRAME_STATS_KIND_COUNT)
+            {
+                frame_histogram *histogram = &stats->histograms[kind];
+                histogram->max_ns = max_ns;
+                histogram->jank_count = jank;
+                histogram->big_jank_count = big_jank;
+            }
+        }
+        else if (sscanf(line, "bucket kind=%31s index=%u count=%u", kind_name, &index, &count) == 3)
+        {
+            kind = frame_stats_find_kind(kind_name);
+            if ((kind < FRAME_STATS_KIND_COUNT) && (index < FRAME_STATS_BUCKET_COUNT))
+            {
+                frame_histogram *histogram = &stats->histograms[kind];
+                histogram->counts[index] += count;
+                histogram->count += count;
+            }
+        }
+        else if (strncmp(line, "timed_block ", 12))
+        {
+            // Timed blocks (app_timed_blocks.h) are for people, like the
+            // summaries.
+            result = 0;
+        }
+    }
+
+    fclose(file);
+    return result;
+}
+
+internal frame_stats_comparison
+frame_histogram_compare(frame_histogram *baseline, frame_histogram *candidate)
+{
+    frame_stats_comparison result = {};
+    real64 n1 = (real64)candidate->count;
+    real64 n2 = (real64)baseline->count;
+    if ((n1 < 1) || (n2 < 1))
+    {
+        return result;
+    }
+
+    // U counts candidate/baseline pairs where the candidate frame is slower,
+    // with pairs in the same bucket counting as half.  The variance gets the
+    // usual correction for ties, which with 100us buckets is most pairs.
+    real64 u = 0;
+    real64 baseline_below = 0;
+    real64 tie_term = 0;
+    for (uint32 bucket = 0; bucket < FRAME_STATS_BUCKET_COUNT; ++bucket)
+    {
+        real64 c1 = candidate->counts[bucket];
+        real64 c2 = baseline->counts[bucket];
+        u += c1 * (baseline_below + 0.5 * c2);
+        baseline_below += c2;
+        real64 t = c1 + c2;
+        tie_term += t * t * t - t;
+    }
+
+    real64 n = n1 + n2;
+    real64 mean = 0.5 * n1 * n2;
+    real64 variance = (n1 * n2 / 12.0) * ((n + 1) - tie_term / (n * (n - 1)));
+    result.shift_effect = u / (n1 * n2);
+    if (variance > 0)
+    {
+        result.shift_z = (u - mean) / sqrt(variance);
+    }
+
+    real64 p1 = candidate->jank_count / n1;
+    real64 p2 = baseline->jank_count / n2;
+    real64 pooled = (candidate->jank_count + baseline->jank_count) / n;
+    real64 jank_variance = pooled * (1 - pooled) * (1 / n1 + 1 / n2);
+    if (jank_variance > 0)
+    {
+        result.jank_z = (p1 - p2) / sqrt(jank_variance);
+    }
+
+    result.shift_regressed = (result.shift_z > FRAME_STATS_SIGNIFICANT_Z) &&
+        (result.shift_effect >= FRAME_STATS_MIN_EFFECT);
+    result.jank_regressed = result.jank_z > FRAME_STATS_SIGNIFICANT_Z;
+    return result;
+}
+
+#endif
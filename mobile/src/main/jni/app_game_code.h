@@ -0,0 +1,192 @@
+#ifndef APP_GAME_CODE_H
+#define APP_GAME_CODE_H
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_log.h"
+
+// Builds of the game code the platform can switch between.
+//
+// The game compiled into the platform is always there as the first
+// variant.  Others are shared libraries built from the same sources, say
+// at another optimization level or with another renderer, exporting
+// GameUpdateAndRender and GameGetSoundSamples.  Switching happens between
+// frames and doesn't touch game_memory, so two builds can be compared in
+// one process on the same game state.
+//
+// Libraries stay loaded once opened, as the game state may still point at
+// their constant data.  Timing is kept per variant.
+
+#define GAME_CODE_MAX_VARIANTS 8
+
+struct timed_block_table;
+typedef void game_attach_timed_blocks(timed_block_table *table);
+
+struct game_code
+{
+    char name[64];
+    void *library;
+    game_update_and_render *update_and_render;
+    game_get_sound_samples *get_sound_samples;
+    // Optional; see game_timed_blocks.h.
+    game_attach_timed_blocks *attach_timed_blocks;
+
+    uint64 frames;
+    int64_t update_ns;
+};
+
+struct game_code_set
+{
+    game_code variants[GAME_CODE_MAX_VARIANTS];
+    uint32 count;
+    uint32 current;
+};
+
+internal void
+game_code_init(game_code_set *set, game_update_and_render *update_and_render,
+    game_get_sound_samples *get_sound_samples)
+{
+    *set = {};
+    game_code *builtin = &set->variants[set->count++];
+    snprintf(builtin->name, sizeof(builtin->name), "builtin");
+    builtin->update_and_render = update_and_render;
+    builtin->get_sound_samples = get_sound_samples;
+}
+
+// Returns the new variant's index, or -1 if it couldn't be loaded.
+internal int32
+game_code_add_library(game_code_set *set, char *path)
+{
+    if (set->count == GAME_CODE_MAX_VARIANTS)
+    {
+        app_log("No room for game code %s", path);
+        return -1;
+    }
+
+    // Local, so the library's calls to its own functions never bind to the
+    // ones compiled into the platform.
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+    {
+        app_log("Couldn't load game code %s: %s", path, dlerror());
+        return -1;
+    }
+    game_update_and_render *update_and_render =
+        (game_update_and_render *)dlsym(library, "GameUpdateAndRender");
+    game_get_sound_samples *get_sound_samples =
+        (game_get_sound_samples *)dlsym(library, "GameGetSoundSamples");
+    if (!update_and_render || !get_sound_samples)
+    {
+        app_log("Game code %s doesn't export GameUpdateAndRender and GameGetSoundSamples", path);
+        dlclose(library);
+        return -1;
+    }
+
+    game_code *variant = &set->variants[set->count];
+    *variant = {};
+    char *slash = strrchr(path, '/');
+    snprintf(variant->name, sizeof(variant->name), "%s", slash ? slash + 1 : path);
+    variant->library = library;
+    variant->update_and_render = update_and_render;
+    variant->get_sound_samples = get_sound_samples;
+#if HANDMADE_INTERNAL
+    variant->attach_timed_blocks = (game_attach_timed_blocks *)dlsym(library, "GameAttachTimedBlocks");
+#endif
+    return (int32)set->count++;
+}
+
+internal int
+game_code_compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+// Adds every .so in directory, in name order.  Returns how many loaded.
+internal uint32
+game_code_add_directory(game_code_set *set, char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (!dir)
+    {
+        return 0;
+    }
+
+    char *names[GAME_CODE_MAX_VARIANTS];
+    uint32 name_count = 0;
+    dirent *entry;
+    while ((entry = readdir(dir)) && (name_count < ArrayCount(names)))
+    {
+        size_t length = strlen(entry->d_name);
+        if ((length > 3) && !strcmp(entry->d_name + length - 3, ".so"))
+        {
+            names[name_count++] = strdup(entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(names, name_count, sizeof(names[0]), game_code_compare_names);
+
+    uint32 loaded = 0;
+    for (uint32 i = 0; i < name_count; ++i)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+        if (game_code_add_library(set, path) >= 0)
+        {
+            ++loaded;
+        }
+        free(names[i]);
+    }
+    return loaded;
+}
+
+inline game_code *
+game_code_current(game_code_set *set)
+{
+    return &set->variants[set->current];
+}
+
+// Only between frames.
+internal void
+game_code_select(game_code_set *set, uint32 index)
+{
+    if (index < set->count)
+    {
+        set->current = index;
+        app_log("Game code now %s", set->variants[index].name);
+    }
+}
+
+inline void
+game_code_next(game_code_set *set)
+{
+    game_code_select(set, (set->current + 1) % set->count);
+}
+
+inline void
+game_code_record(game_code_set *set, int64_t update_ns)
+{
+    game_code *variant = game_code_current(set);
+    ++variant->frames;
+    variant->update_ns += update_ns;
+}
+
+internal void
+game_code_log_stats(game_code_set *set)
+{
+    for (uint32 i = 0; i < set->count; ++i)
+    {
+        game_code *variant = &set->variants[i];
+        if (variant->frames)
+        {
+            app_log("Game code %s: %" PRIu64 " frames, update avg %.3f ms", variant->name,
+                variant->frames, (variant->update_ns / 1.0e6) / variant->frames);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,521 @@
+#ifndef APP_GL_H
+#define APP_GL_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "app_gl_cache.h"
+#include "app_log.h"
+#include "app_pixels.h"
+
+// Presentation of the game's offscreen buffer: a single textured quad.
+// Shared by the Android platform layer and the Linux host's EGL mode, and
+// expects a current GLES2 context for every call.
+//
+// How the buffer gets to the texture is an upload strategy: a format (as it
+// is with the shader swapping channels, as it is through
+// GL_EXT_texture_format_BGRA8888, or converted to dithered RGB565 at half
+// the size, see app_pixels.h) and an update method (sub-image into the same
+// storage, respecifying the whole image, or orphaning the storage and then
+// updating the new one).  rgba8-sub is what we've always done.
+//
+// How the texture gets to the screen is a scale mode.  The game's buffer is
+// always the same size, so whatever the display, the CPU side costs the same
+// and only the GPU pays for more output pixels:
+//
+//   stretch   fill the whole surface with plain bilinear filtering, aspect
+//             ratio or not; what we've always done
+//   integer   the largest whole multiple of the buffer that fits, nearest
+//             filtered and centred, so every game pixel is the same square
+//   sharp     the largest size that keeps the aspect ratio, sampled as if
+//             the buffer had first been scaled up by the whole part of that
+//             with nearest filtering and then by the rest bilinearly: crisp
+//             pixels, with a one pixel blend only along the edges between
+//             them
+//
+// At 1080p and 2160p the fit is a whole multiple (2x and 4x), so integer and
+// sharp look the same there and only differ on in-between displays.
+
+#define GAME_BUFFER_WIDTH 960
+#define GAME_BUFFER_HEIGHT 540
+#define GAME_BUFFER_RGB565_SIZE (sizeof(uint16) * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT)
+
+enum upload_format
+{
+    UPLOAD_RGBA8,
+    UPLOAD_RGB565,
+    UPLOAD_BGRA8,
+
+    UPLOAD_FORMAT_COUNT,
+};
+
+enum upload_update
+{
+    UPDATE_SUB_IMAGE,
+    UPDATE_FULL_IMAGE,
+    UPDATE_ORPHAN,
+
+    UPLOAD_UPDATE_COUNT,
+};
+
+global_variable char *upload_format_names[UPLOAD_FORMAT_COUNT] = {"rgba8", "rgb565", "bgra8"};
+global_variable char *upload_update_names[UPLOAD_UPDATE_COUNT] = {"sub", "full", "orphan"};
+
+enum scale_mode
+{
+    SCALE_STRETCH,
+    SCALE_INTEGER,
+    SCALE_SHARP,
+
+    SCALE_MODE_COUNT,
+};
+
+global_variable char *scale_mode_names[SCALE_MODE_COUNT] = {"stretch", "integer", "sharp"};
+
+internal bool32
+scale_mode_parse(char *name, scale_mode *mode)
+{
+    for (uint32 candidate = 0; candidate < SCALE_MODE_COUNT; ++candidate)
+    {
+        if (!strcmp(name, scale_mode_names[candidate]))
+        {
+            *mode = (scale_mode)candidate;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct upload_strategy
+{
+    upload_format format;
+    upload_update update;
+};
+
+inline upload_strategy
+make_upload_strategy(upload_format format, upload_update update)
+{
+    upload_strategy result;
+    result.format = format;
+    result.update = update;
+    return result;
+}
+
+internal void
+upload_strategy_name(upload_strategy strategy, char *name, size_t name_size)
+{
+    snprintf(name, name_size, "%s-%s",
+        upload_format_names[strategy.format], upload_update_names[strategy.update]);
+}
+
+// Takes "rgba8-sub" and friends.
+internal bool32
+upload_strategy_parse(char *name, upload_strategy *strategy)
+{
+    for (uint32 format = 0; format < UPLOAD_FORMAT_COUNT; ++format)
+    {
+        for (uint32 update = 0; update < UPLOAD_UPDATE_COUNT; ++update)
+        {
+            char candidate[32];
+            upload_strategy_name(make_upload_strategy((upload_format)format, (upload_update)update),
+                candidate, sizeof(candidate));
+            if (!strcmp(name, candidate))
+            {
+                *strategy = make_upload_strategy((upload_format)format, (upload_update)update);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+internal bool32
+gl_has_extension(char *name)
+{
+    char *extensions = (char *)glGetString(GL_EXTENSIONS);
+    return extensions && strstr(extensions, name);
+}
+
+struct gl_presenter
+{
+    upload_strategy strategy;
+    scale_mode scale;
+    uint16 *rgb565_buffer;
+
+    // The surface, in pixels; 0 until gl_presenter_set_output.
+    int32 output_width;
+    int32 output_height;
+
+    uint program;
+    uint a_pos_id;
+    uint a_tex_coord_id;
+    uint texture_id;
+    uint sampler_id;
+    int texture_size_id;
+    int prescale_id;
+};
+
+// Where the game's buffer goes on the surface, in pixels from the bottom
+// left, and the whole part of its scale for the sharp shader.
+struct gl_output_rect
+{
+    int32 x;
+    int32 y;
+    int32 width;
+    int32 height;
+    real32 prescale;
+};
+
+// Call whenever the surface changes size; glViewport is still the caller's.
+inline void
+gl_presenter_set_output(gl_presenter *gl, int32 width, int32 height)
+{
+    gl->output_width = width;
+    gl->output_height = height;
+}
+
+internal gl_output_rect
+gl_presenter_output_rect(gl_presenter *gl)
+{
+    gl_output_rect rect = {};
+    rect.width = gl->output_width;
+    rect.height = gl->output_height;
+    rect.prescale = 1.0f;
+    if ((gl->scale == SCALE_STRETCH) || (rect.width <= 0) || (rect.height <= 0))
+    {
+        return rect;
+    }
+
+    real32 fit = fminf((real32)gl->output_width / GAME_BUFFER_WIDTH, (real32)gl->output_height / GAME_BUFFER_HEIGHT);
+    real32 whole = floorf(fit);
+    // A surface smaller than the buffer has no whole multiple to offer.
+    real32 scale = ((gl->scale == SCALE_INTEGER) && (whole >= 1.0f)) ? whole : fit;
+    rect.width = (int32)(scale * GAME_BUFFER_WIDTH + 0.5f);
+    rect.height = (int32)(scale * GAME_BUFFER_HEIGHT + 0.5f);
+    // Whole pixel offsets, or nearest filtering would land between them.
+    rect.x = (gl->output_width - rect.width) / 2;
+    rect.y = (gl->output_height - rect.height) / 2;
+    rect.prescale = (whole >= 1.0f) ? whole : 1.0f;
+    return rect;
+}
+
+inline uint32
+gl_presenter_upload_bytes(gl_presenter *gl)
+{
+    uint32 bytes_per_pixel = (gl->strategy.format == UPLOAD_RGB565) ? 2 : 4;
+    return bytes_per_pixel * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT;
+}
+
+// Converts if needed and uploads the whole buffer into the bound texture.
+internal void
+gl_presenter_upload(gl_presenter *gl, uint8_t *texture_buffer, bool32 allocate)
+{
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    void *pixels = texture_buffer;
+    if (gl->strategy.format == UPLOAD_RGB565)
+    {
+        pixels_bgra_to_rgb565_simd(gl->rgb565_buffer, (uint32 *)texture_buffer,
+            GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT);
+        format = GL_RGB;
+        type = GL_UNSIGNED_SHORT_5_6_5;
+        pixels = gl->rgb565_buffer;
+    }
+    else if (gl->strategy.format == UPLOAD_BGRA8)
+    {
+        // The extension wants the internal format to match.
+        format = GL_BGRA_EXT;
+    }
+
+    if (allocate || (gl->strategy.update == UPDATE_FULL_IMAGE))
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, format,
+            GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT, 0,
+            format, type, pixels);
+    }
+    else
+    {
+        if (gl->strategy.update == UPDATE_ORPHAN)
+        {
+            // New storage, so the driver never has to wait for the GPU to
+            // finish reading last frame's.
+            glTexImage2D(GL_TEXTURE_2D, 0, format,
+                GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT, 0,
+                format, type, 0);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D,
+            0,
+            0,
+            0,
+            GAME_BUFFER_WIDTH,
+            GAME_BUFFER_HEIGHT,
+            format,
+            type,
+            pixels);
+    }
+}
+
+internal GLuint
+gl_link_program(char *vertex_shader_source, char *fragment_shader_source)
+{
+    GLuint program = glCreateProgram();
+    uint vertex_shader_id;
+    uint fragment_shader_id;
+
+    {
+        uint shader = vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+        int compiled;
+        glShaderSource(shader, 1, (const char* const *)&vertex_shader_source, 0);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled)
+        {
+            char info_log[1024];
+            glGetShaderInfoLog(shader, sizeof(info_log), 0, info_log);
+            app_log("vertex shader failed to compile: %s", info_log);
+        }
+    }
+    {
+        uint shader = fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+        int compiled;
+        glShaderSource(shader, 1, (const char* const *)&fragment_shader_source, 0);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled)
+        {
+            char info_log[1024];
+            glGetShaderInfoLog(shader, sizeof(info_log), 0, info_log);
+            app_log("fragment shader failed to compile: %s", info_log);
+        }
+    }
+    glAttachShader(program, vertex_shader_id);
+    glAttachShader(program, fragment_shader_id);
+    glLinkProgram(program);
+
+    int linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        char info_log[1024];
+        glGetProgramInfoLog(program, sizeof(info_log), 0, info_log);
+        app_log("program failed to link: %s", info_log);
+    }
+    glDeleteShader(vertex_shader_id);
+    glDeleteShader(fragment_shader_id);
+
+    return program;
+}
+
+// rgb565_buffer is where RGB565 uploads are converted to, GAME_BUFFER_RGB565_SIZE
+// bytes that outlive the presenter; it's only touched with that format.  cache
+// may be 0 to always compile from source.
+internal void
+gl_presenter_init(gl_presenter *gl, uint8_t *texture_buffer, uint16 *rgb565_buffer, upload_strategy strategy,
+    scale_mode scale, gl_program_cache *cache)
+{
+    Assert(rgb565_buffer || (strategy.format != UPLOAD_RGB565));
+    gl->strategy = strategy;
+    gl->scale = scale;
+    gl->rgb565_buffer = rgb565_buffer;
+
+    char *vertex_shader_source =
+        "attribute vec2 a_pos; \n"
+        "attribute vec2 a_tex_coord; \n"
+        "varying vec2 v_tex_coord; \n"
+        "void main() \n"
+        "{ \n"
+        " gl_Position = vec4(a_pos, 0, 1); \n"
+        " v_tex_coord = a_tex_coord; \n"
+        "} \n";
+
+
+    char *fragment_shader_source =
+        "precision mediump float;\n"
+        "varying vec2 v_tex_coord;\n"
+        "uniform sampler2D tex;\n"
+        "void main() \n"
+        "{ \n"
+        " vec4 texture_color = vec4(texture2D( tex, v_tex_coord ).bgr, 1.0);\n"
+        " gl_FragColor = texture_color;\n"
+        "} \n";
+    // Only a BGRA texture comes out of the sampler the right way round.
+    char *bgra_fragment_shader_source =
+        "precision mediump float;\n"
+        "varying vec2 v_tex_coord;\n"
+        "uniform sampler2D tex;\n"
+        "void main() \n"
+        "{ \n"
+        " vec4 texture_color = vec4(texture2D( tex, v_tex_coord ).rgb, 1.0);\n"
+        " gl_FragColor = texture_color;\n"
+        "} \n";
+    if (strategy.format == UPLOAD_BGRA8)
+    {
+        fragment_shader_source = bgra_fragment_shader_source;
+    }
+
+    // Texel coordinates run to 960, past where mediump keeps fractions.
+    char sharp_fragment_shader_source[1024];
+    if (scale == SCALE_SHARP)
+    {
+        snprintf(sharp_fragment_shader_source, sizeof(sharp_fragment_shader_source),
+            "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+            "precision highp float;\n"
+            "#else\n"
+            "precision mediump float;\n"
+            "#endif\n"
+            "varying vec2 v_tex_coord;\n"
+            "uniform sampler2D tex;\n"
+            "uniform vec2 texture_size;\n"
+            "uniform vec2 prescale;\n"
+            "void main() \n"
+            "{ \n"
+            " vec2 texel = v_tex_coord * texture_size;\n"
+            " vec2 texel_floored = floor(texel);\n"
+            " vec2 from_center = fract(texel) - 0.5;\n"
+            " vec2 region_range = 0.5 - 0.5 / prescale;\n"
+            " vec2 blend = (from_center - clamp(from_center, -region_range, region_range)) * prescale + 0.5;\n"
+            " vec4 texture_color = vec4(texture2D( tex, (texel_floored + blend) / texture_size ).%s, 1.0);\n"
+            " gl_FragColor = texture_color;\n"
+            "} \n",
+            (strategy.format == UPLOAD_BGRA8) ? "rgb" : "bgr");
+        fragment_shader_source = sharp_fragment_shader_source;
+    }
+
+    gl->program = gl_program_cache_load(cache, vertex_shader_source, fragment_shader_source);
+    if (!gl->program)
+    {
+        gl->program = gl_link_program(vertex_shader_source, fragment_shader_source);
+        gl_program_cache_save(cache, vertex_shader_source, fragment_shader_source, gl->program);
+    }
+
+    glUseProgram(gl->program);
+    gl->a_pos_id = glGetAttribLocation(gl->program, "a_pos");
+    gl->a_tex_coord_id = glGetAttribLocation(gl->program, "a_tex_coord");
+    gl->sampler_id = glGetAttribLocation(gl->program, "tex");
+    gl->texture_size_id = glGetUniformLocation(gl->program, "texture_size");
+    gl->prescale_id = glGetUniformLocation(gl->program, "prescale");
+    glEnableVertexAttribArray(gl->a_pos_id);
+    glEnableVertexAttribArray(gl->a_tex_coord_id);
+
+    glGenTextures(1, &gl->texture_id);
+    glBindTexture(GL_TEXTURE_2D, gl->texture_id);
+
+    gl_presenter_upload(gl, texture_buffer, 1);
+    GLint filter = (scale == SCALE_INTEGER) ? GL_NEAREST : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    // The sharp shader samples right up to the edge texels.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glDepthFunc(GL_ALWAYS);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_CULL_FACE);
+}
+
+// Draws the texture as it is, without uploading; this is all the GPU does
+// for the scale.
+internal void
+gl_presenter_blit(gl_presenter *gl)
+{
+    gl_output_rect rect = gl_presenter_output_rect(gl);
+    float left = -1;
+    float right = 1;
+    float bottom = -1;
+    float top = 1;
+    if (gl->output_width && gl->output_height)
+    {
+        left = (2.0f * rect.x) / gl->output_width - 1.0f;
+        right = (2.0f * (rect.x + rect.width)) / gl->output_width - 1.0f;
+        bottom = (2.0f * rect.y) / gl->output_height - 1.0f;
+        top = (2.0f * (rect.y + rect.height)) / gl->output_height - 1.0f;
+    }
+
+    float vertexCoords[] =
+    {
+        left, top,
+        left, bottom,
+        right, top,
+        right, bottom,
+    };
+    float texCoords[] =
+    {
+        0.0, 0.0,
+        0.0, 1.0,
+        1.0, 0.0,
+        1.0, 1.0,
+    };
+
+    uint16_t indices[] = { 0, 1, 2, 1, 2, 3 };
+
+    glUseProgram(gl->program);
+
+    uint a_pos_id = glGetAttribLocation(gl->program, "a_pos");
+    uint a_tex_coord_id = glGetAttribLocation(gl->program, "a_tex_coord");
+    uint sampler_id = glGetAttribLocation(gl->program, "tex");
+
+    if (!((a_pos_id == gl->a_pos_id) && (a_tex_coord_id == gl->a_tex_coord_id) && (sampler_id == gl->sampler_id)))
+    {
+        app_log("program mismatch: pos_id %d/%d, tex_coord %d/%d, sampler_id %d/%d", a_pos_id, gl->a_pos_id, a_tex_coord_id, gl->a_tex_coord_id, sampler_id, gl->sampler_id);
+    }
+
+    glVertexAttribPointer(gl->a_pos_id, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), vertexCoords);
+    glVertexAttribPointer(gl->a_tex_coord_id, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), texCoords);
+    glEnableVertexAttribArray(gl->a_pos_id);
+    glEnableVertexAttribArray(gl->a_tex_coord_id);
+    glBindTexture(GL_TEXTURE_2D, gl->texture_id);
+
+    glUniform1i(gl->sampler_id, 0);
+    if (gl->scale == SCALE_SHARP)
+    {
+        glUniform2f(gl->texture_size_id, GAME_BUFFER_WIDTH, GAME_BUFFER_HEIGHT);
+        glUniform2f(gl->prescale_id, rect.prescale, rect.prescale);
+    }
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+}
+
+internal void
+gl_presenter_draw(gl_presenter *gl, uint8_t *texture_buffer)
+{
+    if (gl->scale == SCALE_STRETCH)
+    {
+        static uint8_t grey_value = 0;
+        grey_value += 1;
+        glClearColor(grey_value / 255.0, grey_value / 255.0, grey_value / 255.0, 1.0);
+    }
+    else
+    {
+        // The bars either side.
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+    }
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, gl->texture_id);
+    gl_presenter_upload(gl, texture_buffer, 0);
+    gl_presenter_blit(gl);
+}
+
+// Frees what init made, so another strategy can be tried on the same context.
+internal void
+gl_presenter_destroy(gl_presenter *gl)
+{
+    glDeleteTextures(1, &gl->texture_id);
+    glDeleteProgram(gl->program);
+    *gl = {};
+}
+
+// For when the context has gone and taken the objects with it.
+internal void
+gl_presenter_forget(gl_presenter *gl)
+{
+    gl->program = 0;
+    gl->texture_id = 0;
+}
+
+#endif
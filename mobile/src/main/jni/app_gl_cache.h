@@ -0,0 +1,264 @@
+#ifndef APP_GL_CACHE_H
+#define APP_GL_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "app_log.h"
+#include "app_memory.h"
+
+// Linked program binaries, saved so a new context doesn't have to compile
+// the shaders again.
+//
+// Uses OES_get_program_binary, or the same entry points from GLES3 core.
+// Each program gets a file named after a hash of its sources, holding the
+// driver's binary behind a header with the hash of the GL driver strings
+// and a checksum of the binary.  Anything that doesn't check out, including
+// a driver that won't take back its own binary after an update, is treated
+// as a miss: the caller compiles from source and saves over it.
+//
+// A binary is only held for the length of a load or save, in memory borrowed
+// from the scratch arena; one too big for it is a miss, or isn't saved.
+
+#define GL_PROGRAM_CACHE_MAGIC 0x42504848 // "HHPB"
+#define GL_PROGRAM_CACHE_VERSION 1
+#define GL_PROGRAM_CACHE_MAX_BINARY (16 * 1024 * 1024)
+
+struct gl_program_cache_header
+{
+    uint32 magic;
+    uint32 version;
+    uint64 source_hash;
+    uint64 driver_hash;
+    uint32 binary_format;
+    uint32 binary_length;
+    uint64 binary_checksum;
+};
+
+struct gl_program_cache
+{
+    char directory[1024];
+    uint64 driver_hash;
+    PFNGLGETPROGRAMBINARYOESPROC get_program_binary;
+    PFNGLPROGRAMBINARYOESPROC program_binary;
+    memory_arena *scratch;
+
+    uint32 hits;
+    uint32 misses;
+};
+
+// FNV-1a.
+internal uint64
+gl_program_cache_hash(uint64 hash, void *data, size_t size)
+{
+    uint8 *bytes = (uint8 *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+internal uint64
+gl_program_cache_hash_string(uint64 hash, char *string)
+{
+    return gl_program_cache_hash(hash, string, string ? strlen(string) + 1 : 0);
+}
+
+// Call with the context current.  Returns 0, and the cache stays off, if
+// the driver can't hand out binaries.
+internal bool32
+gl_program_cache_init(gl_program_cache *cache, char *directory, memory_arena *scratch)
+{
+    *cache = {};
+
+    char *extensions = (char *)glGetString(GL_EXTENSIONS);
+    char *version = (char *)glGetString(GL_VERSION);
+    if (extensions && strstr(extensions, "GL_OES_get_program_binary"))
+    {
+        cache->get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+        cache->program_binary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+    }
+    else if (version && !strncmp(version, "OpenGL ES ", 10) && (atoi(version + 10) >= 3))
+    {
+        cache->get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinary");
+        cache->program_binary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinary");
+    }
+
+    int format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &format_count);
+    if (!directory || !cache->get_program_binary || !cache->program_binary || (format_count <= 0))
+    {
+        *cache = {};
+        return 0;
+    }
+
+    snprintf(cache->directory, sizeof(cache->directory), "%s", directory);
+    cache->scratch = scratch;
+    uint64 hash = 0xcbf29ce484222325ull;
+    hash = gl_program_cache_hash_string(hash, (char *)glGetString(GL_VENDOR));
+    hash = gl_program_cache_hash_string(hash, (char *)glGetString(GL_RENDERER));
+    hash = gl_program_cache_hash_string(hash, version);
+    cache->driver_hash = hash;
+    return 1;
+}
+
+inline bool32
+gl_program_cache_enabled(gl_program_cache *cache)
+{
+    return cache && cache->program_binary;
+}
+
+internal uint64
+gl_program_cache_source_hash(char *vertex_shader_source, char *fragment_shader_source)
+{
+    uint64 hash = 0xcbf29ce484222325ull;
+    hash = gl_program_cache_hash_string(hash, vertex_shader_source);
+    hash = gl_program_cache_hash_string(hash, fragment_shader_source);
+    return hash;
+}
+
+internal void
+gl_program_cache_path(gl_program_cache *cache, uint64 source_hash, char *path, size_t path_size)
+{
+    snprintf(path, path_size, "%s/program_%016llx.bin", cache->directory, (unsigned long long)source_hash);
+}
+
+// Returns a linked program, or 0 on a miss.
+internal GLuint
+gl_program_cache_load(gl_program_cache *cache, char *vertex_shader_source, char *fragment_shader_source)
+{
+    if (!gl_program_cache_enabled(cache))
+    {
+        return 0;
+    }
+
+    uint64 source_hash = gl_program_cache_source_hash(vertex_shader_source, fragment_shader_source);
+    char path[1100];
+    gl_program_cache_path(cache, source_hash, path, sizeof(path));
+
+    GLuint program = 0;
+    void *binary = 0;
+    temporary_memory temporary = begin_temporary_memory(cache->scratch);
+    gl_program_cache_header header = {};
+    FILE *file = fopen(path, "rb");
+    if (file &&
+        (fread(&header, sizeof(header), 1, file) == 1) &&
+        (header.magic == GL_PROGRAM_CACHE_MAGIC) &&
+        (header.version == GL_PROGRAM_CACHE_VERSION) &&
+        (header.source_hash == source_hash) &&
+        (header.driver_hash == cache->driver_hash) &&
+        (header.binary_length > 0) && (header.binary_length <= GL_PROGRAM_CACHE_MAX_BINARY) &&
+        (binary = arena_push(cache->scratch, header.binary_length, MEMORY_CACHE_LINE)) &&
+        (fread(binary, header.binary_length, 1, file) == 1) &&
+        (gl_program_cache_hash(0xcbf29ce484222325ull, binary, header.binary_length) == header.binary_checksum))
+    {
+        program = glCreateProgram();
+        cache->program_binary(program, header.binary_format, binary, header.binary_length);
+        int linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            app_log("Cached program %s was rejected by the driver", path);
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    end_temporary_memory(temporary);
+    // Don't leave a rejected binary's error for the next caller to find.
+    while (glGetError() != GL_NO_ERROR)
+    {
+    }
+
+    if (program)
+    {
+        ++cache->hits;
+    }
+    else
+    {
+        ++cache->misses;
+    }
+    return program;
+}
+
+// Saves a program linked from these sources.  Written to a temporary file
+// and renamed, so a crash halfway leaves the old file or none.
+internal bool32
+gl_program_cache_save(gl_program_cache *cache, char *vertex_shader_source, char *fragment_shader_source,
+    GLuint program)
+{
+    if (!gl_program_cache_enabled(cache))
+    {
+        return 0;
+    }
+
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if ((length <= 0) || (length > GL_PROGRAM_CACHE_MAX_BINARY))
+    {
+        return 0;
+    }
+
+    temporary_memory temporary = begin_temporary_memory(cache->scratch);
+    void *binary = arena_push(cache->scratch, length, MEMORY_CACHE_LINE);
+    if (!binary)
+    {
+        end_temporary_memory(temporary);
+        return 0;
+    }
+    GLenum binary_format = 0;
+    GLsizei written_length = 0;
+    cache->get_program_binary(program, length, &written_length, &binary_format, binary);
+    if ((glGetError() != GL_NO_ERROR) || (written_length <= 0))
+    {
+        end_temporary_memory(temporary);
+        return 0;
+    }
+
+    gl_program_cache_header header = {};
+    header.magic = GL_PROGRAM_CACHE_MAGIC;
+    header.version = GL_PROGRAM_CACHE_VERSION;
+    header.source_hash = gl_program_cache_source_hash(vertex_shader_source, fragment_shader_source);
+    header.driver_hash = cache->driver_hash;
+    header.binary_format = binary_format;
+    header.binary_length = written_length;
+    header.binary_checksum = gl_program_cache_hash(0xcbf29ce484222325ull, binary, written_length);
+
+    char path[1100];
+    char temporary_path[1200];
+    gl_program_cache_path(cache, header.source_hash, path, sizeof(path));
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path);
+
+    bool32 saved = 0;
+    FILE *file = fopen(temporary_path, "wb");
+    if (file)
+    {
+        bool32 written = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+            (fwrite(binary, written_length, 1, file) == 1);
+        written = (fclose(file) == 0) && written;
+        saved = written && (rename(temporary_path, path) == 0);
+        if (!saved)
+        {
+            remove(temporary_path);
+        }
+    }
+    end_temporary_memory(temporary);
+
+    if (!saved)
+    {
+        app_log("Couldn't save program binary to %s", path);
+    }
+    return saved;
+}
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef APP_GL_TUNE_H
+#define APP_GL_TUNE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+
+#include "app_gl.h"
+#include "app_log.h"
+#include "app_time.h"
+
+// Picks the fastest upload strategy (see app_gl.h) for this device.
+//
+// Which one wins depends on the driver: some copy a sub-image update
+// straight into the texture, some stall until the GPU is done with the old
+// contents, some store BGRA natively and swizzle everything else on the
+// CPU.  So each candidate is drawn for a few frames with the context
+// current and the median frame, upload to glFinish, is kept.  The winner is
+// cached in a text file keyed by the device and the GL driver strings, so
+// only the first launch after an install or driver update pays for it.
+//
+// Anything that goes wrong ends up at the fallback, which is the path we'd
+// use without tuning.
+
+#define UPLOAD_TUNE_VERSION 1
+#define UPLOAD_TUNE_WARMUP_FRAMES 3
+#define UPLOAD_TUNE_FRAMES 9
+
+struct upload_tuning
+{
+    upload_strategy strategy;
+    int64_t frame_ns;
+    bool32 from_cache;
+};
+
+// The strategies that can be tried here.  When the build asks for RGB565
+// only its update method is tuned.
+internal uint32
+upload_tune_candidates(bool32 rgb565, upload_strategy *candidates, uint32 max_candidates)
+{
+    upload_format formats[2];
+    uint32 format_count = 0;
+    if (rgb565)
+    {
+        formats[format_count++] = UPLOAD_RGB565;
+    }
+    else
+    {
+        formats[format_count++] = UPLOAD_RGBA8;
+        if (gl_has_extension("GL_EXT_texture_format_BGRA8888"))
+        {
+            formats[format_count++] = UPLOAD_BGRA8;
+        }
+    }
+
+    uint32 count = 0;
+    for (uint32 format = 0; format < format_count; ++format)
+    {
+        for (uint32 update = 0; (update < UPLOAD_UPDATE_COUNT) && (count < max_candidates); ++update)
+        {
+            candidates[count++] = make_upload_strategy(formats[format], (upload_update)update);
+        }
+    }
+    return count;
+}
+
+internal int
+upload_tune_compare_ns(const void *a, const void *b)
+{
+    int64_t x = *(int64_t *)a;
+    int64_t y = *(int64_t *)b;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+// Median time to upload and draw one frame, or -1 if the driver rejected
+// the strategy.
+internal int64_t
+upload_tune_time(upload_strategy strategy, uint8_t *texture_buffer, uint16 *rgb565_buffer,
+    gl_program_cache *program_cache)
+{
+    while (glGetError() != GL_NO_ERROR)
+    {
+    }
+
+    gl_presenter gl = {};
+    gl_presenter_init(&gl, texture_buffer, rgb565_buffer, strategy, SCALE_STRETCH, program_cache);
+    glFinish();
+
+    int64_t frame_ns[UPLOAD_TUNE_FRAMES];
+    bool32 failed = (glGetError() != GL_NO_ERROR);
+    for (uint32 frame = 0; !failed && (frame < UPLOAD_TUNE_WARMUP_FRAMES + UPLOAD_TUNE_FRAMES); ++frame)
+    {
+        int64_t start_ns = monotonic_nanoseconds();
+        gl_presenter_draw(&gl, texture_buffer);
+        glFinish();
+        if (frame >= UPLOAD_TUNE_WARMUP_FRAMES)
+        {
+            frame_ns[frame - UPLOAD_TUNE_WARMUP_FRAMES] = monotonic_nanoseconds() - start_ns;
+        }
+        failed = (glGetError() != GL_NO_ERROR);
+    }
+    gl_presenter_destroy(&gl);
+
+    if (failed)
+    {
+        return -1;
+    }
+    qsort(frame_ns, UPLOAD_TUNE_FRAMES, sizeof(frame_ns[0]), upload_tune_compare_ns);
+    return frame_ns[UPLOAD_TUNE_FRAMES / 2];
+}
+
+// One line per device and driver; newlines in the driver strings would
+// split it.
+internal void
+upload_tune_key(char *device, bool32 rgb565, char *key, size_t key_size)
+{
+    snprintf(key, key_size, "v%d %s %s | %s | %s | %s", UPLOAD_TUNE_VERSION, rgb565 ? "rgb565" : "any",
+        device, (char *)glGetString(GL_VENDOR), (char *)glGetString(GL_RENDERER), (char *)glGetString(GL_VERSION));
+    for (char *c = key; *c; ++c)
+    {
+        if ((*c == '\n') || (*c == '\r'))
+        {
+            *c = ' ';
+        }
+    }
+}
+
+// Cache lines are "<strategy> <frame ns> <key>".
+internal bool32
+upload_tune_parse_line(char *line, char *name, size_t name_size, long long *frame_ns, char **key)
+{
+    char *space = strchr(line, ' ');
+    if (!space || ((size_t)(space - line) >= name_size))
+    {
+        return 0;
+    }
+    memcpy(name, line, space - line);
+    name[space - line] = 0;
+
+    char *end;
+    *frame_ns = strtoll(space + 1, &end, 10);
+    if ((end == space + 1) || (*end != ' '))
+    {
+        return 0;
+    }
+    *key = end + 1;
+    size_t key_length = strcspn(*key, "\r\n");
+    (*key)[key_length] = 0;
+    return 1;
+}
+
+internal bool32
+upload_tune_read_cache(char *path, char *key, upload_strategy *candidates, uint32 candidate_count,
+    upload_tuning *tuning)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    bool32 found = 0;
+    char line[1024];
+    while (!found && fgets(line, sizeof(line), file))
+    {
+        char name[32];
+        long long frame_ns;
+        char *line_key;
+        upload_strategy strategy;
+        if (!upload_tune_parse_line(line, name, sizeof(name), &frame_ns, &line_key) ||
+            strcmp(line_key, key) || !upload_strategy_parse(name, &strategy))
+        {
+            continue;
+        }
+        // Only trust it if it's still something we'd try.
+        for (uint32 i = 0; i < candidate_count; ++i)
+        {
+            if ((candidates[i].format == strategy.format) && (candidates[i].update == strategy.update))
+            {
+                tuning->strategy = strategy;
+                tuning->frame_ns = frame_ns;
+                tuning->from_cache = 1;
+                found = 1;
+            }
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+// Rewrites the cache with this key's line replaced.  Leaves it alone if the
+// other lines can't be kept.
+internal bool32
+upload_tune_write_cache(char *path, char *key, upload_tuning *tuning)
+{
+    char *kept = 0;
+    size_t kept_size = 0;
+    FILE *file = fopen(path, "r");
+    if (file)
+    {
+        char line[1024];
+        while (fgets(line, sizeof(line), file))
+        {
+            char copy[1024];
+            memcpy(copy, line, sizeof(line));
+            char name[32];
+            long long frame_ns;
+            char *line_key;
+            if (!upload_tune_parse_line(copy, name, sizeof(name), &frame_ns, &line_key) || !strcmp(line_key, key))
+            {
+                continue;
+            }
+            size_t length = strlen(line);
+            char *grown = (char *)realloc(kept, kept_size + length);
+            if (!grown)
+            {
+                fclose(file);
+                free(kept);
+                return 0;
+            }
+            kept = grown;
+            memcpy(kept + kept_size, line, length);
+            kept_size += length;
+        }
+        fclose(file);
+    }
+
+    bool32 written = 0;
+    file = fopen(path, "w");
+    if (file)
+    {
+        char name[32];
+        upload_strategy_name(tuning->strategy, name, sizeof(name));
+        fwrite(kept, 1, kept_size, file);
+        fprintf(file, "%s %lld %s\n", name, (long long)tuning->frame_ns, key);
+        written = (fclose(file) == 0);
+    }
+    free(kept);
+    return written;
+}
+
+// Call with the context current.  cache_path may be 0 to always probe.
+internal upload_tuning
+upload_tune(char *cache_path, char *device, upload_strategy fallback, uint8_t *texture_buffer,
+    uint16 *rgb565_buffer, gl_program_cache *program_cache)
+{
+    upload_tuning tuning = {};
+    tuning.strategy = fallback;
+
+    bool32 rgb565 = (fallback.format == UPLOAD_RGB565);
+    upload_strategy candidates[UPLOAD_FORMAT_COUNT * UPLOAD_UPDATE_COUNT];
+    uint32 candidate_count = upload_tune_candidates(rgb565, candidates, ArrayCount(candidates));
+
+    char key[512];
+    upload_tune_key(device, rgb565, key, sizeof(key));
+    if (cache_path && upload_tune_read_cache(cache_path, key, candidates, candidate_count, &tuning))
+    {
+        return tuning;
+    }
+
+    int64_t best_ns = -1;
+    for (uint32 i = 0; i < candidate_count; ++i)
+    {
+        char name[32];
+        upload_strategy_name(candidates[i], name, sizeof(name));
+        int64_t frame_ns = upload_tune_time(candidates[i], texture_buffer, rgb565_buffer, program_cache);
+        if (frame_ns < 0)
+        {
+            app_log("Upload %s: not supported", name);
+            continue;
+        }
+        app_log("Upload %s: %.3f ms", name, frame_ns / 1.0e6);
+        if ((best_ns < 0) || (frame_ns < best_ns))
+        {
+            best_ns = frame_ns;
+            tuning.strategy = candidates[i];
+        }
+    }
+    tuning.frame_ns = best_ns;
+
+    if (best_ns < 0)
+    {
+        // Nothing worked; don't remember that.
+        tuning.strategy = fallback;
+        return tuning;
+    }
+    if (cache_path && !upload_tune_write_cache(cache_path, key, &tuning))
+    {
+        app_log("Couldn't write upload tuning to %s", cache_path);
+    }
+    return tuning;
+}
+
+#endif
@@ -0,0 +1,425 @@
+#ifndef APP_HOT_PATH_H
+#define APP_HOT_PATH_H
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "app_log.h"
+#include "app_profiler.h"
+
+// Allocations and system calls the game thread makes inside a frame.
+//
+// A steady frame, from its start to the swap, should neither allocate nor
+// make system calls; when it does, that's where spikes come from.  With
+// HANDMADE_HOT_PATH=1, malloc, calloc, realloc and free, and read, write,
+// open, close, ioctl and nanosleep (and on Android __android_log_print), are
+// replaced by versions defined here that count the call and then make it:
+// the allocations through libc's allocator, the system calls with syscall()
+// directly, so neither seccomp nor ptrace is involved.
+//
+// Only the thread that called hot_path_start is counted, against the frame
+// stage the loop last set, or as between frames.  Calls inside a frame are
+// also kept by where they were called from, so the log can name them.
+//
+// What's seen depends on where the definitions win.  The Linux host is an
+// executable, which comes first in symbol lookup, so it sees every library,
+// the GL driver included.  On Android the platform is a shared library
+// loaded after libc, so a default visibility definition would lose to
+// libc's even for the library's own calls.  There the definitions are
+// protected instead, which binds the library's own calls to them when it's
+// linked: the platform, the glue and the game built into it are seen, the
+// GL driver and the rest of the system aren't.  Either way, calls libc makes
+// to itself (the write behind fprintf, say) aren't seen, though allocations
+// made by libc functions the game thread calls are, attributed to that
+// function.
+
+#ifndef HANDMADE_HOT_PATH
+#define HANDMADE_HOT_PATH 0
+#endif
+
+#define HOT_PATH_MAX_STAGES 8
+#define HOT_PATH_BETWEEN_FRAMES HOT_PATH_MAX_STAGES
+#define HOT_PATH_MAX_SITES 32
+
+enum hot_path_event
+{
+    HOT_PATH_MALLOC,
+    HOT_PATH_CALLOC,
+    HOT_PATH_REALLOC,
+    HOT_PATH_FREE,
+    HOT_PATH_READ,
+    HOT_PATH_WRITE,
+    HOT_PATH_OPEN,
+    HOT_PATH_CLOSE,
+    HOT_PATH_IOCTL,
+    HOT_PATH_NANOSLEEP,
+    HOT_PATH_LOG,
+
+    HOT_PATH_EVENT_COUNT,
+};
+
+global_variable char *hot_path_event_names[HOT_PATH_EVENT_COUNT] = {
+    "malloc", "calloc", "realloc", "free", "read", "write", "open", "close", "ioctl", "nanosleep", "log",
+};
+
+struct hot_path_site
+{
+    uintptr_t address;
+    uint32 event;
+    uint32 stage;
+    uint64 count;
+};
+
+struct hot_path_tracker
+{
+    bool32 tracking;
+    pthread_t thread;
+    uint32 stage;
+    bool32 frame_dirty;
+
+    // Since the last log.  The last row is between frames.
+    uint64 counts[HOT_PATH_MAX_STAGES + 1][HOT_PATH_EVENT_COUNT];
+    uint64 allocated_bytes[HOT_PATH_MAX_STAGES + 1];
+    hot_path_site sites[HOT_PATH_MAX_SITES];
+    uint32 site_count;
+    uint64 dropped_sites;
+    uint64 frames;
+    uint64 dirty_frames;
+
+    uint64 session_frames;
+    uint64 session_dirty_frames;
+};
+
+// The replacements can't be handed a tracker.
+global_variable hot_path_tracker *global_hot_path;
+
+// Called from the replacements, so it mustn't allocate or make system
+// calls itself.
+internal void
+hot_path_note(uint32 event, size_t bytes, void *address)
+{
+    hot_path_tracker *tracker = global_hot_path;
+    if (!tracker || !pthread_equal(pthread_self(), tracker->thread))
+    {
+        return;
+    }
+    uint32 stage = tracker->stage;
+    ++tracker->counts[stage][event];
+    tracker->allocated_bytes[stage] += bytes;
+    if (stage == HOT_PATH_BETWEEN_FRAMES)
+    {
+        return;
+    }
+
+    tracker->frame_dirty = 1;
+    for (uint32 i = 0; i < tracker->site_count; ++i)
+    {
+        hot_path_site *site = &tracker->sites[i];
+        if ((site->address == (uintptr_t)address) && (site->event == event) && (site->stage == stage))
+        {
+            ++site->count;
+            return;
+        }
+    }
+    if (tracker->site_count < HOT_PATH_MAX_SITES)
+    {
+        hot_path_site *site = &tracker->sites[tracker->site_count++];
+        site->address = (uintptr_t)address;
+        site->event = event;
+        site->stage = stage;
+        site->count = 1;
+    }
+    else
+    {
+        ++tracker->dropped_sites;
+    }
+}
+
+// Starts counting the calling thread.  Does nothing unless the replacements
+// were built in.
+internal void
+hot_path_start(hot_path_tracker *tracker)
+{
+    *tracker = {};
+    tracker->thread = pthread_self();
+    tracker->stage = HOT_PATH_BETWEEN_FRAMES;
+#if HANDMADE_HOT_PATH
+    tracker->tracking = 1;
+    __atomic_store_n(&global_hot_path, tracker, __ATOMIC_RELEASE);
+    app_log("Tracking allocations and system calls on the game thread");
+#else
+    app_log("Allocation and system call tracking needs HANDMADE_HOT_PATH=1");
+#endif
+}
+
+// Everything until the next stage, or the end of the frame, counts against
+// stage.  The first stage starts the frame.
+//
+// The compiler takes malloc and free to leave the program's memory alone,
+// so with the replacements in the same library it would otherwise be free
+// to move or drop these stores around them.
+inline void
+hot_path_stage(hot_path_tracker *tracker, uint32 stage)
+{
+    __atomic_store_n(&tracker->stage, (stage < HOT_PATH_MAX_STAGES) ? stage : HOT_PATH_BETWEEN_FRAMES,
+        __ATOMIC_RELAXED);
+}
+
+// Call right after the swap.
+inline void
+hot_path_end_frame(hot_path_tracker *tracker)
+{
+    __atomic_store_n(&tracker->stage, HOT_PATH_BETWEEN_FRAMES, __ATOMIC_RELAXED);
+    ++tracker->frames;
+    ++tracker->session_frames;
+    if (__atomic_load_n(&tracker->frame_dirty, __ATOMIC_RELAXED))
+    {
+        ++tracker->dirty_frames;
+        ++tracker->session_dirty_frames;
+        tracker->frame_dirty = 0;
+    }
+}
+
+internal int
+hot_path_append_counts(char *line, size_t line_size, uint64 *counts, uint64 allocated_bytes)
+{
+    int length = 0;
+    for (uint32 event = 0; event < HOT_PATH_EVENT_COUNT; ++event)
+    {
+        if (counts[event])
+        {
+            length += snprintf(line + length, line_size - length, "%s%llu %s", length ? ", " : "",
+                (unsigned long long)counts[event], hot_path_event_names[event]);
+        }
+    }
+    if (allocated_bytes)
+    {
+        length += snprintf(line + length, line_size - length, " (%llu bytes)", (unsigned long long)allocated_bytes);
+    }
+    return length;
+}
+
+// Logs what happened since the last log, then starts over.  Call between
+// frames; logging allocates.
+internal void
+hot_path_log(hot_path_tracker *tracker, char **stage_names, uint32 stage_count)
+{
+    if (!tracker->tracking || !tracker->frames)
+    {
+        return;
+    }
+
+    app_log("Hot path over %llu frames: %llu allocated or made system calls before the swap (%llu of %llu this session)",
+        (unsigned long long)tracker->frames, (unsigned long long)tracker->dirty_frames,
+        (unsigned long long)tracker->session_dirty_frames, (unsigned long long)tracker->session_frames);
+    for (uint32 stage = 0; stage <= HOT_PATH_MAX_STAGES; ++stage)
+    {
+        char line[512];
+        int length = snprintf(line, sizeof(line), "  %-8s ",
+            (stage == HOT_PATH_BETWEEN_FRAMES) ? "between" : ((stage < stage_count) ? stage_names[stage] : "?"));
+        int counts_length = hot_path_append_counts(line + length, sizeof(line) - length, tracker->counts[stage],
+            tracker->allocated_bytes[stage]);
+        if (counts_length)
+        {
+            app_log("%s", line);
+        }
+    }
+    for (uint32 i = 0; i < tracker->site_count; ++i)
+    {
+        hot_path_site *site = &tracker->sites[i];
+        char name[256];
+        profiler_symbol_name(site->address - 1, name, sizeof(name));
+        app_log("    %llu %s in %s from %s", (unsigned long long)site->count, hot_path_event_names[site->event],
+            (site->stage < stage_count) ? stage_names[site->stage] : "?", name);
+    }
+    if (tracker->dropped_sites)
+    {
+        app_log("    and %llu calls from elsewhere", (unsigned long long)tracker->dropped_sites);
+    }
+
+    memset(tracker->counts, 0, sizeof(tracker->counts));
+    memset(tracker->allocated_bytes, 0, sizeof(tracker->allocated_bytes));
+    tracker->site_count = 0;
+    tracker->dropped_sites = 0;
+    tracker->frames = 0;
+    tracker->dirty_frames = 0;
+}
+
+#if HANDMADE_HOT_PATH
+
+// The replacements are given libc's names with asm labels, so they don't
+// clash with the headers' declarations (exception specifications, fortified
+// inline versions, ioctl's request type).
+
+#ifdef __BIONIC__
+typedef void *hot_path_malloc_function(size_t size);
+typedef void *hot_path_calloc_function(size_t count, size_t size);
+typedef void *hot_path_realloc_function(void *pointer, size_t size);
+typedef void hot_path_free_function(void *pointer);
+
+global_variable hot_path_malloc_function *hot_path_libc_malloc;
+global_variable hot_path_calloc_function *hot_path_libc_calloc;
+global_variable hot_path_realloc_function *hot_path_libc_realloc;
+global_variable hot_path_free_function *hot_path_libc_free;
+
+internal void
+hot_path_find_libc(void)
+{
+    if (!hot_path_libc_free)
+    {
+        hot_path_libc_malloc = (hot_path_malloc_function *)dlsym(RTLD_NEXT, "malloc");
+        hot_path_libc_calloc = (hot_path_calloc_function *)dlsym(RTLD_NEXT, "calloc");
+        hot_path_libc_realloc = (hot_path_realloc_function *)dlsym(RTLD_NEXT, "realloc");
+        hot_path_libc_free = (hot_path_free_function *)dlsym(RTLD_NEXT, "free");
+    }
+}
+
+#define HOT_PATH_LIBC(name) (hot_path_find_libc(), hot_path_libc_##name)
+#else
+// glibc's own entry points; dlsym might allocate.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void __libc_free(void *pointer);
+
+#define HOT_PATH_LIBC(name) __libc_##name
+#endif
+
+#ifdef __ANDROID__
+#define HOT_PATH_EXPORT __attribute__((visibility("protected")))
+#else
+#define HOT_PATH_EXPORT __attribute__((visibility("default")))
+#endif
+
+extern "C" void *hot_path_malloc(size_t size) __asm__("malloc");
+extern "C" void *hot_path_calloc(size_t count, size_t size) __asm__("calloc");
+extern "C" void *hot_path_realloc(void *pointer, size_t size) __asm__("realloc");
+extern "C" void hot_path_free(void *pointer) __asm__("free");
+extern "C" ssize_t hot_path_read(int file, void *buffer, size_t size) __asm__("read");
+extern "C" ssize_t hot_path_write(int file, const void *buffer, size_t size) __asm__("write");
+extern "C" int hot_path_open(const char *path, int flags, ...) __asm__("open");
+extern "C" int hot_path_close(int file) __asm__("close");
+#ifdef __BIONIC__
+extern "C" int hot_path_ioctl(int file, int request, ...) __asm__("ioctl");
+#else
+extern "C" int hot_path_ioctl(int file, unsigned long request, ...) __asm__("ioctl");
+#endif
+extern "C" int hot_path_nanosleep(const timespec *duration, timespec *remaining) __asm__("nanosleep");
+
+extern "C" HOT_PATH_EXPORT void *
+hot_path_malloc(size_t size)
+{
+    hot_path_note(HOT_PATH_MALLOC, size, __builtin_return_address(0));
+    return HOT_PATH_LIBC(malloc)(size);
+}
+
+extern "C" HOT_PATH_EXPORT void *
+hot_path_calloc(size_t count, size_t size)
+{
+    hot_path_note(HOT_PATH_CALLOC, count * size, __builtin_return_address(0));
+    return HOT_PATH_LIBC(calloc)(count, size);
+}
+
+extern "C" HOT_PATH_EXPORT void *
+hot_path_realloc(void *pointer, size_t size)
+{
+    hot_path_note(HOT_PATH_REALLOC, size, __builtin_return_address(0));
+    return HOT_PATH_LIBC(realloc)(pointer, size);
+}
+
+extern "C" HOT_PATH_EXPORT void
+hot_path_free(void *pointer)
+{
+    if (pointer)
+    {
+        hot_path_note(HOT_PATH_FREE, 0, __builtin_return_address(0));
+    }
+    HOT_PATH_LIBC(free)(pointer);
+}
+
+extern "C" HOT_PATH_EXPORT ssize_t
+hot_path_read(int file, void *buffer, size_t size)
+{
+    hot_path_note(HOT_PATH_READ, 0, __builtin_return_address(0));
+    return (ssize_t)syscall(SYS_read, file, buffer, size);
+}
+
+extern "C" HOT_PATH_EXPORT ssize_t
+hot_path_write(int file, const void *buffer, size_t size)
+{
+    hot_path_note(HOT_PATH_WRITE, 0, __builtin_return_address(0));
+    return (ssize_t)syscall(SYS_write, file, buffer, size);
+}
+
+extern "C" HOT_PATH_EXPORT int
+hot_path_open(const char *path, int flags, ...)
+{
+    hot_path_note(HOT_PATH_OPEN, 0, __builtin_return_address(0));
+    int mode = 0;
+    if (flags & O_CREAT)
+    {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = va_arg(arguments, int);
+        va_end(arguments);
+    }
+    // arm64 only has openat.
+    return (int)syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+extern "C" HOT_PATH_EXPORT int
+hot_path_close(int file)
+{
+    hot_path_note(HOT_PATH_CLOSE, 0, __builtin_return_address(0));
+    return (int)syscall(SYS_close, file);
+}
+
+#ifdef __BIONIC__
+extern "C" HOT_PATH_EXPORT int
+hot_path_ioctl(int file, int request, ...)
+#else
+extern "C" HOT_PATH_EXPORT int
+hot_path_ioctl(int file, unsigned long request, ...)
+#endif
+{
+    hot_path_note(HOT_PATH_IOCTL, 0, __builtin_return_address(0));
+    va_list arguments;
+    va_start(arguments, request);
+    void *argument = va_arg(arguments, void *);
+    va_end(arguments);
+    return (int)syscall(SYS_ioctl, file, request, argument);
+}
+
+extern "C" HOT_PATH_EXPORT int
+hot_path_nanosleep(const timespec *duration, timespec *remaining)
+{
+    hot_path_note(HOT_PATH_NANOSLEEP, 0, __builtin_return_address(0));
+    return (int)syscall(SYS_nanosleep, duration, remaining);
+}
+
+#ifdef __ANDROID__
+extern "C" int hot_path_android_log_print(int priority, const char *tag, const char *format, ...)
+    __asm__("__android_log_print");
+
+extern "C" HOT_PATH_EXPORT int
+hot_path_android_log_print(int priority, const char *tag, const char *format, ...)
+{
+    hot_path_note(HOT_PATH_LOG, 0, __builtin_return_address(0));
+    va_list arguments;
+    va_start(arguments, format);
+    int result = __android_log_vprint(priority, tag, format, arguments);
+    va_end(arguments);
+    return result;
+}
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef APP_INPUT_H
+#define APP_INPUT_H
+
+// Translation of platform input into game_input, shared by the Android and
+// Linux host platform layers.  Keycodes are Android's.
+
+internal void
+process_keyboard_message(game_button_state *new_state, bool32 is_down)
+{
+    if (new_state->EndedDown != is_down)
+    {
+        new_state->EndedDown = is_down;
+        ++new_state->HalfTransitionCount;
+    }
+}
+
+internal void
+process_button(bool down, game_button_state *old_state, game_button_state *new_state)
+{
+    new_state->EndedDown = down;
+    new_state->HalfTransitionCount = (old_state->EndedDown != new_state->EndedDown) ? 1 : 0;
+}
+
+// Starts the frame's keyboard controller: keys held last frame stay held,
+// transition counts start from zero.
+internal void
+begin_keyboard_controller(game_input *new_input, game_input *old_input)
+{
+    game_controller_input *old_keyboard_controller = GetController(old_input, 0);
+    game_controller_input *new_keyboard_controller = GetController(new_input, 0);
+    *new_keyboard_controller = {};
+    new_keyboard_controller->IsConnected = true;
+    for (
+            uint button_index = 0;
+            button_index < ArrayCount(new_keyboard_controller->Buttons);
+            ++button_index)
+    {
+        new_keyboard_controller->Buttons[button_index].EndedDown =
+            old_keyboard_controller->Buttons[button_index].EndedDown;
+    }
+}
+
+// For when key releases may have been missed, as they are while the game
+// isn't running.
+internal void
+release_keyboard_controller(game_input *input)
+{
+    game_controller_input *keyboard_controller = GetController(input, 0);
+    for (
+            uint button_index = 0;
+            button_index < ArrayCount(keyboard_controller->Buttons);
+            ++button_index)
+    {
+        keyboard_controller->Buttons[button_index].EndedDown = 0;
+    }
+}
+
+// Returns 0 for keys the game doesn't use.
+internal bool32
+process_game_key(game_input *input, int keycode, bool32 is_down)
+{
+    game_controller_input *new_keyboard_controller = GetController(input, 0);
+
+    if ((keycode == 51) || (keycode == 19))
+    {
+        process_keyboard_message(&new_keyboard_controller->MoveUp, is_down);
+    }
+    else if ((keycode == 29) || (keycode == 21))
+    {
+        process_keyboard_message(&new_keyboard_controller->MoveLeft, is_down);
+    }
+    else if ((keycode == 47) || (keycode == 20))
+    {
+        process_keyboard_message(&new_keyboard_controller->MoveDown, is_down);
+    }
+    else if ((keycode == 32) || (keycode == 22))
+    {
+        process_keyboard_message(&new_keyboard_controller->MoveRight, is_down);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+// The touch pan stick drives controller 1's movement buttons.
+internal void
+process_stick_buttons(real32 stick_x, real32 stick_y, game_input *new_input, game_input *old_input)
+{
+    game_controller_input *old_controller = GetController(old_input, 1);
+    game_controller_input *new_controller = GetController(new_input, 1);
+
+    process_button((stick_x > 0), &old_controller->MoveRight, &new_controller->MoveRight);
+    process_button((stick_x < 0), &old_controller->MoveLeft, &new_controller->MoveLeft);
+    process_button((stick_y > 0), &old_controller->MoveUp, &new_controller->MoveUp);
+    process_button((stick_y < 0), &old_controller->MoveDown, &new_controller->MoveDown);
+}
+
+#endif
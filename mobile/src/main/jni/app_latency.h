@@ -0,0 +1,275 @@
+#ifndef APP_LATENCY_H
+#define APP_LATENCY_H
+
+#include <pthread.h>
+
+#include "app_time.h"
+
+// Input-to-photon latency probe.
+//
+// Every input event consumed by a frame is noted with its AInputEvent
+// timestamp.  Once that frame's eglSwapBuffers returns, the gap between the
+// oldest consumed event and the end of the swap is recorded, which is the
+// worst case latency a user could have seen for that frame.
+
+#define LATENCY_HISTORY_COUNT 128
+
+struct latency_probe
+{
+    int64_t frame_oldest_event_ns;
+    int64_t frame_newest_event_ns;
+    uint32 frame_event_count;
+
+    int64_t history[LATENCY_HISTORY_COUNT];
+    uint32 history_count;
+    uint32 history_next;
+
+    uint64_t total_events;
+    uint64_t total_frames_with_input;
+};
+
+struct latency_summary
+{
+    uint32 sample_count;
+    int64_t min_ns;
+    int64_t p50_ns;
+    int64_t p95_ns;
+    int64_t max_ns;
+};
+
+internal void
+latency_note_input(latency_probe *probe, int64_t event_ns)
+{
+    if ((probe->frame_event_count == 0) || (event_ns < probe->frame_oldest_event_ns))
+    {
+        probe->frame_oldest_event_ns = event_ns;
+    }
+    if ((probe->frame_event_count == 0) || (event_ns > probe->frame_newest_event_ns))
+    {
+        probe->frame_newest_event_ns = event_ns;
+    }
+    ++probe->frame_event_count;
+    ++probe->total_events;
+}
+
+// Call once per frame after the swap (or after the frame was dropped, with
+// presented = 0).  Input consumed by a frame that never reached the screen
+// is not counted, as there is no photon to measure against.
+internal void
+latency_end_frame(latency_probe *probe, bool32 presented, int64_t present_ns)
+{
+    if (presented && probe->frame_event_count)
+    {
+        probe->history[probe->history_next] = present_ns - probe->frame_oldest_event_ns;
+        probe->history_next = (probe->history_next + 1) % LATENCY_HISTORY_COUNT;
+        if (probe->history_count < LATENCY_HISTORY_COUNT)
+        {
+            ++probe->history_count;
+        }
+        ++probe->total_frames_with_input;
+    }
+    probe->frame_event_count = 0;
+}
+
+internal latency_summary
+latency_summarize(latency_probe *probe)
+{
+    latency_summary result = {};
+    result.sample_count = probe->history_count;
+    if (!result.sample_count)
+    {
+        return result;
+    }
+
+    int64_t sorted[LATENCY_HISTORY_COUNT];
+    for (uint32 i = 0; i < probe->history_count; ++i)
+    {
+        int64_t value = probe->history[i];
+        uint32 j = i;
+        for (; (j > 0) && (sorted[j - 1] > value); --j)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    result.min_ns = sorted[0];
+    result.p50_ns = sorted[(result.sample_count - 1) / 2];
+    result.p95_ns = sorted[((result.sample_count - 1) * 95) / 100];
+    result.max_ns = sorted[result.sample_count - 1];
+    return result;
+}
+
+// Late input latching.
+//
+// Normally the frame loop samples input, simulates, presents and then sleeps
+// off the rest of the frame, so input arriving during the sleep waits for the
+// whole sleep before it is seen.  With late latching the sleep moves to the
+// front of the frame: we wait until the frame deadline minus the predicted
+// cost of simulate+present, and only then sample input.
+//
+// Only with manual pacing.  When the swap blocks until vblank the latch's
+// sleep would come on top of that wait, to a deadline that knows nothing of
+// the vblank, so the platforms turn it off in the vsync modes.
+
+#define LATE_LATCH_WINDOW 32
+
+struct late_latch_state
+{
+    bool32 enabled;
+    int64_t frame_ns;
+    int64_t margin_ns;
+    int64_t next_deadline_ns;
+
+    int64_t work_ns[LATE_LATCH_WINDOW];
+    uint32 work_next;
+};
+
+internal int64_t
+late_latch_predicted_work(late_latch_state *latch)
+{
+    // The slowest recent frame, rather than an average, so that one heavy
+    // frame doesn't immediately blow the deadline on the next one.
+    int64_t result = 0;
+    for (uint32 i = 0; i < LATE_LATCH_WINDOW; ++i)
+    {
+        if (latch->work_ns[i] > result)
+        {
+            result = latch->work_ns[i];
+        }
+    }
+    return result + latch->margin_ns;
+}
+
+internal void
+late_latch_wait(late_latch_state *latch)
+{
+    int64_t now = monotonic_nanoseconds();
+    if (!latch->next_deadline_ns)
+    {
+        latch->next_deadline_ns = now + latch->frame_ns;
+    }
+    int64_t latch_at = latch->next_deadline_ns - late_latch_predicted_work(latch);
+    if (latch_at > now)
+    {
+        sleep_until_nanoseconds(latch_at);
+    }
+}
+
+// After a gap, so the first deadline is a frame from now.
+internal void
+late_latch_restart(late_latch_state *latch)
+{
+    latch->next_deadline_ns = 0;
+}
+
+internal void
+late_latch_end_frame(late_latch_state *latch, int64_t work_ns)
+{
+    latch->work_ns[latch->work_next] = work_ns;
+    latch->work_next = (latch->work_next + 1) % LATE_LATCH_WINDOW;
+
+    latch->next_deadline_ns += latch->frame_ns;
+    int64_t now = monotonic_nanoseconds();
+    if (latch->next_deadline_ns < now)
+    {
+        // Missed; don't try to catch up with a burst of short frames.
+        latch->next_deadline_ns = now + latch->frame_ns;
+    }
+}
+
+// Synthetic input injector.
+//
+// A thread that produces timestamped key presses at random intervals, so the
+// latency probe and late latching can be exercised without a touchscreen or
+// keyboard, including on a Linux host where there is no AInputQueue.  Events
+// are handed over through a single-producer single-consumer ring.
+
+#define SYNTHETIC_INPUT_RING_SIZE 64
+
+struct synthetic_input_event
+{
+    int32 keycode;
+    bool32 is_down;
+    int64_t event_ns;
+};
+
+struct synthetic_input_injector
+{
+    pthread_t thread;
+    volatile bool32 running;
+
+    int32 keycode;
+    int64_t min_interval_ns;
+    int64_t max_interval_ns;
+    uint32 random_state;
+
+    synthetic_input_event events[SYNTHETIC_INPUT_RING_SIZE];
+    uint32 write_index;
+    uint32 read_index;
+};
+
+internal void *
+synthetic_input_thread(void *param)
+{
+    synthetic_input_injector *injector = (synthetic_input_injector *)param;
+    bool32 is_down = 0;
+    while (injector->running)
+    {
+        injector->random_state = injector->random_state * 1664525 + 1013904223;
+        int64_t range = injector->max_interval_ns - injector->min_interval_ns;
+        int64_t interval = injector->min_interval_ns +
+            (range ? (int64_t)(injector->random_state >> 8) % range : 0);
+        sleep_until_nanoseconds(monotonic_nanoseconds() + interval);
+
+        is_down = !is_down;
+        uint32 write_index = injector->write_index;
+        uint32 read_index = __atomic_load_n(&injector->read_index, __ATOMIC_ACQUIRE);
+        if (write_index - read_index < SYNTHETIC_INPUT_RING_SIZE)
+        {
+            synthetic_input_event *event = &injector->events[write_index % SYNTHETIC_INPUT_RING_SIZE];
+            event->keycode = injector->keycode;
+            event->is_down = is_down;
+            event->event_ns = monotonic_nanoseconds();
+            __atomic_store_n(&injector->write_index, write_index + 1, __ATOMIC_RELEASE);
+        }
+    }
+    return 0;
+}
+
+internal void
+synthetic_input_start(synthetic_input_injector *injector, int32 keycode,
+    int64_t min_interval_ns, int64_t max_interval_ns)
+{
+    injector->keycode = keycode;
+    injector->min_interval_ns = min_interval_ns;
+    injector->max_interval_ns = max_interval_ns;
+    injector->random_state = (uint32)monotonic_nanoseconds();
+    injector->running = 1;
+    pthread_create(&injector->thread, 0, synthetic_input_thread, injector);
+}
+
+internal void
+synthetic_input_stop(synthetic_input_injector *injector)
+{
+    injector->running = 0;
+    pthread_join(injector->thread, 0);
+}
+
+// Returns 1 and fills in event if one was waiting.  Only call from the
+// thread that runs the frame loop.
+internal bool32
+synthetic_input_next(synthetic_input_injector *injector, synthetic_input_event *event)
+{
+    uint32 read_index = injector->read_index;
+    uint32 write_index = __atomic_load_n(&injector->write_index, __ATOMIC_ACQUIRE);
+    if (read_index == write_index)
+    {
+        return 0;
+    }
+    *event = injector->events[read_index % SYNTHETIC_INPUT_RING_SIZE];
+    __atomic_store_n(&injector->read_index, read_index + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef APP_LIFECYCLE_H
+#define APP_LIFECYCLE_H
+
+#include "android_native_app_glue.h"
+
+#include "app_time.h"
+
+// Whether the game should be running at all.
+//
+// It only makes sense to simulate while the activity is resumed, has a
+// window to draw into and has focus.  The rest of the time the frame loop
+// blocks in the looper until a command changes that, instead of updating
+// the game at 30 Hz for nobody and polling with a zero timeout.
+
+struct lifecycle_state
+{
+    bool32 resumed;
+    bool32 has_window;
+    bool32 focused;
+
+    uint32 suspend_count;
+    int64_t suspended_ns;
+};
+
+// Call for every command from the glue.
+internal void
+lifecycle_on_cmd(lifecycle_state *lifecycle, int32_t cmd)
+{
+    if ((cmd == APP_CMD_RESUME) || (cmd == APP_CMD_PAUSE))
+    {
+        lifecycle->resumed = (cmd == APP_CMD_RESUME);
+    }
+    if ((cmd == APP_CMD_INIT_WINDOW) || (cmd == APP_CMD_TERM_WINDOW))
+    {
+        lifecycle->has_window = (cmd == APP_CMD_INIT_WINDOW);
+    }
+    if ((cmd == APP_CMD_GAINED_FOCUS) || (cmd == APP_CMD_LOST_FOCUS))
+    {
+        lifecycle->focused = (cmd == APP_CMD_GAINED_FOCUS);
+    }
+}
+
+inline bool32
+lifecycle_running(lifecycle_state *lifecycle)
+{
+    return lifecycle->resumed && lifecycle->has_window && lifecycle->focused;
+}
+
+struct lifecycle_suspension
+{
+    int64_t wall_ns;
+    int64_t cpu_ns;
+};
+
+// Processes the glue's commands and input, sleeping in between, until
+// there's a reason to run again.  Reports how long that took and how much
+// CPU the whole process used meanwhile.
+internal lifecycle_suspension
+lifecycle_wait_until_running(lifecycle_state *lifecycle, android_app *app)
+{
+    int64_t start_ns = monotonic_nanoseconds();
+    int64_t start_cpu_ns = get_nanoseconds(CLOCK_PROCESS_CPUTIME_ID);
+
+    while (!lifecycle_running(lifecycle))
+    {
+        int events;
+        android_poll_source *source;
+        if ((ALooper_pollAll(-1, 0, &events, (void **)&source) >= 0) && source)
+        {
+            source->process(app, source);
+        }
+    }
+
+    lifecycle_suspension result;
+    result.wall_ns = monotonic_nanoseconds() - start_ns;
+    result.cpu_ns = get_nanoseconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu_ns;
+    ++lifecycle->suspend_count;
+    lifecycle->suspended_ns += result.wall_ns;
+    return result;
+}
+
+#endif
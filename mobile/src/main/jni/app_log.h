@@ -0,0 +1,15 @@
+#ifndef APP_LOG_H
+#define APP_LOG_H
+
+// Logging for code shared between the Android and Linux host platform
+// layers.  Android-only code keeps calling __android_log_print directly.
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define app_log(...) ((void)__android_log_print(ANDROID_LOG_INFO, "org.nxsy.ndk_handmade", __VA_ARGS__))
+#else
+#include <stdio.h>
+#define app_log(...) ((void)fprintf(stderr, __VA_ARGS__), (void)fputc('\n', stderr))
+#endif
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef APP_MEMORY_H
+#define APP_MEMORY_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "app_log.h"
+
+// Platform memory, carved out of one reservation made at startup.
+//
+//   permanent  buffers that live as long as the process, such as the
+//              game's offscreen buffer; never freed
+//   scratch    anything that only has to last the frame; reset at the
+//              start of every frame
+//   pools      fixed size blocks, one pool per power of two from 4 KB to
+//              8 MB, for file contents and other buffers that come and go
+//
+// The reservation is anonymous and lazily committed, so only the pages
+// actually handed out cost anything.  Pool blocks are page aligned, and
+// so is anything pushed with MEMORY_PAGE alignment; pixel buffers want at
+// least MEMORY_CACHE_LINE.  Requests bigger than the largest pool, or for
+// a pool that's run out, fall back to malloc and are counted, so the sizes
+// below can be tuned from the peak counters.
+//
+// Code that only needs memory for the length of a call can also take it from
+// an arena between begin_temporary_memory and end_temporary_memory, which
+// hands it all back.
+//
+// With poisoning on, scratch is filled with MEMORY_POISON when it's reset
+// and pool blocks when they're freed.  A pool block that comes back with
+// its poison disturbed was written after it was freed, which is logged.
+
+#define MEMORY_CACHE_LINE 64
+#define MEMORY_PAGE 4096
+#define MEMORY_POISON 0xdd
+
+#define MEMORY_POOL_MIN_SHIFT 12
+#define MEMORY_POOL_COUNT 12
+
+// Blocks per pool, smallest first.  Address space is cheap; this is about
+// 47 MB of it.
+global_variable uint32 memory_pool_block_counts[MEMORY_POOL_COUNT] = {
+    64, 64, 32, 32, 16, 16, 8, 8, 4, 4, 2, 2,
+};
+
+struct memory_arena
+{
+    char *name;
+    uint8 *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+    uint32 failures;
+};
+
+struct temporary_memory
+{
+    memory_arena *arena;
+    size_t used;
+};
+
+struct memory_pool
+{
+    size_t block_size;
+    uint32 block_count;
+    uint8 *base;
+    // Blocks past next_unused have never been handed out, so they don't
+    // have to be threaded onto the free list (and touched) up front.
+    void *free_list;
+    uint32 next_unused;
+    uint32 in_use;
+    uint32 peak_in_use;
+};
+
+struct platform_memory
+{
+    uint8 *base;
+    size_t reserved;
+    bool32 poison;
+
+    memory_arena permanent;
+    memory_arena scratch;
+    memory_pool pools[MEMORY_POOL_COUNT];
+
+    uint32 fallback_allocations;
+    uint32 poison_errors;
+};
+
+inline size_t
+memory_align(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// Contents are whatever was there last: zero the first time, poison after a
+// reset with poisoning on.  alignment must be a power of two.  Returns 0 if
+// the arena is full.
+internal void *
+arena_push(memory_arena *arena, size_t size, size_t alignment)
+{
+    size_t start = memory_align((uintptr_t)arena->base + arena->used, alignment) - (uintptr_t)arena->base;
+    if ((start > arena->size) || (size > arena->size - start))
+    {
+        ++arena->failures;
+        app_log("Memory arena %s is out of space for %zu bytes (%zu of %zu used)", arena->name, size,
+            arena->used, arena->size);
+        return 0;
+    }
+    arena->used = start + size;
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+    return arena->base + start;
+}
+
+internal void
+arena_init(memory_arena *arena, char *name, void *base, size_t size)
+{
+    *arena = {};
+    arena->name = name;
+    arena->base = (uint8 *)base;
+    arena->size = size;
+}
+
+inline temporary_memory
+begin_temporary_memory(memory_arena *arena)
+{
+    temporary_memory result;
+    result.arena = arena;
+    result.used = arena->used;
+    return result;
+}
+
+inline void
+end_temporary_memory(temporary_memory temporary)
+{
+    Assert(temporary.arena->used >= temporary.used);
+    temporary.arena->used = temporary.used;
+}
+
+internal void
+arena_reset(memory_arena *arena, bool32 poison)
+{
+    if (poison)
+    {
+        memset(arena->base, MEMORY_POISON, arena->used);
+    }
+    arena->used = 0;
+}
+
+internal bool32
+platform_memory_init(platform_memory *memory, size_t permanent_size, size_t scratch_size, bool32 poison)
+{
+    *memory = {};
+    memory->poison = poison;
+    permanent_size = memory_align(permanent_size, MEMORY_PAGE);
+    scratch_size = memory_align(scratch_size, MEMORY_PAGE);
+
+    size_t reserved = permanent_size + scratch_size;
+    for (uint32 pool_index = 0; pool_index < MEMORY_POOL_COUNT; ++pool_index)
+    {
+        size_t block_size = (size_t)1 << (MEMORY_POOL_MIN_SHIFT + pool_index);
+        reserved += block_size * memory_pool_block_counts[pool_index];
+    }
+
+    void *base = mmap(0, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        app_log("Couldn't reserve %zu bytes of platform memory", reserved);
+        return 0;
+    }
+    memory->base = (uint8 *)base;
+    memory->reserved = reserved;
+
+    uint8 *next = memory->base;
+    arena_init(&memory->permanent, (char *)"permanent", next, permanent_size);
+    next += permanent_size;
+
+    arena_init(&memory->scratch, (char *)"scratch", next, scratch_size);
+    next += scratch_size;
+
+    for (uint32 pool_index = 0; pool_index < MEMORY_POOL_COUNT; ++pool_index)
+    {
+        memory_pool *pool = &memory->pools[pool_index];
+        pool->block_size = (size_t)1 << (MEMORY_POOL_MIN_SHIFT + pool_index);
+        pool->block_count = memory_pool_block_counts[pool_index];
+        pool->base = next;
+        next += pool->block_size * pool->block_count;
+    }
+    return 1;
+}
+
+// Call at the start of every frame.
+inline void
+platform_memory_begin_frame(platform_memory *memory)
+{
+    arena_reset(&memory->scratch, memory->poison);
+}
+
+inline void *
+memory_push_permanent(platform_memory *memory, size_t size, size_t alignment)
+{
+    return arena_push(&memory->permanent, size, alignment);
+}
+
+inline void *
+memory_push_scratch(platform_memory *memory, size_t size, size_t alignment)
+{
+    return arena_push(&memory->scratch, size, alignment);
+}
+
+internal void
+memory_check_poison(platform_memory *memory, memory_pool *pool, uint8 *block)
+{
+    for (size_t i = sizeof(void *); i < pool->block_size; ++i)
+    {
+        if (block[i] != MEMORY_POISON)
+        {
+            ++memory->poison_errors;
+            app_log("Pool block %p (%zu bytes) was written at offset %zu after it was freed", block,
+                pool->block_size, i);
+            break;
+        }
+    }
+}
+
+// A block of at least size bytes, page aligned if it came from a pool.
+// Release it with memory_free.
+internal void *
+memory_allocate(platform_memory *memory, size_t size)
+{
+    for (uint32 pool_index = 0; pool_index < MEMORY_POOL_COUNT; ++pool_index)
+    {
+        memory_pool *pool = &memory->pools[pool_index];
+        if (pool->block_size < size)
+        {
+            continue;
+        }
+
+        uint8 *block = 0;
+        if (pool->free_list)
+        {
+            block = (uint8 *)pool->free_list;
+            pool->free_list = *(void **)block;
+            if (memory->poison)
+            {
+                memory_check_poison(memory, pool, block);
+            }
+        }
+        else if (pool->next_unused < pool->block_count)
+        {
+            block = pool->base + pool->block_size * pool->next_unused++;
+        }
+        else
+        {
+            // Try a bigger one before giving up on the pools.
+            continue;
+        }
+
+        ++pool->in_use;
+        if (pool->in_use > pool->peak_in_use)
+        {
+            pool->peak_in_use = pool->in_use;
+        }
+        return block;
+    }
+
+    ++memory->fallback_allocations;
+    return malloc(size);
+}
+
+internal void
+memory_free(platform_memory *memory, void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    uint8 *block = (uint8 *)pointer;
+    for (uint32 pool_index = 0; pool_index < MEMORY_POOL_COUNT; ++pool_index)
+    {
+        memory_pool *pool = &memory->pools[pool_index];
+        if ((block >= pool->base) && (block < pool->base + pool->block_size * pool->block_count))
+        {
+            if (memory->poison)
+            {
+                memset(block, MEMORY_POISON, pool->block_size);
+            }
+            *(void **)block = pool->free_list;
+            pool->free_list = block;
+            --pool->in_use;
+            return;
+        }
+    }
+    free(pointer);
+}
+
+internal void
+platform_memory_log(platform_memory *memory)
+{
+    app_log("Platform memory: permanent %zu/%zu KB, scratch peak %zu/%zu KB, %u malloc fallbacks, %u poison errors",
+        memory->permanent.peak / 1024, memory->permanent.size / 1024,
+        memory->scratch.peak / 1024, memory->scratch.size / 1024,
+        memory->fallback_allocations, memory->poison_errors);
+    for (uint32 pool_index = 0; pool_index < MEMORY_POOL_COUNT; ++pool_index)
+    {
+        memory_pool *pool = &memory->pools[pool_index];
+        if (pool->peak_in_use)
+        {
+            app_log("  pool %zu KB: %u in use, peak %u of %u", pool->block_size / 1024, pool->in_use,
+                pool->peak_in_use, pool->block_count);
+        }
+    }
+}
+
+#endif
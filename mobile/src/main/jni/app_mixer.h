@@ -0,0 +1,607 @@
+#ifndef APP_MIXER_H
+#define APP_MIXER_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIXER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MIXER_SSE2 1
+#endif
+
+#include "app_memory.h"
+#include "app_time.h"
+
+// Platform audio mixer.
+//
+// Each stream delivers interleaved stereo 16-bit samples at its own rate.
+// They are converted to planar float, run through a polyphase resampler to
+// the device rate, scaled by the stream volume and summed, and the sum is
+// clamped back down to interleaved stereo 16-bit for the output ring.
+//
+// Every kernel has a scalar reference version next to its NEON or SSE2
+// version.  The reference is what the SIMD paths are checked against, and
+// can be selected at runtime with mixer.reference.
+
+#define MIXER_TAPS 16
+#define MIXER_MAX_PHASES 1024
+#define MIXER_MAX_STREAMS 4
+
+struct mixer_resampler
+{
+    uint32 up;
+    uint32 down;
+    uint32 phase; // 0..up-1, position between input frames in 1/up units
+    float *coefficients; // up * MIXER_TAPS
+
+    // MIXER_TAPS - 1 frames of history, then pending frames that were
+    // supplied but not yet consumed, then the current input.
+    float *work_l;
+    float *work_r;
+    uint32 pending;
+};
+
+struct mixer_stream
+{
+    mixer_resampler resampler;
+    float volume;
+
+    int16 *input;
+    uint32 input_capacity_frames;
+};
+
+struct audio_mixer
+{
+    bool32 reference;
+    uint32 output_samples_per_second;
+    uint32 max_output_frames;
+
+    float *accumulate_l;
+    float *accumulate_r;
+    float *stream_l;
+    float *stream_r;
+    uint32 frame_count;
+
+    mixer_stream streams[MIXER_MAX_STREAMS];
+    uint32 stream_count;
+};
+
+//
+// Kernels
+//
+
+internal void
+mixer_deinterleave_scalar(int16 *in, uint32 frame_count, float *l, float *r)
+{
+    float scale = 1.0f / 32768.0f;
+    for (uint32 i = 0; i < frame_count; ++i)
+    {
+        l[i] = in[2 * i + 0] * scale;
+        r[i] = in[2 * i + 1] * scale;
+    }
+}
+
+internal void
+mixer_accumulate_scalar(float *accumulate, float *source, uint32 count, float volume)
+{
+    for (uint32 i = 0; i < count; ++i)
+    {
+        accumulate[i] += source[i] * volume;
+    }
+}
+
+inline float
+mixer_dot_scalar(float *a, float *b)
+{
+    float result = 0.0f;
+    for (uint32 i = 0; i < MIXER_TAPS; ++i)
+    {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+inline int16
+mixer_float_to_s16(float value)
+{
+    value *= 32768.0f;
+    if (value > 32767.0f)
+    {
+        value = 32767.0f;
+    }
+    if (value < -32768.0f)
+    {
+        value = -32768.0f;
+    }
+    return (int16)(value + ((value >= 0.0f) ? 0.5f : -0.5f));
+}
+
+internal void
+mixer_interleave_scalar(float *l, float *r, uint32 frame_count, int16 *out)
+{
+    for (uint32 i = 0; i < frame_count; ++i)
+    {
+        out[2 * i + 0] = mixer_float_to_s16(l[i]);
+        out[2 * i + 1] = mixer_float_to_s16(r[i]);
+    }
+}
+
+#if MIXER_NEON
+
+internal void
+mixer_deinterleave_simd(int16 *in, uint32 frame_count, float *l, float *r)
+{
+    float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+    uint32 i = 0;
+    for (; i + 4 <= frame_count; i += 4)
+    {
+        int16x4x2_t lr = vld2_s16(in + 2 * i);
+        vst1q_f32(l + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(lr.val[0])), scale));
+        vst1q_f32(r + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(lr.val[1])), scale));
+    }
+    mixer_deinterleave_scalar(in + 2 * i, frame_count - i, l + i, r + i);
+}
+
+internal void
+mixer_accumulate_simd(float *accumulate, float *source, uint32 count, float volume)
+{
+    float32x4_t v = vdupq_n_f32(volume);
+    uint32 i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_f32(accumulate + i, vmlaq_f32(vld1q_f32(accumulate + i), vld1q_f32(source + i), v));
+    }
+    mixer_accumulate_scalar(accumulate + i, source + i, count - i, volume);
+}
+
+inline float
+mixer_dot_simd(float *a, float *b)
+{
+    float32x4_t sum = vmulq_f32(vld1q_f32(a), vld1q_f32(b));
+    for (uint32 i = 4; i < MIXER_TAPS; i += 4)
+    {
+        sum = vmlaq_f32(sum, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    return vget_lane_f32(vpadd_f32(half, half), 0);
+}
+
+internal void
+mixer_interleave_simd(float *l, float *r, uint32 frame_count, int16 *out)
+{
+    float32x4_t scale = vdupq_n_f32(32768.0f);
+    float32x4_t high = vdupq_n_f32(32767.0f);
+    float32x4_t low = vdupq_n_f32(-32768.0f);
+    float32x4_t half = vdupq_n_f32(0.5f);
+    uint32x4_t sign_mask = vdupq_n_u32(0x80000000);
+    uint32 i = 0;
+    for (; i + 4 <= frame_count; i += 4)
+    {
+        float32x4_t fl = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(l + i), scale), high), low);
+        float32x4_t fr = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(r + i), scale), high), low);
+        // Round half away from zero, to match the scalar version.
+        float32x4_t rl = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(half),
+            vandq_u32(vreinterpretq_u32_f32(fl), sign_mask)));
+        float32x4_t rr = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(half),
+            vandq_u32(vreinterpretq_u32_f32(fr), sign_mask)));
+        int16x4x2_t lr;
+        lr.val[0] = vqmovn_s32(vcvtq_s32_f32(vaddq_f32(fl, rl)));
+        lr.val[1] = vqmovn_s32(vcvtq_s32_f32(vaddq_f32(fr, rr)));
+        vst2_s16(out + 2 * i, lr);
+    }
+    mixer_interleave_scalar(l + i, r + i, frame_count - i, out + 2 * i);
+}
+
+#elif MIXER_SSE2
+
+internal void
+mixer_deinterleave_simd(int16 *in, uint32 frame_count, float *l, float *r)
+{
+    __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    uint32 i = 0;
+    for (; i + 4 <= frame_count; i += 4)
+    {
+        // L R L R L R L R -> sign extended 32-bit L and R lanes.
+        __m128i lr = _mm_loadu_si128((__m128i *)(in + 2 * i));
+        __m128i left = _mm_srai_epi32(_mm_slli_epi32(lr, 16), 16);
+        __m128i right = _mm_srai_epi32(lr, 16);
+        _mm_storeu_ps(l + i, _mm_mul_ps(_mm_cvtepi32_ps(left), scale));
+        _mm_storeu_ps(r + i, _mm_mul_ps(_mm_cvtepi32_ps(right), scale));
+    }
+    mixer_deinterleave_scalar(in + 2 * i, frame_count - i, l + i, r + i);
+}
+
+internal void
+mixer_accumulate_simd(float *accumulate, float *source, uint32 count, float volume)
+{
+    __m128 v = _mm_set1_ps(volume);
+    uint32 i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(accumulate + i), _mm_mul_ps(_mm_loadu_ps(source + i), v));
+        _mm_storeu_ps(accumulate + i, sum);
+    }
+    mixer_accumulate_scalar(accumulate + i, source + i, count - i, volume);
+}
+
+inline float
+mixer_dot_simd(float *a, float *b)
+{
+    __m128 sum = _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    for (uint32 i = 4; i < MIXER_TAPS; i += 4)
+    {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+internal void
+mixer_interleave_simd(float *l, float *r, uint32 frame_count, int16 *out)
+{
+    __m128 scale = _mm_set1_ps(32768.0f);
+    __m128 high = _mm_set1_ps(32767.0f);
+    __m128 low = _mm_set1_ps(-32768.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 sign_mask = _mm_set1_ps(-0.0f);
+    uint32 i = 0;
+    for (; i + 4 <= frame_count; i += 4)
+    {
+        __m128 fl = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(l + i), scale), high), low);
+        __m128 fr = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(r + i), scale), high), low);
+        // Round half away from zero, to match the scalar version.
+        fl = _mm_add_ps(fl, _mm_or_ps(half, _mm_and_ps(fl, sign_mask)));
+        fr = _mm_add_ps(fr, _mm_or_ps(half, _mm_and_ps(fr, sign_mask)));
+        __m128i il = _mm_cvttps_epi32(fl);
+        __m128i ir = _mm_cvttps_epi32(fr);
+        __m128i lr = _mm_packs_epi32(_mm_unpacklo_epi32(il, ir), _mm_unpackhi_epi32(il, ir));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), lr);
+    }
+    mixer_interleave_scalar(l + i, r + i, frame_count - i, out + 2 * i);
+}
+
+#else
+
+#define mixer_deinterleave_simd mixer_deinterleave_scalar
+#define mixer_accumulate_simd mixer_accumulate_scalar
+#define mixer_dot_simd mixer_dot_scalar
+#define mixer_interleave_simd mixer_interleave_scalar
+
+#endif
+
+//
+// Resampler
+//
+
+internal uint32
+mixer_gcd(uint32 a, uint32 b)
+{
+    while (b)
+    {
+        uint32 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+internal bool32
+mixer_resampler_init(mixer_resampler *resampler, memory_arena *arena, uint32 input_samples_per_second,
+    uint32 output_samples_per_second, uint32 max_input_frames)
+{
+    uint32 gcd = mixer_gcd(input_samples_per_second, output_samples_per_second);
+    resampler->up = output_samples_per_second / gcd;
+    resampler->down = input_samples_per_second / gcd;
+    resampler->phase = 0;
+    resampler->pending = 0;
+    if (resampler->up > MIXER_MAX_PHASES)
+    {
+        return 0;
+    }
+
+    // At most one frame is ever pending.
+    size_t work_size = (MIXER_TAPS + max_input_frames) * sizeof(float);
+    resampler->coefficients = (float *)arena_push(arena, resampler->up * MIXER_TAPS * sizeof(float),
+        MEMORY_CACHE_LINE);
+    resampler->work_l = (float *)arena_push(arena, work_size, MEMORY_CACHE_LINE);
+    resampler->work_r = (float *)arena_push(arena, work_size, MEMORY_CACHE_LINE);
+    if (!resampler->coefficients || !resampler->work_l || !resampler->work_r)
+    {
+        return 0;
+    }
+    // The history starts out silent.
+    memset(resampler->work_l, 0, work_size);
+    memset(resampler->work_r, 0, work_size);
+
+    // Blackman windowed sinc, cut off at the lower of the two Nyquist
+    // frequencies.  Output n sits between input taps 7 and 8 of its window,
+    // (phase / up) of the way along, so each phase is the prototype filter
+    // sampled at that fractional offset.
+    double cutoff = (resampler->up < resampler->down) ? (double)resampler->up / resampler->down : 1.0;
+    double pi = 3.14159265358979323846;
+    for (uint32 phase = 0; phase < resampler->up; ++phase)
+    {
+        float *c = resampler->coefficients + phase * MIXER_TAPS;
+        double sum = 0.0;
+        for (uint32 tap = 0; tap < MIXER_TAPS; ++tap)
+        {
+            double x = (MIXER_TAPS / 2 - 1) + (double)phase / resampler->up - tap;
+            double sinc = (x == 0.0) ? 1.0 : sin(pi * cutoff * x) / (pi * cutoff * x);
+            double window = 0.42 + 0.5 * cos(2.0 * pi * x / MIXER_TAPS) + 0.08 * cos(4.0 * pi * x / MIXER_TAPS);
+            c[tap] = (float)(sinc * window);
+            sum += c[tap];
+        }
+        for (uint32 tap = 0; tap < MIXER_TAPS; ++tap)
+        {
+            c[tap] = (float)(c[tap] / sum);
+        }
+    }
+    return 1;
+}
+
+// Input frames the resampler needs to produce exactly output_frames.
+//
+// Output i's window starts at frame (phase + i * down) / up of the history
+// and ends MIXER_TAPS - 1 frames later, so the last window needs frame
+// (phase + (output_frames - 1) * down) / up of what follows the history.
+// Afterwards (phase + output_frames * down) / up frames have been consumed,
+// which when downsampling can be one more than that.  What was supplied but
+// not consumed stays pending for the next call.
+internal uint32
+mixer_resampler_input_frames(mixer_resampler *resampler, uint32 output_frames)
+{
+    if (!output_frames)
+    {
+        return 0;
+    }
+    uint64_t last_window = ((uint64_t)resampler->phase + (uint64_t)(output_frames - 1) * resampler->down) /
+        resampler->up;
+    uint64_t consumed = ((uint64_t)resampler->phase + (uint64_t)output_frames * resampler->down) / resampler->up;
+    uint64_t wanted = (last_window + 1 > consumed) ? (last_window + 1) : consumed;
+    return (uint32)(wanted - resampler->pending);
+}
+
+internal void
+mixer_resample(mixer_resampler *resampler, bool32 reference, int16 *in, uint32 input_frames,
+    float *out_l, float *out_r, uint32 output_frames)
+{
+    float *work_l = resampler->work_l + MIXER_TAPS - 1 + resampler->pending;
+    float *work_r = resampler->work_r + MIXER_TAPS - 1 + resampler->pending;
+    if (reference)
+    {
+        mixer_deinterleave_scalar(in, input_frames, work_l, work_r);
+    }
+    else
+    {
+        mixer_deinterleave_simd(in, input_frames, work_l, work_r);
+    }
+
+    // Frames consumed, counted from the start of the history.
+    uint32 base = 0;
+    if (resampler->up == resampler->down)
+    {
+        // Same rate; the window's centre tap is exactly the input.
+        memcpy(out_l, resampler->work_l + MIXER_TAPS / 2 - 1, output_frames * sizeof(float));
+        memcpy(out_r, resampler->work_r + MIXER_TAPS / 2 - 1, output_frames * sizeof(float));
+        base = output_frames;
+    }
+    else
+    {
+        uint32 phase = resampler->phase;
+        for (uint32 i = 0; i < output_frames; ++i)
+        {
+            float *c = resampler->coefficients + phase * MIXER_TAPS;
+            if (reference)
+            {
+                out_l[i] = mixer_dot_scalar(resampler->work_l + base, c);
+                out_r[i] = mixer_dot_scalar(resampler->work_r + base, c);
+            }
+            else
+            {
+                out_l[i] = mixer_dot_simd(resampler->work_l + base, c);
+                out_r[i] = mixer_dot_simd(resampler->work_r + base, c);
+            }
+            phase += resampler->down;
+            while (phase >= resampler->up)
+            {
+                phase -= resampler->up;
+                ++base;
+            }
+        }
+        resampler->phase = phase;
+    }
+
+    // The last MIXER_TAPS - 1 consumed frames become the history, followed by
+    // whatever was supplied and not consumed.
+    uint32 supplied = resampler->pending + input_frames;
+    Assert(base <= supplied);
+    uint32 keep = MIXER_TAPS - 1 + supplied - base;
+    memmove(resampler->work_l, resampler->work_l + base, keep * sizeof(float));
+    memmove(resampler->work_r, resampler->work_r + base, keep * sizeof(float));
+    resampler->pending = supplied - base;
+}
+
+//
+// Mixer
+//
+
+// The buffers come out of arena, and last as long as it keeps them.
+internal bool32
+mixer_init(audio_mixer *mixer, memory_arena *arena, uint32 output_samples_per_second, uint32 max_output_frames)
+{
+    mixer->output_samples_per_second = output_samples_per_second;
+    mixer->max_output_frames = max_output_frames;
+    size_t size = max_output_frames * sizeof(float);
+    mixer->accumulate_l = (float *)arena_push(arena, size, MEMORY_CACHE_LINE);
+    mixer->accumulate_r = (float *)arena_push(arena, size, MEMORY_CACHE_LINE);
+    mixer->stream_l = (float *)arena_push(arena, size, MEMORY_CACHE_LINE);
+    mixer->stream_r = (float *)arena_push(arena, size, MEMORY_CACHE_LINE);
+    return mixer->accumulate_l && mixer->accumulate_r && mixer->stream_l && mixer->stream_r;
+}
+
+internal mixer_stream *
+mixer_add_stream(audio_mixer *mixer, memory_arena *arena, uint32 input_samples_per_second, float volume)
+{
+    if (mixer->stream_count >= MIXER_MAX_STREAMS)
+    {
+        return 0;
+    }
+    mixer_stream *stream = &mixer->streams[mixer->stream_count];
+    stream->volume = volume;
+    // See mixer_resampler_input_frames; phase and rounding can add two.
+    stream->input_capacity_frames = (uint32)(((uint64_t)mixer->max_output_frames * input_samples_per_second) /
+        mixer->output_samples_per_second) + 2;
+    stream->input = (int16 *)arena_push(arena, stream->input_capacity_frames * 2 * sizeof(int16),
+        MEMORY_CACHE_LINE);
+    if (!stream->input ||
+        !mixer_resampler_init(&stream->resampler, arena, input_samples_per_second,
+            mixer->output_samples_per_second, stream->input_capacity_frames))
+    {
+        return 0;
+    }
+    ++mixer->stream_count;
+    return stream;
+}
+
+internal void
+mixer_begin(audio_mixer *mixer, uint32 frame_count)
+{
+    Assert(frame_count <= mixer->max_output_frames);
+    mixer->frame_count = frame_count;
+    memset(mixer->accumulate_l, 0, frame_count * sizeof(float));
+    memset(mixer->accumulate_r, 0, frame_count * sizeof(float));
+}
+
+// Mixes stream->input, which must hold
+// mixer_resampler_input_frames(&stream->resampler, frame_count) frames.
+internal void
+mixer_mix_stream(audio_mixer *mixer, mixer_stream *stream)
+{
+    uint32 input_frames = mixer_resampler_input_frames(&stream->resampler, mixer->frame_count);
+    mixer_resample(&stream->resampler, mixer->reference, stream->input, input_frames,
+        mixer->stream_l, mixer->stream_r, mixer->frame_count);
+    if (mixer->reference)
+    {
+        mixer_accumulate_scalar(mixer->accumulate_l, mixer->stream_l, mixer->frame_count, stream->volume);
+        mixer_accumulate_scalar(mixer->accumulate_r, mixer->stream_r, mixer->frame_count, stream->volume);
+    }
+    else
+    {
+        mixer_accumulate_simd(mixer->accumulate_l, mixer->stream_l, mixer->frame_count, stream->volume);
+        mixer_accumulate_simd(mixer->accumulate_r, mixer->stream_r, mixer->frame_count, stream->volume);
+    }
+}
+
+internal void
+mixer_end(audio_mixer *mixer, int16 *out)
+{
+    if (mixer->reference)
+    {
+        mixer_interleave_scalar(mixer->accumulate_l, mixer->accumulate_r, mixer->frame_count, out);
+    }
+    else
+    {
+        mixer_interleave_simd(mixer->accumulate_l, mixer->accumulate_r, mixer->frame_count, out);
+    }
+}
+
+//
+// Verification
+//
+
+struct mixer_check_result
+{
+    int32 max_difference;
+    real64 reference_frames_per_second;
+    real64 simd_frames_per_second;
+};
+
+internal void
+mixer_fill_test_input(mixer_stream *stream, uint32 frame_count, uint32 *random_state)
+{
+    for (uint32 i = 0; i < 2 * frame_count; ++i)
+    {
+        *random_state = *random_state * 1664525 + 1013904223;
+        stream->input[i] = (int16)(*random_state >> 16);
+    }
+}
+
+internal void
+mixer_run_check_pass(audio_mixer *mixer, uint32 frame_count, uint32 seed, int16 *out)
+{
+    uint32 random_state = seed;
+    mixer_begin(mixer, frame_count);
+    for (uint32 stream_index = 0; stream_index < mixer->stream_count; ++stream_index)
+    {
+        mixer_stream *stream = &mixer->streams[stream_index];
+        mixer_fill_test_input(stream, mixer_resampler_input_frames(&stream->resampler, frame_count), &random_state);
+        mixer_mix_stream(mixer, stream);
+    }
+    mixer_end(mixer, out);
+}
+
+// Runs the same random input through the SIMD and reference paths of two
+// identically configured mixers (one stream at the output rate and one that
+// needs converting, loud enough together to clip), and times both.  Its
+// buffers are only borrowed from arena.
+internal mixer_check_result
+mixer_check(memory_arena *arena, uint32 output_samples_per_second, uint32 other_samples_per_second,
+    uint32 frames_per_pass, uint32 pass_count)
+{
+    mixer_check_result result = {};
+    temporary_memory temporary = begin_temporary_memory(arena);
+
+    audio_mixer mixers[2] = {};
+    int16 *outputs[2];
+    for (uint32 mixer_index = 0; mixer_index < 2; ++mixer_index)
+    {
+        audio_mixer *mixer = &mixers[mixer_index];
+        outputs[mixer_index] = (int16 *)arena_push(arena, frames_per_pass * 2 * sizeof(int16), MEMORY_CACHE_LINE);
+        if (!outputs[mixer_index] ||
+            !mixer_init(mixer, arena, output_samples_per_second, frames_per_pass) ||
+            !mixer_add_stream(mixer, arena, output_samples_per_second, 0.8f) ||
+            !mixer_add_stream(mixer, arena, other_samples_per_second, 0.7f))
+        {
+            end_temporary_memory(temporary);
+            result.max_difference = -1;
+            return result;
+        }
+        mixer->reference = (mixer_index == 0);
+    }
+
+    for (uint32 pass = 0; pass < pass_count; ++pass)
+    {
+        int64_t times[2];
+        for (uint32 mixer_index = 0; mixer_index < 2; ++mixer_index)
+        {
+            int64_t start = get_nanoseconds(CLOCK_MONOTONIC_RAW);
+            mixer_run_check_pass(&mixers[mixer_index], frames_per_pass, pass + 1, outputs[mixer_index]);
+            times[mixer_index] = get_nanoseconds(CLOCK_MONOTONIC_RAW) - start;
+        }
+        result.reference_frames_per_second += times[0];
+        result.simd_frames_per_second += times[1];
+
+        for (uint32 i = 0; i < 2 * frames_per_pass; ++i)
+        {
+            int32 difference = abs(outputs[0][i] - outputs[1][i]);
+            if (difference > result.max_difference)
+            {
+                result.max_difference = difference;
+            }
+        }
+    }
+
+    real64 total_frames = (real64)frames_per_pass * pass_count;
+    result.reference_frames_per_second = total_frames * 1.0e9 / result.reference_frames_per_second;
+    result.simd_frames_per_second = total_frames * 1.0e9 / result.simd_frames_per_second;
+
+    end_temporary_memory(temporary);
+    return result;
+}
+
+#endif
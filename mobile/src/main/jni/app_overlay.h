@@ -0,0 +1,378 @@
+#ifndef APP_OVERLAY_H
+#define APP_OVERLAY_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "app_pixels.h"
+#include "app_time.h"
+
+// Performance overlay, drawn by the platform straight into the game's
+// buffer after GameUpdateAndRender and before the upload, so it costs no GL
+// state and shows up in --dump on the host.
+//
+// It shows a rolling graph of frame work time against the budget, how long
+// each stage of the last frame took, resident memory, bytes uploaded per
+// frame, and what the overlay itself cost.  Text is a 3x5 pixel font drawn
+// at twice the size.  The panel is darkened and filled a row at a time,
+// with NEON or SSE2 where we have them and the scalar version otherwise.
+
+#define OVERLAY_HISTORY_COUNT 120
+#define OVERLAY_SCALE 2
+#define OVERLAY_GLYPH_ADVANCE (4 * OVERLAY_SCALE)
+#define OVERLAY_LINE_HEIGHT (7 * OVERLAY_SCALE)
+#define OVERLAY_MARGIN 8
+#define OVERLAY_PADDING 6
+#define OVERLAY_WIDTH (2 * OVERLAY_HISTORY_COUNT + 2 * OVERLAY_PADDING)
+#define OVERLAY_GRAPH_HEIGHT 48
+#define OVERLAY_MEMORY_INTERVAL 30
+
+#define OVERLAY_TEXT_COLOR 0xffffffff
+#define OVERLAY_GOOD_COLOR 0xff40d040
+#define OVERLAY_BAD_COLOR 0xffe04040
+#define OVERLAY_BUDGET_COLOR 0xffe0e040
+#define OVERLAY_BAR_COLOR 0xff4090e0
+
+enum overlay_stage
+{
+    OVERLAY_STAGE_INPUT,
+    OVERLAY_STAGE_UPDATE,
+    OVERLAY_STAGE_SOUND,
+    OVERLAY_STAGE_PRESENT,
+
+    OVERLAY_STAGE_COUNT,
+};
+
+global_variable char *overlay_stage_names[OVERLAY_STAGE_COUNT] = {"INPUT", "UPDATE", "SOUND", "PRESENT"};
+
+// 3x5 glyphs for ' ' to '_', a row of three bits at a time from the top,
+// most significant bit on the left.  Lower case is drawn as upper case.
+global_variable uint16 overlay_font[64] =
+{
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x52a5, 0x0000, 0x0000,
+    0x1491, 0x4494, 0x0000, 0x05d0, 0x0000, 0x01c0, 0x0002, 0x12a4,
+    0x7b6f, 0x2c97, 0x73e7, 0x72cf, 0x5bc9, 0x79cf, 0x79ef, 0x7292,
+    0x7bef, 0x7bcf, 0x0410, 0x0000, 0x0000, 0x0e38, 0x0000, 0x0000,
+    0x0000, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b,
+    0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a,
+    0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd,
+    0x5aad, 0x5a92, 0x72a7, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+};
+
+struct perf_overlay
+{
+    bool32 visible;
+    int64_t budget_ns;
+    real32 update_hz;
+
+    int64_t frame_ns[OVERLAY_HISTORY_COUNT];
+    uint32 frame_next;
+    uint32 frame_count;
+
+    int64_t stage_ns[OVERLAY_STAGE_COUNT];
+    uint32 upload_bytes;
+
+    uint64 resident_bytes;
+    uint32 frames_since_memory;
+
+    int64_t draw_ns;
+};
+
+struct overlay_target
+{
+    uint32 *pixels;
+    int32 width;
+    int32 height;
+    int32 pitch;
+};
+
+internal void
+overlay_init(perf_overlay *overlay, int64_t budget_ns, real32 update_hz, bool32 visible)
+{
+    *overlay = {};
+    overlay->budget_ns = budget_ns;
+    overlay->update_hz = update_hz;
+    overlay->visible = visible;
+}
+
+inline void
+overlay_toggle(perf_overlay *overlay)
+{
+    overlay->visible = !overlay->visible;
+    overlay->frames_since_memory = OVERLAY_MEMORY_INTERVAL;
+}
+
+// Call once a frame with the time the frame spent working.
+internal void
+overlay_record_frame(perf_overlay *overlay, int64_t work_ns)
+{
+    overlay->frame_ns[overlay->frame_next] = work_ns;
+    overlay->frame_next = (overlay->frame_next + 1) % OVERLAY_HISTORY_COUNT;
+    if (overlay->frame_count < OVERLAY_HISTORY_COUNT)
+    {
+        ++overlay->frame_count;
+    }
+}
+
+inline void
+overlay_record_stage(perf_overlay *overlay, overlay_stage stage, int64_t ns)
+{
+    overlay->stage_ns[stage] = ns;
+}
+
+// Resident set size from /proc, which is too slow to read every frame.
+internal uint64
+overlay_read_resident_bytes()
+{
+    uint64 result = 0;
+    int fd = open("/proc/self/statm", O_RDONLY);
+    if (fd >= 0)
+    {
+        char contents[128];
+        ssize_t size = read(fd, contents, sizeof(contents) - 1);
+        if (size > 0)
+        {
+            contents[size] = 0;
+            unsigned long long total_pages = 0;
+            unsigned long long resident_pages = 0;
+            if (sscanf(contents, "%llu %llu", &total_pages, &resident_pages) == 2)
+            {
+                result = resident_pages * (uint64)sysconf(_SC_PAGESIZE);
+            }
+        }
+        close(fd);
+    }
+    return result;
+}
+
+internal void
+overlay_darken_span_scalar(uint32 *pixels, int32 count)
+{
+    for (int32 i = 0; i < count; ++i)
+    {
+        pixels[i] = ((pixels[i] >> 1) & 0x7f7f7f7f) | 0xff000000;
+    }
+}
+
+internal void
+overlay_fill_span_scalar(uint32 *pixels, int32 count, uint32 color)
+{
+    for (int32 i = 0; i < count; ++i)
+    {
+        pixels[i] = color;
+    }
+}
+
+#if PIXELS_NEON
+
+internal void
+overlay_darken_span_simd(uint32 *pixels, int32 count)
+{
+    int32 simd_count = count & ~3;
+    uint32x4_t alpha = vdupq_n_u32(0xff000000);
+    for (int32 i = 0; i < simd_count; i += 4)
+    {
+        uint8x16_t p = vld1q_u8((uint8 *)(pixels + i));
+        uint32x4_t halved = vreinterpretq_u32_u8(vshrq_n_u8(p, 1));
+        vst1q_u32(pixels + i, vorrq_u32(halved, alpha));
+    }
+    overlay_darken_span_scalar(pixels + simd_count, count - simd_count);
+}
+
+internal void
+overlay_fill_span_simd(uint32 *pixels, int32 count, uint32 color)
+{
+    int32 simd_count = count & ~3;
+    uint32x4_t c = vdupq_n_u32(color);
+    for (int32 i = 0; i < simd_count; i += 4)
+    {
+        vst1q_u32(pixels + i, c);
+    }
+    overlay_fill_span_scalar(pixels + simd_count, count - simd_count, color);
+}
+
+#elif PIXELS_SSE2
+
+internal void
+overlay_darken_span_simd(uint32 *pixels, int32 count)
+{
+    int32 simd_count = count & ~3;
+    __m128i low_bits = _mm_set1_epi32(0x7f7f7f7f);
+    __m128i alpha = _mm_set1_epi32(0xff000000);
+    for (int32 i = 0; i < simd_count; i += 4)
+    {
+        __m128i p = _mm_loadu_si128((__m128i *)(pixels + i));
+        // No 8-bit shift, so shift 32 bits and drop what crossed into the
+        // byte below.
+        __m128i halved = _mm_and_si128(_mm_srli_epi32(p, 1), low_bits);
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm_or_si128(halved, alpha));
+    }
+    overlay_darken_span_scalar(pixels + simd_count, count - simd_count);
+}
+
+internal void
+overlay_fill_span_simd(uint32 *pixels, int32 count, uint32 color)
+{
+    int32 simd_count = count & ~3;
+    __m128i c = _mm_set1_epi32(color);
+    for (int32 i = 0; i < simd_count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(pixels + i), c);
+    }
+    overlay_fill_span_scalar(pixels + simd_count, count - simd_count, color);
+}
+
+#else
+
+#define overlay_darken_span_simd overlay_darken_span_scalar
+#define overlay_fill_span_simd overlay_fill_span_scalar
+
+#endif
+
+// Clips to the target; all drawing goes through here.
+internal void
+overlay_rect(overlay_target *target, int32 x, int32 y, int32 width, int32 height, uint32 color, bool32 darken)
+{
+    int32 x_end = x + width;
+    int32 y_end = y + height;
+    x = (x < 0) ? 0 : x;
+    y = (y < 0) ? 0 : y;
+    x_end = (x_end > target->width) ? target->width : x_end;
+    y_end = (y_end > target->height) ? target->height : y_end;
+    for (int32 row = y; row < y_end; ++row)
+    {
+        uint32 *pixels = target->pixels + row * target->pitch + x;
+        if (darken)
+        {
+            overlay_darken_span_simd(pixels, x_end - x);
+        }
+        else
+        {
+            overlay_fill_span_simd(pixels, x_end - x, color);
+        }
+    }
+}
+
+// Returns the x just past the text.
+internal int32
+overlay_text(overlay_target *target, int32 x, int32 y, char *text, uint32 color)
+{
+    for (char *c = text; *c; ++c)
+    {
+        char upper = ((*c >= 'a') && (*c <= 'z')) ? (*c - 'a' + 'A') : *c;
+        uint16 glyph = ((upper >= ' ') && (upper <= '_')) ? overlay_font[upper - ' '] : 0;
+        for (int32 row = 0; row < 5; ++row)
+        {
+            for (int32 column = 0; column < 3; ++column)
+            {
+                if (glyph & (1 << (14 - 3 * row - column)))
+                {
+                    overlay_rect(target, x + column * OVERLAY_SCALE, y + row * OVERLAY_SCALE,
+                        OVERLAY_SCALE, OVERLAY_SCALE, color, 0);
+                }
+            }
+        }
+        x += OVERLAY_GLYPH_ADVANCE;
+    }
+    return x;
+}
+
+// Call between frames, after the frame's stages have been recorded, so the
+// read isn't charged to PRESENT or to the overlay's own cost.
+internal void
+overlay_update_memory(perf_overlay *overlay)
+{
+    if (overlay->visible && (++overlay->frames_since_memory >= OVERLAY_MEMORY_INTERVAL))
+    {
+        overlay->resident_bytes = overlay_read_resident_bytes();
+        overlay->frames_since_memory = 0;
+    }
+}
+
+internal void
+overlay_draw(perf_overlay *overlay, uint8_t *buffer, int32 width, int32 height, int32 pitch)
+{
+    if (!overlay->visible)
+    {
+        return;
+    }
+    int64_t start_ns = monotonic_nanoseconds();
+
+    overlay_target target;
+    target.pixels = (uint32 *)buffer;
+    target.width = width;
+    target.height = height;
+    target.pitch = pitch / 4;
+
+    int32 text_lines = 4 + OVERLAY_STAGE_COUNT;
+    int32 panel_height = 2 * OVERLAY_PADDING + OVERLAY_GRAPH_HEIGHT + OVERLAY_PADDING +
+        text_lines * OVERLAY_LINE_HEIGHT;
+    int32 left = OVERLAY_MARGIN;
+    int32 top = OVERLAY_MARGIN;
+    overlay_rect(&target, left, top, OVERLAY_WIDTH, panel_height, 0, 1);
+
+    // The graph's full height is two budgets, oldest frame on the left.
+    int32 graph_left = left + OVERLAY_PADDING;
+    int32 graph_bottom = top + OVERLAY_PADDING + OVERLAY_GRAPH_HEIGHT;
+    int64_t frame_sum_ns = 0;
+    int64_t frame_max_ns = 0;
+    for (uint32 i = 0; i < overlay->frame_count; ++i)
+    {
+        uint32 index = (overlay->frame_next + OVERLAY_HISTORY_COUNT - overlay->frame_count + i) % OVERLAY_HISTORY_COUNT;
+        int64_t frame_ns = overlay->frame_ns[index];
+        frame_sum_ns += frame_ns;
+        frame_max_ns = (frame_ns > frame_max_ns) ? frame_ns : frame_max_ns;
+
+        int32 bar_height = (int32)((frame_ns * OVERLAY_GRAPH_HEIGHT) / (2 * overlay->budget_ns));
+        bar_height = (bar_height > OVERLAY_GRAPH_HEIGHT) ? OVERLAY_GRAPH_HEIGHT : ((bar_height < 1) ? 1 : bar_height);
+        uint32 color = (frame_ns > overlay->budget_ns) ? OVERLAY_BAD_COLOR : OVERLAY_GOOD_COLOR;
+        int32 x = graph_left + 2 * (OVERLAY_HISTORY_COUNT - overlay->frame_count + i);
+        overlay_rect(&target, x, graph_bottom - bar_height, 1, bar_height, color, 0);
+    }
+    overlay_rect(&target, graph_left, graph_bottom - OVERLAY_GRAPH_HEIGHT / 2,
+        2 * OVERLAY_HISTORY_COUNT, 1, OVERLAY_BUDGET_COLOR, 0);
+
+    char line[64];
+    int32 x = graph_left;
+    int32 y = graph_bottom + OVERLAY_PADDING;
+    snprintf(line, sizeof(line), "WORK %.1f MAX %.1f / %.1f MS",
+        overlay->frame_count ? (frame_sum_ns / 1.0e6) / overlay->frame_count : 0.0,
+        frame_max_ns / 1.0e6, overlay->budget_ns / 1.0e6);
+    overlay_text(&target, x, y, line, OVERLAY_TEXT_COLOR);
+    y += OVERLAY_LINE_HEIGHT;
+
+    // Stage bars are to the same scale as the graph: half the width is a
+    // whole budget.
+    int32 bar_left = x + 8 * OVERLAY_GLYPH_ADVANCE;
+    int32 bar_width = 2 * OVERLAY_HISTORY_COUNT - 8 * OVERLAY_GLYPH_ADVANCE - 6 * OVERLAY_GLYPH_ADVANCE;
+    for (uint32 stage = 0; stage < OVERLAY_STAGE_COUNT; ++stage)
+    {
+        int64_t stage_ns = overlay->stage_ns[stage];
+        int32 length = (int32)((stage_ns * bar_width) / (2 * overlay->budget_ns));
+        length = (length > bar_width) ? bar_width : length;
+        overlay_text(&target, x, y, overlay_stage_names[stage], OVERLAY_TEXT_COLOR);
+        overlay_rect(&target, bar_left, y, length, 5 * OVERLAY_SCALE, OVERLAY_BAR_COLOR, 0);
+        snprintf(line, sizeof(line), "%.2f", stage_ns / 1.0e6);
+        overlay_text(&target, bar_left + bar_width + OVERLAY_GLYPH_ADVANCE, y, line, OVERLAY_TEXT_COLOR);
+        y += OVERLAY_LINE_HEIGHT;
+    }
+
+    snprintf(line, sizeof(line), "MEM %.1f MB", overlay->resident_bytes / (1024.0 * 1024.0));
+    overlay_text(&target, x, y, line, OVERLAY_TEXT_COLOR);
+    y += OVERLAY_LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "UPLOAD %.2f MB %.0f MB/S", overlay->upload_bytes / (1024.0 * 1024.0),
+        (overlay->upload_bytes * overlay->update_hz) / (1024.0 * 1024.0));
+    overlay_text(&target, x, y, line, OVERLAY_TEXT_COLOR);
+    y += OVERLAY_LINE_HEIGHT;
+
+    // What this cost last time, as this one isn't finished.
+    snprintf(line, sizeof(line), "OVERLAY %.3f MS", overlay->draw_ns / 1.0e6);
+    overlay_text(&target, x, y, line, OVERLAY_TEXT_COLOR);
+
+    overlay->draw_ns = monotonic_nanoseconds() - start_ns;
+}
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef APP_PERSIST_H
+#define APP_PERSIST_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include "app_log.h"
+#include "app_time.h"
+
+// PermanentStorage kept in a file, so the game survives its process.
+//
+// The file is a header page followed by the storage, mapped MAP_SHARED, so
+// the game writes straight into the page cache and the kernel writes it
+// back whether or not we're still around.  At lifecycle points the platform
+// seals it: a checksum of the storage goes in the header and msync starts
+// the writeback without waiting for it.  The first frame after that unseals
+// it again.  On startup a sealed file from the same build, mapped back at
+// the same address, is taken as it is and the game carries on; anything
+// else starts from zeroed storage as before.
+//
+// The address matters because the game keeps pointers into its own
+// storage.  Pointers anywhere else, such as to file contents the platform
+// read for it, don't survive, so this is only for games that keep all of
+// their state in PermanentStorage.
+//
+// Writes to a mapped file that can't be backed get SIGBUS, so the space is
+// reserved up front where we can, and checked for where we can't.
+
+#define PERSIST_MAGIC 0x53504848 // "HHPS"
+#define PERSIST_VERSION 1
+#define PERSIST_HEADER_SIZE 4096
+
+// Somewhere the heap and libraries don't go, inside a 39-bit address space.
+// On 32-bit the kernel picks, and state only comes back if it picks the
+// same place.
+#define PERSIST_BASE_ADDRESS ((sizeof(void *) == 8) ? (uintptr_t)0x4000000000ull : (uintptr_t)0)
+
+struct persist_header
+{
+    uint32 magic;
+    uint32 version;
+    uint64 storage_size;
+    uint64 build_hash;
+    uint64 base_address;
+    uint64 checksum;
+    uint32 sealed;
+    uint32 seal_count;
+};
+
+struct persistent_storage
+{
+    int file;
+    uint8 *base;
+    uint64 mapped_size;
+    persist_header *header;
+
+    void *storage;
+    uint64 storage_size;
+    bool32 restored;
+    int64_t open_ns;
+    int64_t seal_ns;
+};
+
+// Four independent lanes, so it runs at memory speed rather than multiply
+// latency.  Not cryptographic; it only has to notice torn or stale pages.
+internal uint64
+persist_checksum(void *data, uint64 size)
+{
+    uint64 *words = (uint64 *)data;
+    uint64 word_count = size / 8;
+    uint64 lanes[4] = {0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0x2545f4914f6cdd1dull};
+    uint64 i = 0;
+    for (; i + 4 <= word_count; i += 4)
+    {
+        for (uint32 lane = 0; lane < 4; ++lane)
+        {
+            uint64 h = (lanes[lane] ^ words[i + lane]) * 0xff51afd7ed558ccdull;
+            lanes[lane] = h ^ (h >> 32);
+        }
+    }
+    uint64 hash = size;
+    for (uint32 lane = 0; lane < 4; ++lane)
+    {
+        hash = (hash ^ lanes[lane]) * 0xc4ceb9fe1a85ec53ull;
+    }
+    for (; i < word_count; ++i)
+    {
+        hash = (hash ^ words[i]) * 0xc4ceb9fe1a85ec53ull;
+    }
+    uint8 *tail = (uint8 *)(words + word_count);
+    for (uint64 j = 0; j < size % 8; ++j)
+    {
+        hash = (hash ^ tail[j]) * 0xc4ceb9fe1a85ec53ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+// Empties the file and makes it the right size again, so the storage reads
+// as zeros without writing any.
+internal bool32
+persist_reset_file(int file, uint64 file_size)
+{
+    if ((ftruncate(file, 0) != 0) || (ftruncate(file, file_size) != 0))
+    {
+        return 0;
+    }
+#if !defined(__ANDROID__) || (__ANDROID_API__ >= 21)
+    int error = posix_fallocate(file, 0, file_size);
+    if ((error != 0) && (error != EOPNOTSUPP) && (error != EINVAL))
+    {
+        app_log("Couldn't reserve %llu bytes for persistent storage: %s", (unsigned long long)file_size,
+            strerror(error));
+        return 0;
+    }
+#else
+    struct statfs fs = {};
+    if ((fstatfs(file, &fs) != 0) || ((uint64)fs.f_bavail * fs.f_bsize < 2 * file_size))
+    {
+        app_log("Not enough free space for persistent storage");
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+internal bool32
+persist_header_matches(persist_header *header, uint64 storage_size, uint64 build_hash)
+{
+    return (header->magic == PERSIST_MAGIC) &&
+        (header->version == PERSIST_VERSION) &&
+        (header->storage_size == storage_size) &&
+        (header->build_hash == build_hash) &&
+        header->sealed;
+}
+
+// Maps storage_size bytes of storage from path.  build_hash should change
+// whenever the game's idea of its storage might.  Returns 0, with nothing
+// left open, if the file can't be used at all; the caller allocates as usual.
+internal bool32
+persist_open(persistent_storage *persist, char *path, uint64 storage_size, uint64 build_hash)
+{
+    *persist = {};
+    int64_t start_ns = monotonic_nanoseconds();
+    uint64 file_size = PERSIST_HEADER_SIZE + storage_size;
+
+    int file = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (file < 0)
+    {
+        app_log("Couldn't open persistent storage %s: %s", path, strerror(errno));
+        return 0;
+    }
+
+    persist_header old_header = {};
+    struct stat file_stat = {};
+    bool32 reusable = (fstat(file, &file_stat) == 0) && ((uint64)file_stat.st_size == file_size) &&
+        (pread(file, &old_header, sizeof(old_header), 0) == sizeof(old_header)) &&
+        persist_header_matches(&old_header, storage_size, build_hash);
+    if (!reusable && !persist_reset_file(file, file_size))
+    {
+        close(file);
+        return 0;
+    }
+
+    void *hint = (void *)(reusable ? (uintptr_t)old_header.base_address : PERSIST_BASE_ADDRESS);
+    void *base = mmap(hint, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (base == MAP_FAILED)
+    {
+        app_log("Couldn't map persistent storage: %s", strerror(errno));
+        close(file);
+        return 0;
+    }
+
+    persist_header *header = (persist_header *)base;
+    void *storage = (uint8 *)base + PERSIST_HEADER_SIZE;
+    if (reusable)
+    {
+        if ((uintptr_t)base != (uintptr_t)header->base_address)
+        {
+            app_log("Persistent storage mapped at %p instead of %p, starting over", base,
+                (void *)(uintptr_t)header->base_address);
+            reusable = 0;
+        }
+        else if (persist_checksum(storage, storage_size) != header->checksum)
+        {
+            app_log("Persistent storage checksum mismatch, starting over");
+            reusable = 0;
+        }
+
+        if (!reusable)
+        {
+            munmap(base, file_size);
+            base = MAP_FAILED;
+            if (persist_reset_file(file, file_size))
+            {
+                base = mmap((void *)PERSIST_BASE_ADDRESS, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            }
+            if (base == MAP_FAILED)
+            {
+                close(file);
+                return 0;
+            }
+            header = (persist_header *)base;
+            storage = (uint8 *)base + PERSIST_HEADER_SIZE;
+        }
+    }
+
+    if (!reusable)
+    {
+        header->magic = PERSIST_MAGIC;
+        header->version = PERSIST_VERSION;
+        header->storage_size = storage_size;
+        header->build_hash = build_hash;
+        header->base_address = (uintptr_t)base;
+        header->sealed = 0;
+    }
+
+    persist->file = file;
+    persist->base = (uint8 *)base;
+    persist->mapped_size = file_size;
+    persist->header = header;
+    persist->storage = storage;
+    persist->storage_size = storage_size;
+    persist->restored = reusable;
+    persist->open_ns = monotonic_nanoseconds() - start_ns;
+    return 1;
+}
+
+inline bool32
+persist_enabled(persistent_storage *persist)
+{
+    return persist->base != 0;
+}
+
+// Call where the process may be killed next.  The storage mustn't change
+// until persist_unseal.
+internal void
+persist_seal(persistent_storage *persist)
+{
+    if (!persist_enabled(persist) || persist->header->sealed)
+    {
+        return;
+    }
+    int64_t start_ns = monotonic_nanoseconds();
+    persist->header->checksum = persist_checksum(persist->storage, persist->storage_size);
+    persist->header->sealed = 1;
+    ++persist->header->seal_count;
+    msync(persist->base, persist->mapped_size, MS_ASYNC);
+    persist->seal_ns = monotonic_nanoseconds() - start_ns;
+}
+
+// Call before the game next touches the storage.  If the process dies from
+// here on, the file won't be trusted, as pages may reach it in any order.
+inline void
+persist_unseal(persistent_storage *persist)
+{
+    if (persist_enabled(persist) && persist->header->sealed)
+    {
+        persist->header->sealed = 0;
+    }
+}
+
+internal void
+persist_close(persistent_storage *persist)
+{
+    if (persist_enabled(persist))
+    {
+        munmap(persist->base, persist->mapped_size);
+        close(persist->file);
+    }
+    *persist = {};
+}
+
+#endif
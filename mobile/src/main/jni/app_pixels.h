@@ -0,0 +1,167 @@
+#ifndef APP_PIXELS_H
+#define APP_PIXELS_H
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PIXELS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXELS_SSE2 1
+#endif
+
+// Pixel conversion for texture upload.
+//
+// The game draws 32-bit BGRA.  Converting that to RGB565 before upload
+// halves the bytes the GPU has to pull across the shared memory bus every
+// frame, at the cost of colour depth; a 4x4 ordered dither keeps smooth
+// gradients from banding.
+//
+// The channels are packed so the texture's red field holds the game's blue,
+// as the RGBA8 upload does, so the presenter's .bgr swizzle works for both.
+//
+// As in the mixer, the scalar version is the reference and the NEON or SSE2
+// version must match it exactly.
+
+global_variable uint8 pixels_bayer4[4][4] =
+{
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5},
+};
+
+// Thresholds for one row, scaled to the step of a 5 and a 6 bit channel.
+// Adding before truncating rounds up exactly as often as the lost bits say.
+//
+// The GPU expands a 5 bit value q back to (q << 3) | (q >> 2), which is q
+// times 255/31 rather than 8, so the channel is first scaled by 248/255
+// (252/255 for 6 bits) or the dither would brighten everything by up to 3%.
+// That also means the sum can't pass 255.
+internal void
+pixels_dither_row(uint32 y, uint8 *dither5, uint8 *dither6)
+{
+    for (uint32 x = 0; x < 4; ++x)
+    {
+        dither5[x] = pixels_bayer4[y & 3][x] >> 1;
+        dither6[x] = pixels_bayer4[y & 3][x] >> 2;
+    }
+}
+
+internal void
+pixels_bgra_to_rgb565_row_scalar(uint16 *dest, uint32 *source, uint32 x_begin, uint32 x_end, uint32 y)
+{
+    uint8 dither5[4];
+    uint8 dither6[4];
+    pixels_dither_row(y, dither5, dither6);
+
+    for (uint32 x = x_begin; x < x_end; ++x)
+    {
+        uint32 bgra = source[x];
+        uint32 b = bgra & 0xff;
+        uint32 g = (bgra >> 8) & 0xff;
+        uint32 r = (bgra >> 16) & 0xff;
+        b = b - (b >> 5) + dither5[x & 3];
+        g = g - (g >> 6) + dither6[x & 3];
+        r = r - (r >> 5) + dither5[x & 3];
+        dest[x] = (uint16)(((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3));
+    }
+}
+
+internal void
+pixels_bgra_to_rgb565_scalar(uint16 *dest, uint32 *source, uint32 width, uint32 height)
+{
+    for (uint32 y = 0; y < height; ++y)
+    {
+        pixels_bgra_to_rgb565_row_scalar(dest + y * width, source + y * width, 0, width, y);
+    }
+}
+
+#if PIXELS_NEON
+
+internal void
+pixels_bgra_to_rgb565_simd(uint16 *dest, uint32 *source, uint32 width, uint32 height)
+{
+    uint32 simd_width = width & ~7u;
+    for (uint32 y = 0; y < height; ++y)
+    {
+        uint8 dither5[8];
+        uint8 dither6[8];
+        pixels_dither_row(y, dither5, dither6);
+        pixels_dither_row(y, dither5 + 4, dither6 + 4);
+        uint8x8_t d5 = vld1_u8(dither5);
+        uint8x8_t d6 = vld1_u8(dither6);
+
+        uint16 *dest_row = dest + y * width;
+        uint32 *source_row = source + y * width;
+        for (uint32 x = 0; x < simd_width; x += 8)
+        {
+            // Loads 8 pixels split into B, G, R and A lanes.
+            uint8x8x4_t bgra = vld4_u8((uint8 *)(source_row + x));
+            uint8x8_t b = vsub_u8(bgra.val[0], vshr_n_u8(bgra.val[0], 5));
+            uint8x8_t g = vsub_u8(bgra.val[1], vshr_n_u8(bgra.val[1], 6));
+            uint8x8_t r = vsub_u8(bgra.val[2], vshr_n_u8(bgra.val[2], 5));
+            uint8x8_t b5 = vshr_n_u8(vadd_u8(b, d5), 3);
+            uint8x8_t g6 = vshr_n_u8(vadd_u8(g, d6), 2);
+            uint8x8_t r5 = vshr_n_u8(vadd_u8(r, d5), 3);
+            uint16x8_t packed = vorrq_u16(
+                vorrq_u16(vshlq_n_u16(vmovl_u8(b5), 11), vshlq_n_u16(vmovl_u8(g6), 5)),
+                vmovl_u8(r5));
+            vst1q_u16(dest_row + x, packed);
+        }
+        pixels_bgra_to_rgb565_row_scalar(dest_row, source_row, simd_width, width, y);
+    }
+}
+
+#elif PIXELS_SSE2
+
+internal void
+pixels_bgra_to_rgb565_simd(uint16 *dest, uint32 *source, uint32 width, uint32 height)
+{
+    uint32 simd_width = width & ~7u;
+    __m128i low_byte = _mm_set1_epi32(0xff);
+    for (uint32 y = 0; y < height; ++y)
+    {
+        uint8 dither5[4];
+        uint8 dither6[4];
+        pixels_dither_row(y, dither5, dither6);
+        __m128i d5 = _mm_setr_epi16(dither5[0], dither5[1], dither5[2], dither5[3],
+            dither5[0], dither5[1], dither5[2], dither5[3]);
+        __m128i d6 = _mm_setr_epi16(dither6[0], dither6[1], dither6[2], dither6[3],
+            dither6[0], dither6[1], dither6[2], dither6[3]);
+
+        uint16 *dest_row = dest + y * width;
+        uint32 *source_row = source + y * width;
+        for (uint32 x = 0; x < simd_width; x += 8)
+        {
+            __m128i p0 = _mm_loadu_si128((__m128i *)(source_row + x));
+            __m128i p1 = _mm_loadu_si128((__m128i *)(source_row + x + 4));
+
+            // Channels into 16-bit lanes; every value fits, so the signed
+            // saturation in packs never kicks in.
+            __m128i b = _mm_packs_epi32(_mm_and_si128(p0, low_byte), _mm_and_si128(p1, low_byte));
+            __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), low_byte),
+                _mm_and_si128(_mm_srli_epi32(p1, 8), low_byte));
+            __m128i r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), low_byte),
+                _mm_and_si128(_mm_srli_epi32(p1, 16), low_byte));
+
+            b = _mm_sub_epi16(b, _mm_srli_epi16(b, 5));
+            g = _mm_sub_epi16(g, _mm_srli_epi16(g, 6));
+            r = _mm_sub_epi16(r, _mm_srli_epi16(r, 5));
+            __m128i b5 = _mm_srli_epi16(_mm_add_epi16(b, d5), 3);
+            __m128i g6 = _mm_srli_epi16(_mm_add_epi16(g, d6), 2);
+            __m128i r5 = _mm_srli_epi16(_mm_add_epi16(r, d5), 3);
+
+            __m128i packed = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(b5, 11), _mm_slli_epi16(g6, 5)), r5);
+            _mm_storeu_si128((__m128i *)(dest_row + x), packed);
+        }
+        pixels_bgra_to_rgb565_row_scalar(dest_row, source_row, simd_width, width, y);
+    }
+}
+
+#else
+
+#define pixels_bgra_to_rgb565_simd pixels_bgra_to_rgb565_scalar
+
+#endif
+
+#endif
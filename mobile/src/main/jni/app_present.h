@@ -0,0 +1,211 @@
+#ifndef APP_PRESENT_H
+#define APP_PRESENT_H
+
+#include <math.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+
+#include "app_time.h"
+
+// Frame pacing and presentation.
+//
+// Either the display paces us, with eglSwapBuffers blocking until every
+// vblank (60 Hz) or every second one (30 Hz), or we pace ourselves with a
+// sleep and swap without waiting.  Sleeping on top of a blocking swap, as
+// the loop used to, means the two add up differently every frame.
+//
+// Where EGL_ANDROID_presentation_time is available every frame in the vsync
+// modes also carries the time it is meant to be shown, so one that is ready
+// early is held back by the compositor rather than shown early.  Manual
+// pacing doesn't ask for a time: the loop's sleep already is the cadence,
+// in whole milliseconds, so any cadence of our own would drift away from it.
+// Nor is the requested time ever more than a frame past the swap, as the
+// refresh rate we're told may not be the panel's; each frame past that would
+// be one more buffer held by the compositor, and one more frame of latency.
+//
+// The time each frame spends blocked in eglSwapBuffers is measured, along
+// with the spread of the frame intervals, so the modes can be compared.
+
+enum pacing_mode
+{
+    PACING_MANUAL,
+    PACING_VSYNC,
+    PACING_VSYNC_HALF,
+
+    PACING_MODE_COUNT,
+};
+
+global_variable char *pacing_mode_names[PACING_MODE_COUNT] = {"manual", "vsync", "vsync-half"};
+
+typedef EGLBoolean (EGLAPIENTRYP egl_presentation_time_android)(EGLDisplay display, EGLSurface surface, int64_t time);
+
+struct frame_pacer
+{
+    pacing_mode mode;
+    int swap_interval;
+    int64_t frame_ns;
+
+    egl_presentation_time_android presentation_time;
+    int64_t next_present_ns;
+    // How far past the swap the last frame asked to be shown.
+    int64_t last_present_lag_ns;
+
+    int64_t last_swap_ns;
+    int64_t last_swap_end_ns;
+
+    uint32 window_frames;
+    int64_t window_swap_ns;
+    int64_t window_max_swap_ns;
+    int64_t window_max_present_lag_ns;
+    uint32 window_intervals;
+    real64 window_interval_sum;
+    real64 window_interval_sum_squares;
+};
+
+internal void
+frame_pacer_init(frame_pacer *pacer, pacing_mode mode, int refresh_hz)
+{
+    *pacer = {};
+    pacer->mode = mode;
+    pacer->swap_interval = (mode == PACING_MANUAL) ? 0 : ((mode == PACING_VSYNC) ? 1 : 2);
+    // Manual pacing keeps the game at half the refresh rate, as before.
+    int frames_per_update = (mode == PACING_VSYNC) ? 1 : 2;
+    pacer->frame_ns = ((int64_t)1000000000 * frames_per_update) / refresh_hz;
+}
+
+inline real32
+frame_pacer_update_hz(frame_pacer *pacer)
+{
+    return 1.0e9f / pacer->frame_ns;
+}
+
+// True when the frame loop has to sleep off the rest of the frame itself.
+inline bool32
+frame_pacer_sleeps(frame_pacer *pacer)
+{
+    return pacer->mode == PACING_MANUAL;
+}
+
+// Call with the context current after every new surface, as the swap
+// interval belongs to the surface.
+internal void
+frame_pacer_attach(frame_pacer *pacer, EGLDisplay display)
+{
+    eglSwapInterval(display, pacer->swap_interval);
+
+    pacer->presentation_time = 0;
+    char *extensions = (char *)eglQueryString(display, EGL_EXTENSIONS);
+    if (extensions && strstr(extensions, "EGL_ANDROID_presentation_time"))
+    {
+        pacer->presentation_time =
+            (egl_presentation_time_android)eglGetProcAddress("eglPresentationTimeANDROID");
+    }
+    pacer->next_present_ns = 0;
+    pacer->last_swap_end_ns = 0;
+}
+
+// The time to ask for the frame being swapped at swap_start_ns to be shown,
+// or 0 to show it as soon as it can be.
+internal int64_t
+frame_pacer_present_time(frame_pacer *pacer, int64_t swap_start_ns)
+{
+    if (pacer->mode == PACING_MANUAL)
+    {
+        pacer->last_present_lag_ns = 0;
+        return 0;
+    }
+
+    // Keep to an even cadence, unless we've fallen behind it; then the frame
+    // goes out as soon as it can and the cadence restarts there.
+    int64_t present_ns = pacer->next_present_ns;
+    if (present_ns < swap_start_ns)
+    {
+        present_ns = swap_start_ns;
+    }
+    else if (present_ns > swap_start_ns + pacer->frame_ns)
+    {
+        present_ns = swap_start_ns + pacer->frame_ns;
+    }
+    pacer->next_present_ns = present_ns + pacer->frame_ns;
+    pacer->last_present_lag_ns = present_ns - swap_start_ns;
+    if (pacer->last_present_lag_ns > pacer->window_max_present_lag_ns)
+    {
+        pacer->window_max_present_lag_ns = pacer->last_present_lag_ns;
+    }
+    return present_ns;
+}
+
+// Returns what eglSwapBuffers did, so the caller can check for a lost
+// context.
+internal bool32
+frame_pacer_swap(frame_pacer *pacer, EGLDisplay display, EGLSurface surface)
+{
+    int64_t swap_start_ns = monotonic_nanoseconds();
+
+    if (pacer->presentation_time)
+    {
+        int64_t present_ns = frame_pacer_present_time(pacer, swap_start_ns);
+        if (present_ns)
+        {
+            pacer->presentation_time(display, surface, present_ns);
+        }
+    }
+
+    bool32 swapped = eglSwapBuffers(display, surface);
+
+    int64_t swap_end_ns = monotonic_nanoseconds();
+    pacer->last_swap_ns = swap_end_ns - swap_start_ns;
+
+    ++pacer->window_frames;
+    pacer->window_swap_ns += pacer->last_swap_ns;
+    if (pacer->last_swap_ns > pacer->window_max_swap_ns)
+    {
+        pacer->window_max_swap_ns = pacer->last_swap_ns;
+    }
+    if (pacer->last_swap_end_ns)
+    {
+        real64 interval_ms = (swap_end_ns - pacer->last_swap_end_ns) / 1.0e6;
+        ++pacer->window_intervals;
+        pacer->window_interval_sum += interval_ms;
+        pacer->window_interval_sum_squares += interval_ms * interval_ms;
+    }
+    pacer->last_swap_end_ns = swap_end_ns;
+    return swapped;
+}
+
+// After a gap in presenting, so the cadence and the intervals start over.
+internal void
+frame_pacer_restart(frame_pacer *pacer)
+{
+    pacer->next_present_ns = 0;
+    pacer->last_swap_end_ns = 0;
+}
+
+// Standard deviation of the swap-to-swap interval, in milliseconds.
+internal real64
+frame_pacer_window_jitter_ms(frame_pacer *pacer)
+{
+    if (pacer->window_intervals < 2)
+    {
+        return 0;
+    }
+    real64 n = pacer->window_intervals;
+    real64 mean = pacer->window_interval_sum / n;
+    real64 variance = (pacer->window_interval_sum_squares - n * mean * mean) / (n - 1);
+    return (variance > 0) ? sqrt(variance) : 0;
+}
+
+internal void
+frame_pacer_reset_window(frame_pacer *pacer)
+{
+    pacer->window_frames = 0;
+    pacer->window_swap_ns = 0;
+    pacer->window_max_swap_ns = 0;
+    pacer->window_max_present_lag_ns = 0;
+    pacer->window_intervals = 0;
+    pacer->window_interval_sum = 0;
+    pacer->window_interval_sum_squares = 0;
+}
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef APP_PROFILER_H
+#define APP_PROFILER_H
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ucontext.h>
+
+#include "app_log.h"
+#include "app_threads.h"
+#include "app_time.h"
+
+// Sampling profiler for one thread, for devices simpleperf can't get at.
+//
+// A timer on the thread's own CPU clock sends it SIGPROF every 1/hz seconds
+// of CPU time it uses, so a thread that's asleep isn't sampled (or woken).
+// The handler takes the interrupted program counter and walks the frame
+// pointer chain for up to PROFILER_MAX_DEPTH return addresses, and puts
+// them in a single producer, single consumer ring.  A drain thread empties
+// the ring into a table of distinct stacks, and on request writes that out
+// as folded stacks ("outer;inner;leaf count" a line, as flamegraph.pl and
+// speedscope take), naming each address with dladdr there rather than in
+// the handler.
+//
+// The kernel only checks CPU timers on its scheduler tick, so the rate
+// actually reached is at most CONFIG_HZ, often 250; it's logged with the
+// profile, along with the handler's share of the thread's CPU time.
+//
+// The walk needs frame pointers, which arm64 keeps by default; elsewhere
+// build with -fno-omit-frame-pointer or stacks stop at the first function
+// without one.  It assumes the frame record is {previous frame, return
+// address}, as on arm64, x86 and clang's 32-bit ARM.  dladdr only sees
+// exported symbols, so static functions come out as library+offset, for
+// addr2line; C++ names come out mangled, for c++filt.
+
+#define PROFILER_MAX_DEPTH 16
+#define PROFILER_RING_SIZE 4096
+#define PROFILER_STACK_TABLE_SIZE 4096
+#define PROFILER_DRAIN_INTERVAL_NS (50 * 1000000)
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+struct profiler_sample
+{
+    uint32 depth;
+    // Innermost first: the interrupted pc, then return addresses.
+    uintptr_t pcs[PROFILER_MAX_DEPTH];
+};
+
+struct profiler_stack
+{
+    uint64 hash;
+    uint32 count;
+    uint32 depth;
+    uintptr_t pcs[PROFILER_MAX_DEPTH];
+};
+
+struct sampling_profiler
+{
+    uint32 hz;
+    pid_t tid;
+    uintptr_t stack_low;
+    uintptr_t stack_high;
+    timer_t timer;
+    bool32 timer_armed;
+    clockid_t cpu_clock;
+    int64_t start_cpu_ns;
+
+    // Written by the handler, read by the drain thread.
+    profiler_sample ring[PROFILER_RING_SIZE];
+    uint32 write_index;
+    uint32 read_index;
+    uint64 samples;
+    uint64 dropped;
+    uint64 handler_ns;
+
+    pthread_t drain_thread;
+    volatile bool32 running;
+    pthread_mutex_t lock;
+    char path[1024];
+    volatile bool32 write_requested;
+
+    // Only touched with lock held.
+    profiler_stack stacks[PROFILER_STACK_TABLE_SIZE];
+    uint32 stack_count;
+    uint64 stacks_dropped;
+};
+
+// There's no way to hand the handler a pointer, and only one thread is
+// profiled at a time.
+global_variable sampling_profiler *global_profiler;
+
+inline bool32
+profiler_frame_ok(sampling_profiler *profiler, uintptr_t frame)
+{
+    return (frame >= profiler->stack_low) && (frame <= profiler->stack_high - 2 * sizeof(uintptr_t)) &&
+        !(frame & (sizeof(uintptr_t) - 1));
+}
+
+internal void
+profiler_on_signal(int signal_number, siginfo_t *info, void *context)
+{
+    sampling_profiler *profiler = global_profiler;
+    if (!profiler)
+    {
+        return;
+    }
+    int saved_errno = errno;
+    int64_t start_ns = monotonic_nanoseconds();
+
+    ucontext_t *ucontext = (ucontext_t *)context;
+#if defined(__aarch64__)
+    uintptr_t pc = (uintptr_t)ucontext->uc_mcontext.pc;
+    uintptr_t frame = (uintptr_t)ucontext->uc_mcontext.regs[29];
+#elif defined(__arm__)
+    uintptr_t pc = (uintptr_t)ucontext->uc_mcontext.arm_pc;
+    uintptr_t frame = (uintptr_t)ucontext->uc_mcontext.arm_fp;
+#elif defined(__x86_64__)
+    uintptr_t pc = (uintptr_t)ucontext->uc_mcontext.gregs[REG_RIP];
+    uintptr_t frame = (uintptr_t)ucontext->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+    uintptr_t pc = (uintptr_t)ucontext->uc_mcontext.gregs[REG_EIP];
+    uintptr_t frame = (uintptr_t)ucontext->uc_mcontext.gregs[REG_EBP];
+#else
+    uintptr_t pc = 0;
+    uintptr_t frame = 0;
+#endif
+
+    uint32 write_index = profiler->write_index;
+    uint32 read_index = __atomic_load_n(&profiler->read_index, __ATOMIC_ACQUIRE);
+    if (write_index - read_index < PROFILER_RING_SIZE)
+    {
+        profiler_sample *sample = &profiler->ring[write_index % PROFILER_RING_SIZE];
+        uint32 depth = 0;
+        sample->pcs[depth++] = pc;
+        // Each frame record has to be further up the stack than the last, so
+        // a bad one can't send us round in circles.
+        while ((depth < PROFILER_MAX_DEPTH) && profiler_frame_ok(profiler, frame))
+        {
+            uintptr_t *record = (uintptr_t *)frame;
+            uintptr_t return_address = record[1];
+            // Code interrupted before it set up its frame leaves whatever was
+            // in the register, which can point at data that isn't a frame;
+            // user space addresses are below 2^48, text usually isn't.
+            if (!return_address || ((uint64)return_address >> 24 >> 24))
+            {
+                break;
+            }
+            sample->pcs[depth++] = return_address;
+            if (record[0] <= frame)
+            {
+                break;
+            }
+            frame = record[0];
+        }
+        sample->depth = depth;
+        __atomic_store_n(&profiler->write_index, write_index + 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        ++profiler->dropped;
+    }
+    ++profiler->samples;
+    profiler->handler_ns += monotonic_nanoseconds() - start_ns;
+    errno = saved_errno;
+}
+
+internal uint64
+profiler_hash(profiler_sample *sample)
+{
+    uint64 hash = 0xcbf29ce484222325ull ^ sample->depth;
+    for (uint32 i = 0; i < sample->depth; ++i)
+    {
+        hash = (hash ^ sample->pcs[i]) * 0x100000001b3ull;
+    }
+    return hash ? hash : 1;
+}
+
+// Moves whatever the handler has left in the ring into the stack table.
+internal void
+profiler_drain(sampling_profiler *profiler)
+{
+    pthread_mutex_lock(&profiler->lock);
+    uint32 read_index = profiler->read_index;
+    uint32 write_index = __atomic_load_n(&profiler->write_index, __ATOMIC_ACQUIRE);
+    for (; read_index != write_index; ++read_index)
+    {
+        profiler_sample *sample = &profiler->ring[read_index % PROFILER_RING_SIZE];
+        uint64 hash = profiler_hash(sample);
+        uint32 slot = (uint32)(hash % PROFILER_STACK_TABLE_SIZE);
+        for (uint32 probe = 0; probe < PROFILER_STACK_TABLE_SIZE; ++probe)
+        {
+            profiler_stack *stack = &profiler->stacks[slot];
+            if (!stack->hash)
+            {
+                // Leave a few free, so probing for a new stack always ends.
+                if (profiler->stack_count >= PROFILER_STACK_TABLE_SIZE - 64)
+                {
+                    ++profiler->stacks_dropped;
+                    break;
+                }
+                stack->hash = hash;
+                stack->depth = sample->depth;
+                memcpy(stack->pcs, sample->pcs, sample->depth * sizeof(uintptr_t));
+                stack->count = 1;
+                ++profiler->stack_count;
+                break;
+            }
+            if ((stack->hash == hash) && (stack->depth == sample->depth) &&
+                !memcmp(stack->pcs, sample->pcs, sample->depth * sizeof(uintptr_t)))
+            {
+                ++stack->count;
+                break;
+            }
+            slot = (slot + 1) % PROFILER_STACK_TABLE_SIZE;
+        }
+    }
+    __atomic_store_n(&profiler->read_index, read_index, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&profiler->lock);
+}
+
+internal void
+profiler_symbol_name(uintptr_t pc, char *name, size_t name_size)
+{
+    Dl_info info = {};
+    if (dladdr((void *)pc, &info) && info.dli_sname)
+    {
+        snprintf(name, name_size, "%s", info.dli_sname);
+    }
+    else if (info.dli_fname)
+    {
+        char *library = strrchr((char *)info.dli_fname, '/');
+        snprintf(name, name_size, "%s+0x%lx", library ? library + 1 : info.dli_fname,
+            (unsigned long)(pc - (uintptr_t)info.dli_fbase));
+    }
+    else
+    {
+        snprintf(name, name_size, "0x%lx", (unsigned long)pc);
+    }
+}
+
+// Writes everything sampled so far; the samples are kept.
+internal bool32
+profiler_write(sampling_profiler *profiler, char *path)
+{
+    profiler_drain(profiler);
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        app_log("Couldn't write profile %s: %s", path, strerror(errno));
+        return 0;
+    }
+
+    pthread_mutex_lock(&profiler->lock);
+    for (uint32 slot = 0; slot < PROFILER_STACK_TABLE_SIZE; ++slot)
+    {
+        profiler_stack *stack = &profiler->stacks[slot];
+        if (!stack->hash)
+        {
+            continue;
+        }
+        // Outermost first.  A return address is just past its call, which
+        // may be in the next function, so look up the byte before it.
+        for (uint32 i = stack->depth; i-- > 0;)
+        {
+            char name[256];
+            profiler_symbol_name(i ? stack->pcs[i] - 1 : stack->pcs[i], name, sizeof(name));
+            fprintf(file, "%s%s", name, i ? ";" : "");
+        }
+        fprintf(file, " %u\n", stack->count);
+    }
+    uint32 stack_count = profiler->stack_count;
+    pthread_mutex_unlock(&profiler->lock);
+    fclose(file);
+
+    uint64 samples = __atomic_load_n(&profiler->samples, __ATOMIC_RELAXED);
+    uint64 handler_ns = __atomic_load_n(&profiler->handler_ns, __ATOMIC_RELAXED);
+    real64 cpu_ns = (real64)(get_nanoseconds(profiler->cpu_clock) - profiler->start_cpu_ns);
+    app_log("Profile %s: %llu samples over %.3f s of CPU time, %.0f Hz of %u asked for, %u stacks, %llu dropped, "
+        "handler %.2f us each, %.3f%% of CPU time",
+        path, (unsigned long long)samples, cpu_ns / 1.0e9, (cpu_ns > 0) ? samples / (cpu_ns / 1.0e9) : 0.0,
+        profiler->hz, stack_count, (unsigned long long)(profiler->dropped + profiler->stacks_dropped),
+        samples ? (handler_ns / 1000.0) / samples : 0.0, (cpu_ns > 0) ? (100.0 * handler_ns) / cpu_ns : 0.0);
+    return 1;
+}
+
+internal void *
+profiler_drain_thread(void *param)
+{
+    sampling_profiler *profiler = (sampling_profiler *)param;
+    while (profiler->running)
+    {
+        sleep_until_nanoseconds(monotonic_nanoseconds() + PROFILER_DRAIN_INTERVAL_NS);
+        profiler_drain(profiler);
+        if (profiler->write_requested)
+        {
+            profiler->write_requested = 0;
+            profiler_write(profiler, profiler->path);
+        }
+    }
+    return 0;
+}
+
+// Starts sampling the calling thread hz times a second of its CPU time.
+// The profile goes to path when profiler_request_write or profiler_stop is
+// called.
+internal bool32
+profiler_start(sampling_profiler *profiler, uint32 hz, char *path)
+{
+    *profiler = {};
+    profiler->hz = hz;
+    profiler->tid = get_thread_id();
+    snprintf(profiler->path, sizeof(profiler->path), "%s", path);
+    pthread_mutex_init(&profiler->lock, 0);
+    // The drain thread reads it for the log line too.
+    if (pthread_getcpuclockid(pthread_self(), &profiler->cpu_clock) != 0)
+    {
+        profiler->cpu_clock = CLOCK_THREAD_CPUTIME_ID;
+    }
+    profiler->start_cpu_ns = get_nanoseconds(profiler->cpu_clock);
+
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0)
+    {
+        void *stack_address = 0;
+        size_t stack_size = 0;
+        pthread_attr_getstack(&attributes, &stack_address, &stack_size);
+        pthread_attr_destroy(&attributes);
+        profiler->stack_low = (uintptr_t)stack_address;
+        profiler->stack_high = (uintptr_t)stack_address + stack_size;
+    }
+    if (!profiler->stack_high)
+    {
+        app_log("Couldn't find the thread's stack; only leaf functions will be sampled");
+    }
+
+    struct sigaction action = {};
+    action.sa_sigaction = profiler_on_signal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, 0) != 0)
+    {
+        app_log("Couldn't handle SIGPROF: %s", strerror(errno));
+        return 0;
+    }
+
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = profiler->tid;
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &profiler->timer) != 0)
+    {
+        app_log("Couldn't create the profiling timer: %s", strerror(errno));
+        return 0;
+    }
+
+    profiler->running = 1;
+    pthread_create(&profiler->drain_thread, 0, profiler_drain_thread, profiler);
+    global_profiler = profiler;
+
+    struct itimerspec interval = {};
+    interval.it_interval.tv_nsec = 1000000000 / hz;
+    interval.it_value = interval.it_interval;
+    timer_settime(profiler->timer, 0, &interval, 0);
+    profiler->timer_armed = 1;
+    return 1;
+}
+
+inline bool32
+profiler_enabled(sampling_profiler *profiler)
+{
+    return profiler && profiler->timer_armed;
+}
+
+// Has the drain thread write the profile so far, without stopping.
+inline void
+profiler_request_write(sampling_profiler *profiler)
+{
+    if (profiler_enabled(profiler))
+    {
+        profiler->write_requested = 1;
+    }
+}
+
+// Stops sampling and writes the profile.  Call from the profiled thread.
+internal void
+profiler_stop(sampling_profiler *profiler)
+{
+    if (!profiler_enabled(profiler))
+    {
+        return;
+    }
+    timer_delete(profiler->timer);
+    profiler->timer_armed = 0;
+    profiler->running = 0;
+    pthread_join(profiler->drain_thread, 0);
+    profiler_write(profiler, profiler->path);
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef APP_THREADS_H
+#define APP_THREADS_H
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// Thread placement.
+//
+// Left to itself the scheduler will happily run the game thread on a little
+// core, or migrate it mid-frame, and that shows up as random frame spikes.
+// We read the core topology out of sysfs once, then pin latency critical
+// threads to the big cores, raise their priority as far as we're allowed,
+// and drop their timer slack so sleeps wake up when asked.  Worker threads
+// get the remaining cores and normal priority.
+
+#define THREAD_MAX_CPUS 32
+
+enum thread_role
+{
+    THREAD_ROLE_GAME,
+    THREAD_ROLE_RENDER,
+    THREAD_ROLE_WORKER,
+};
+
+struct cpu_topology
+{
+    uint32 cpu_count;
+    uint32 capacity[THREAD_MAX_CPUS];
+    uint32 max_frequency_khz[THREAD_MAX_CPUS];
+
+    cpu_set_t big_cores;
+    cpu_set_t little_cores;
+    uint32 big_count;
+    uint32 little_count;
+};
+
+struct thread_placement
+{
+    pid_t tid;
+    thread_role role;
+    bool32 pinned;
+    int nice;
+    bool32 timer_slack_set;
+};
+
+// Reading the counters is a pread and a getrusage, so they're sampled every
+// so many frames rather than every frame.  Which core the frame ended on is
+// read every frame, as sched_getcpu is cheap (a vDSO call where there is
+// one), so a slow frame can be tied to the move that caused it.
+#define THREAD_SCHED_SAMPLE_FRAMES 150
+
+// Scheduler statistics for one thread.
+struct thread_sched_stats
+{
+    int sched_file;
+    uint64_t last_migrations;
+    long last_involuntary_switches;
+    int last_cpu;
+    uint32 frames_since_sample;
+
+    // The core the last frame ended on, and whether that wasn't the one the
+    // frame before it ended on.
+    int frame_cpu;
+    bool32 frame_migrated;
+
+    uint64_t window_frames;
+    uint64_t window_migrations;
+    uint64_t window_migrated_frames;
+    uint64_t window_involuntary_switches;
+};
+
+inline pid_t
+get_thread_id()
+{
+    return (pid_t)syscall(__NR_gettid);
+}
+
+internal bool32
+read_sysfs_uint(char *path, uint32 *value)
+{
+    int file = open(path, O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        return 0;
+    }
+    char text[32];
+    ssize_t length = read(file, text, sizeof(text) - 1);
+    close(file);
+    if (length <= 0)
+    {
+        return 0;
+    }
+    text[length] = 0;
+    *value = (uint32)strtoul(text, 0, 10);
+    return 1;
+}
+
+internal void
+detect_cpu_topology(cpu_topology *topology)
+{
+    *topology = {};
+    CPU_ZERO(&topology->big_cores);
+    CPU_ZERO(&topology->little_cores);
+
+    long configured = sysconf(_SC_NPROCESSORS_CONF);
+    topology->cpu_count = (configured > THREAD_MAX_CPUS) ? THREAD_MAX_CPUS : (uint32)configured;
+
+    // cpu_capacity is the scheduler's own view of relative core performance
+    // (arm big.LITTLE kernels from 4.x); otherwise max frequency is the best
+    // guess we have.
+    uint32 best_capacity = 0;
+    uint32 best_frequency = 0;
+    uint32 least_capacity = 0;
+    uint32 least_frequency = 0;
+    for (uint32 cpu = 0; cpu < topology->cpu_count; ++cpu)
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpu_capacity", cpu);
+        read_sysfs_uint(path, &topology->capacity[cpu]);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", cpu);
+        read_sysfs_uint(path, &topology->max_frequency_khz[cpu]);
+
+        if (topology->capacity[cpu] > best_capacity)
+        {
+            best_capacity = topology->capacity[cpu];
+        }
+        if (topology->max_frequency_khz[cpu] > best_frequency)
+        {
+            best_frequency = topology->max_frequency_khz[cpu];
+        }
+        if (!least_capacity || (topology->capacity[cpu] < least_capacity))
+        {
+            least_capacity = topology->capacity[cpu];
+        }
+        if (!least_frequency || (topology->max_frequency_khz[cpu] < least_frequency))
+        {
+            least_frequency = topology->max_frequency_khz[cpu];
+        }
+    }
+
+    for (uint32 cpu = 0; cpu < topology->cpu_count; ++cpu)
+    {
+        // Anything above the slowest cluster counts as big, so on a
+        // little/mid/prime layout the mid cores aren't left out just because
+        // there's one faster core.
+        bool32 big;
+        if (best_capacity > least_capacity)
+        {
+            big = topology->capacity[cpu] > least_capacity;
+        }
+        else if (best_frequency > least_frequency)
+        {
+            big = topology->max_frequency_khz[cpu] > least_frequency;
+        }
+        else
+        {
+            // Nothing to go on (or a symmetric machine): every core is big.
+            big = 1;
+        }
+
+        if (big)
+        {
+            CPU_SET(cpu, &topology->big_cores);
+            ++topology->big_count;
+        }
+        else
+        {
+            CPU_SET(cpu, &topology->little_cores);
+            ++topology->little_count;
+        }
+    }
+}
+
+// Applies the placement for role to the calling thread.  Every step is best
+// effort; the result says which ones took.
+internal thread_placement
+place_current_thread(cpu_topology *topology, thread_role role)
+{
+    thread_placement result = {};
+    result.tid = get_thread_id();
+    result.role = role;
+
+    cpu_set_t *cores = &topology->big_cores;
+    if ((role == THREAD_ROLE_WORKER) && topology->little_count)
+    {
+        cores = &topology->little_cores;
+    }
+    if (topology->big_count)
+    {
+        result.pinned = sched_setaffinity(result.tid, sizeof(cpu_set_t), cores) == 0;
+    }
+
+    if (role != THREAD_ROLE_WORKER)
+    {
+        // Try for the urgent-display end of the range first and back off
+        // until the kernel's RLIMIT_NICE lets us through.
+        int wanted[] = {-10, -8, -4, -2};
+        for (uint32 i = 0; i < ArrayCount(wanted); ++i)
+        {
+            if (setpriority(PRIO_PROCESS, result.tid, wanted[i]) == 0)
+            {
+                break;
+            }
+        }
+
+        // Slack is in nanoseconds; the default of 50us is enough to make a
+        // frame-paced sleep wake visibly late.
+        result.timer_slack_set = prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0) == 0;
+    }
+    result.nice = getpriority(PRIO_PROCESS, result.tid);
+
+    return result;
+}
+
+internal bool32
+read_thread_migrations(thread_sched_stats *stats, uint64_t *migrations)
+{
+    // se.nr_migrations is only there with CONFIG_SCHED_DEBUG.
+    char text[4096];
+    ssize_t length = pread(stats->sched_file, text, sizeof(text) - 1, 0);
+    if (length <= 0)
+    {
+        return 0;
+    }
+    text[length] = 0;
+    char *line = strstr(text, "se.nr_migrations");
+    char *colon = line ? strchr(line, ':') : 0;
+    if (!colon)
+    {
+        return 0;
+    }
+    *migrations = strtoull(colon + 1, 0, 10);
+    return 1;
+}
+
+internal void
+thread_sched_stats_begin(thread_sched_stats *stats)
+{
+    *stats = {};
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/sched", get_thread_id());
+    stats->sched_file = open(path, O_RDONLY | O_CLOEXEC);
+    if ((stats->sched_file >= 0) && !read_thread_migrations(stats, &stats->last_migrations))
+    {
+        close(stats->sched_file);
+        stats->sched_file = -1;
+    }
+
+    rusage usage = {};
+    getrusage(RUSAGE_THREAD, &usage);
+    stats->last_involuntary_switches = usage.ru_nivcsw;
+    stats->last_cpu = sched_getcpu();
+    stats->frame_cpu = stats->last_cpu;
+}
+
+// Adds everything since the last sample to the window.  Call from the
+// thread being measured.
+internal void
+thread_sched_stats_sample(thread_sched_stats *stats)
+{
+    int cpu = sched_getcpu();
+    uint64_t migrations;
+    if ((stats->sched_file >= 0) && read_thread_migrations(stats, &migrations))
+    {
+        stats->window_migrations += migrations - stats->last_migrations;
+        stats->last_migrations = migrations;
+    }
+    else if (cpu != stats->last_cpu)
+    {
+        // Without the scheduler's counter, the best we can see is whether
+        // we're on a different core than at the last sample.
+        ++stats->window_migrations;
+    }
+    stats->last_cpu = cpu;
+
+    rusage usage = {};
+    getrusage(RUSAGE_THREAD, &usage);
+    stats->window_involuntary_switches += usage.ru_nivcsw - stats->last_involuntary_switches;
+    stats->last_involuntary_switches = usage.ru_nivcsw;
+
+    stats->window_frames += stats->frames_since_sample;
+    stats->frames_since_sample = 0;
+}
+
+// Call once per frame from the thread being measured.
+inline void
+thread_sched_stats_frame(thread_sched_stats *stats)
+{
+    int cpu = sched_getcpu();
+    stats->frame_migrated = (cpu != stats->frame_cpu);
+    stats->frame_cpu = cpu;
+    if (stats->frame_migrated)
+    {
+        ++stats->window_migrated_frames;
+    }
+
+    if (++stats->frames_since_sample >= THREAD_SCHED_SAMPLE_FRAMES)
+    {
+        thread_sched_stats_sample(stats);
+    }
+}
+
+internal void
+thread_sched_stats_reset_window(thread_sched_stats *stats)
+{
+    stats->window_frames = 0;
+    stats->window_migrations = 0;
+    stats->window_migrated_frames = 0;
+    stats->window_involuntary_switches = 0;
+}
+
+#endif
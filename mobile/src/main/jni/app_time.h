@@ -0,0 +1,34 @@
+#ifndef APP_TIME_H
+#define APP_TIME_H
+
+#include <errno.h>
+#include <time.h>
+
+// AInputEvent timestamps are CLOCK_MONOTONIC nanoseconds, so anything that
+// is compared against an input event must use the same clock.
+inline int64_t
+get_nanoseconds(clockid_t clock_id)
+{
+    timespec now = {};
+    clock_gettime(clock_id, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+inline int64_t
+monotonic_nanoseconds()
+{
+    return get_nanoseconds(CLOCK_MONOTONIC);
+}
+
+inline void
+sleep_until_nanoseconds(int64_t deadline_ns)
+{
+    timespec deadline = {};
+    deadline.tv_sec = deadline_ns / 1000000000;
+    deadline.tv_nsec = deadline_ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR)
+    {
+    }
+}
+
+#endif
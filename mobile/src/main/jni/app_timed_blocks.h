@@ -0,0 +1,228 @@
+#ifndef APP_TIMED_BLOCKS_H
+#define APP_TIMED_BLOCKS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "app_game_code.h"
+#include "app_log.h"
+#include "app_time.h"
+#include "game_timed_blocks.h"
+
+// The platform's half of the game's timed blocks (see game_timed_blocks.h).
+//
+// At the end of every frame each block's ticks and hits are taken out of
+// every thread's row and added up, giving the block's time that frame.
+// Those go into a window, logged and started over every so often as min,
+// average and max per frame, and into totals for the session, which end up
+// in the frame stats file.  Frames a block didn't run in don't count
+// towards its min or average.
+
+#if HANDMADE_INTERNAL
+
+struct timed_block_stats
+{
+    uint64 frames;
+    uint64 hits;
+    uint64 ticks;
+    uint64 min_ticks;
+    uint64 max_ticks;
+};
+
+struct timed_block_set
+{
+    timed_block_table table;
+    real64 ns_per_tick;
+    timed_block_stats window[TIMED_BLOCK_MAX_BLOCKS];
+    timed_block_stats session[TIMED_BLOCK_MAX_BLOCKS];
+    uint64 window_frames;
+};
+
+internal real64
+timed_blocks_calibrate(void)
+{
+#if defined(__aarch64__)
+    uint64 frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return frequency ? 1.0e9 / frequency : 1.0;
+#elif defined(__i386__) || defined(__x86_64__)
+    // Long enough for a good ratio, short enough not to hold up startup.
+    int64_t start_ns = monotonic_nanoseconds();
+    uint64 start_ticks = timed_block_ticks();
+    int64_t end_ns;
+    do
+    {
+        end_ns = monotonic_nanoseconds();
+    } while (end_ns - start_ns < 5000000);
+    uint64 ticks = timed_block_ticks() - start_ticks;
+    return ticks ? (real64)(end_ns - start_ns) / ticks : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+// Starts counting the game code built into the platform; shared library
+// builds are added with timed_blocks_attach.
+internal void
+timed_blocks_init(timed_block_set *blocks)
+{
+    *blocks = {};
+    blocks->ns_per_tick = timed_blocks_calibrate();
+    GameAttachTimedBlocks(&blocks->table);
+}
+
+// Hands the table to every game code shared library that takes it.
+internal void
+timed_blocks_attach(timed_block_set *blocks, game_code_set *set)
+{
+    for (uint32 index = 0; index < set->count; ++index)
+    {
+        if (set->variants[index].attach_timed_blocks)
+        {
+            set->variants[index].attach_timed_blocks(&blocks->table);
+        }
+    }
+}
+
+internal void
+timed_block_stats_add(timed_block_stats *stats, uint64 ticks, uint64 hits)
+{
+    if (!stats->frames || (ticks < stats->min_ticks))
+    {
+        stats->min_ticks = ticks;
+    }
+    if (ticks > stats->max_ticks)
+    {
+        stats->max_ticks = ticks;
+    }
+    ++stats->frames;
+    stats->hits += hits;
+    stats->ticks += ticks;
+}
+
+// Call at the end of every frame.
+internal void
+timed_blocks_collect(timed_block_set *blocks)
+{
+    timed_block_table *table = &blocks->table;
+    uint32 block_count = __atomic_load_n(&table->block_count, __ATOMIC_ACQUIRE);
+    uint32 thread_count = __atomic_load_n(&table->thread_count, __ATOMIC_RELAXED);
+    if (thread_count > TIMED_BLOCK_MAX_THREADS)
+    {
+        thread_count = TIMED_BLOCK_MAX_THREADS;
+    }
+    for (uint32 slot = 0; slot < block_count; ++slot)
+    {
+        uint64 ticks = 0;
+        uint64 hits = 0;
+        for (uint32 thread = 0; thread < thread_count; ++thread)
+        {
+            timed_block_counter *counter = &table->counters[thread][slot];
+            if (__atomic_load_n(&counter->hits, __ATOMIC_RELAXED))
+            {
+                ticks += __atomic_exchange_n(&counter->ticks, 0, __ATOMIC_RELAXED);
+                hits += __atomic_exchange_n(&counter->hits, 0, __ATOMIC_RELAXED);
+            }
+        }
+        if (hits)
+        {
+            timed_block_stats_add(&blocks->window[slot], ticks, hits);
+            timed_block_stats_add(&blocks->session[slot], ticks, hits);
+        }
+    }
+    ++blocks->window_frames;
+}
+
+// Logs each block since the last log, then starts over.
+internal void
+timed_blocks_log(timed_block_set *blocks)
+{
+    uint32 block_count = __atomic_load_n(&blocks->table.block_count, __ATOMIC_ACQUIRE);
+    if (!block_count || !blocks->window_frames)
+    {
+        return;
+    }
+    real64 ms_per_tick = blocks->ns_per_tick / 1.0e6;
+    app_log("Timed blocks over %llu frames, ms per frame it ran:", (unsigned long long)blocks->window_frames);
+    for (uint32 slot = 0; slot < block_count; ++slot)
+    {
+        timed_block_stats *stats = &blocks->window[slot];
+        if (!stats->frames)
+        {
+            continue;
+        }
+        app_log("  %-24s min %.3f avg %.3f max %.3f, %llu frames, %.1f hits each",
+            blocks->table.names[slot], stats->min_ticks * ms_per_tick,
+            (real64)stats->ticks / stats->frames * ms_per_tick, stats->max_ticks * ms_per_tick,
+            (unsigned long long)stats->frames, (real64)stats->hits / stats->frames);
+    }
+    memset(blocks->window, 0, sizeof(blocks->window));
+    blocks->window_frames = 0;
+}
+
+// Adds a line per block for the session to a frame stats file;
+// frame_stats_read skips them.
+internal bool32
+timed_blocks_write(timed_block_set *blocks, char *path)
+{
+    uint32 block_count = __atomic_load_n(&blocks->table.block_count, __ATOMIC_ACQUIRE);
+    if (!block_count)
+    {
+        return 1;
+    }
+    FILE *file = fopen(path, "a");
+    if (!file)
+    {
+        return 0;
+    }
+    for (uint32 slot = 0; slot < block_count; ++slot)
+    {
+        timed_block_stats *stats = &blocks->session[slot];
+        if (stats->frames)
+        {
+            fprintf(file, "timed_block name=%s frames=%llu hits=%llu min_ns=%.0f avg_ns=%.0f max_ns=%.0f\n",
+                blocks->table.names[slot], (unsigned long long)stats->frames, (unsigned long long)stats->hits,
+                stats->min_ticks * blocks->ns_per_tick, (real64)stats->ticks / stats->frames * blocks->ns_per_tick,
+                stats->max_ticks * blocks->ns_per_tick);
+        }
+    }
+    bool32 result = !ferror(file);
+    result = (fclose(file) == 0) && result;
+    return result;
+}
+
+#else
+
+struct timed_block_set
+{
+};
+
+inline void
+timed_blocks_init(timed_block_set *blocks)
+{
+}
+
+inline void
+timed_blocks_attach(timed_block_set *blocks, game_code_set *set)
+{
+}
+
+inline void
+timed_blocks_collect(timed_block_set *blocks)
+{
+}
+
+inline void
+timed_blocks_log(timed_block_set *blocks)
+{
+}
+
+inline bool32
+timed_blocks_write(timed_block_set *blocks, char *path)
+{
+    return 1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef GAME_TIMED_BLOCKS_H
+#define GAME_TIMED_BLOCKS_H
+
+// Timed blocks, for the game code to time its own hot spots.  This is the
+// half the game includes; the platform collects the counts with
+// app_timed_blocks.h.
+//
+//     BEGIN_TIMED_BLOCK(DrawRectangle);
+//     ...
+//     END_TIMED_BLOCK(DrawRectangle);
+//
+// The first time a block runs it's given a slot in the platform's table,
+// by name, so the same block in two game code builds lands in the same slot.
+// After that, ending a block is two relaxed atomic adds to the calling
+// thread's own row: ticks and hits.  Blocks on other threads (say, a render
+// worker) are counted in their own rows and summed by the platform.
+//
+// Ticks are the time stamp counter on x86 and the virtual counter on arm64
+// (a fixed frequency, as the cycle counter isn't readable from user space);
+// anywhere else, nanoseconds.  The platform converts them.
+//
+// game_memory's layout is the game's, so the table isn't passed in there.
+// The game code built into the platform shares the platform's pointer to it;
+// a game code shared library gets it through GameAttachTimedBlocks, which
+// the platform calls if the library exports it.
+//
+// Without HANDMADE_INTERNAL the macros are empty and none of this exists.
+
+#if HANDMADE_INTERNAL
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define TIMED_BLOCK_MAX_BLOCKS 64
+// Threads past this share the last row.
+#define TIMED_BLOCK_MAX_THREADS 8
+
+struct timed_block_counter
+{
+    uint64 ticks;
+    uint64 hits;
+};
+
+struct timed_block_table
+{
+    // Taken while a block is given its slot.
+    bool32 lock;
+    uint32 block_count;
+    uint32 thread_count;
+    char names[TIMED_BLOCK_MAX_BLOCKS][32];
+    timed_block_counter counters[TIMED_BLOCK_MAX_THREADS][TIMED_BLOCK_MAX_BLOCKS];
+};
+
+global_variable timed_block_table *global_timed_blocks;
+global_variable __thread uint32 timed_block_thread_row;
+
+extern "C" __attribute__((visibility("default"))) void
+GameAttachTimedBlocks(timed_block_table *table)
+{
+    global_timed_blocks = table;
+}
+
+inline uint64
+timed_block_ticks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64 ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+// TIMED_BLOCK_MAX_BLOCKS if there's no table, or no room in it.
+internal uint32
+timed_block_register(char *name)
+{
+    timed_block_table *table = global_timed_blocks;
+    if (!table)
+    {
+        return TIMED_BLOCK_MAX_BLOCKS;
+    }
+
+    while (__atomic_exchange_n(&table->lock, 1, __ATOMIC_ACQUIRE))
+    {
+    }
+    uint32 slot = 0;
+    while ((slot < table->block_count) && strcmp(table->names[slot], name))
+    {
+        ++slot;
+    }
+    if ((slot == table->block_count) && (slot < TIMED_BLOCK_MAX_BLOCKS))
+    {
+        snprintf(table->names[slot], sizeof(table->names[slot]), "%s", name);
+        // The platform reads the count without the lock.
+        __atomic_store_n(&table->block_count, slot + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&table->lock, 0, __ATOMIC_RELEASE);
+    return slot;
+}
+
+inline void
+timed_block_record(uint32 slot, uint64 ticks)
+{
+    timed_block_table *table = global_timed_blocks;
+    if (!table || (slot >= TIMED_BLOCK_MAX_BLOCKS))
+    {
+        return;
+    }
+    if (!timed_block_thread_row)
+    {
+        uint32 row = __atomic_fetch_add(&table->thread_count, 1, __ATOMIC_RELAXED);
+        timed_block_thread_row = ((row < TIMED_BLOCK_MAX_THREADS) ? row : (TIMED_BLOCK_MAX_THREADS - 1)) + 1;
+    }
+    timed_block_counter *counter = &table->counters[timed_block_thread_row - 1][slot];
+    __atomic_fetch_add(&counter->ticks, ticks, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->hits, 1, __ATOMIC_RELAXED);
+}
+
+#define BEGIN_TIMED_BLOCK(ID) \
+    local_persist uint32 timed_block_slot_##ID = timed_block_register((char *)#ID); \
+    uint64 timed_block_start_##ID = timed_block_ticks()
+#define END_TIMED_BLOCK(ID) \
+    timed_block_record(timed_block_slot_##ID, timed_block_ticks() - timed_block_start_##ID)
+
+#else
+
+#define BEGIN_TIMED_BLOCK(ID)
+#define END_TIMED_BLOCK(ID)
+
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Builds the Linux host platform layer, and the multi-instance soak runner,
+# into mobile/build/linux.
+#
+# Needs the Handmade Hero sources in mobile/src/main/handmade (as for the
+# Android build) and Mesa's EGL/GLESv2 development packages.  Extra compiler
+# flags can be passed through, e.g. ./build.sh -fsanitize=address.
+#
+# With GAME_SO=name set, builds the game code alone into
+# mobile/build/linux/name.so instead, to load with --game.  The flags then
+# apply to the game, e.g. GAME_SO=game_O3 ./build.sh -O3.  jni is on the
+# include path for game_timed_blocks.h.
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+main="$here/.."
+out="$main/../../build/linux"
+mkdir -p "$out"
+
+if [ -n "$GAME_SO" ]; then
+    ${CXX:-c++} -std=c++11 -O2 -g -shared -fPIC \
+        -DHANDMADE_SLOW=1 -DHANDMADE_INTERNAL=1 \
+        -Wno-write-strings \
+        -I"$main/handmade" -I"$main/jni" \
+        "$main/handmade/handmade.cpp" -o "$out/$GAME_SO.so" \
+        "$@" \
+        -lm
+    exit 0
+fi
+
+# Frame pointers, so --profile gets whole stacks.
+${CXX:-c++} -std=c++11 -O2 -g -fno-omit-frame-pointer \
+    -DHANDMADE_SLOW=1 -DHANDMADE_INTERNAL=1 \
+    -Wno-write-strings \
+    -I"$main/handmade" -I"$main/jni" \
+    "$here/linux_app.cpp" -o "$out/handmade_linux" \
+    "$@" \
+    -lEGL -lGLESv2 -lpthread -lm -ldl
+
+${CXX:-c++} -std=c++11 -O2 -g \
+    -DHANDMADE_SLOW=1 -DHANDMADE_INTERNAL=1 \
+    -Wno-write-strings \
+    -I"$main/handmade" -I"$main/jni" \
+    "$here/linux_soak.cpp" -o "$out/handmade_soak" \
+    "$@" \
+    -lEGL -lGLESv2 -lpthread -lm
@@ -0,0 +1,732 @@
+// Linux host platform layer.
+//
+// Runs the same game code over the same game_memory / game_input /
+// game_offscreen_buffer contract and frame loop as the Android platform layer
+// in ../jni/app.cpp, so that platform experiments can use host profilers and
+// sanitizers instead of a device round-trip.  Assets are read straight out of
+// mobile/src/main/assets.  Build with build.sh next to this file.
+//
+// Presentation modes:
+//   headless   simulate only, nothing is presented
+//   offscreen  the frame is copied into a host-memory front buffer, standing
+//              in for the texture upload
+//   egl        Mesa's surfaceless EGL platform, drawing through the same
+//              GLES2 path as the device into a pbuffer, by default the
+//              game's size; --output 3840x2160 --scale sharp is a 4K TV
+//
+// --pacing picks the game's update rate as on the device, but a pbuffer swap
+// never waits for a vblank, so the host always paces with a sleep.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+
+#include "handmade_platform.h"
+
+#include "handmade.cpp"
+
+#include "app_audio.h"
+#include "app_counters.h"
+#include "app_flight.h"
+#include "app_frame.h"
+#include "app_frame_stats.h"
+#include "app_game_code.h"
+#include "app_gl.h"
+#include "app_gl_tune.h"
+#include "app_hot_path.h"
+#include "app_input.h"
+#include "app_latency.h"
+#include "app_memory.h"
+#include "app_mixer.h"
+#include "app_overlay.h"
+#include "app_persist.h"
+#include "app_present.h"
+#include "app_profiler.h"
+#include "app_threads.h"
+#include "app_timed_blocks.h"
+
+#include "linux_egl.h"
+#include "linux_files.h"
+
+enum present_mode
+{
+    PRESENT_HEADLESS,
+    PRESENT_OFFSCREEN,
+    PRESENT_EGL,
+};
+
+struct linux_options
+{
+    present_mode present;
+    char *asset_root;
+    uint64_t frame_limit;
+    bool32 unpaced;
+    bool32 late_latch;
+    pacing_mode pacing;
+    upload_strategy upload;
+    scale_mode scale;
+    int32 output_width;
+    int32 output_height;
+    bool32 upload_tuning;
+    char *upload_cache_path;
+    char *program_cache_path;
+    bool32 synthetic_input;
+    bool32 overlay;
+    char *audio_path;
+    char *dump_path;
+    char *frame_stats_path;
+    char *persist_path;
+    char *flight_path;
+    char *profile_path;
+    uint32 profile_hz;
+    bool32 counters;
+    bool32 hot_path;
+    char *game_paths[GAME_CODE_MAX_VARIANTS - 1];
+    uint32 game_path_count;
+    uint64_t game_swap_frames;
+};
+
+struct linux_state
+{
+    linux_options options;
+
+    platform_memory memory;
+    uint8_t *texture_buffer;
+    uint16 *rgb565_buffer;
+    uint8_t *front_buffer;
+
+    linux_egl egl;
+    gl_presenter gl;
+    gl_program_cache program_cache;
+    frame_pacer pacer;
+
+    game_input *new_input;
+    game_input *old_input;
+
+    audio_output audio;
+    audio_mixer mixer;
+    mixer_stream *game_sound;
+
+    cpu_topology topology;
+    thread_placement game_thread;
+    thread_sched_stats game_thread_sched;
+
+    latency_probe latency;
+    late_latch_state latch;
+    synthetic_input_injector synthetic_input;
+
+    frame_stats frames;
+    perf_overlay overlay;
+    game_code_set games;
+    persistent_storage persist;
+    flight_recorder flight;
+    sampling_profiler *profiler;
+    perf_counters counters;
+    hot_path_tracker hot_path;
+    timed_block_set timed_blocks;
+};
+
+internal bool32
+egl_init(linux_state *s)
+{
+    int64_t init_start_ns = monotonic_nanoseconds();
+    if (!linux_egl_init(&s->egl, s->options.output_width, s->options.output_height))
+    {
+        return 0;
+    }
+    app_log("EGL: %s, %s, %dx%d %s", glGetString(GL_RENDERER), glGetString(GL_VERSION),
+        s->options.output_width, s->options.output_height, scale_mode_names[s->options.scale]);
+
+    frame_pacer_attach(&s->pacer, s->egl.display);
+
+    glViewport(0, 0, s->options.output_width, s->options.output_height);
+    gl_program_cache_init(&s->program_cache, s->options.program_cache_path, &s->memory.scratch);
+    if (s->options.upload_tuning)
+    {
+        struct utsname host;
+        char device[512] = "linux";
+        if (uname(&host) == 0)
+        {
+            snprintf(device, sizeof(device), "%s %s %s", host.sysname, host.release, host.machine);
+        }
+        upload_tuning tuning = upload_tune(s->options.upload_cache_path, device, s->options.upload, s->texture_buffer,
+            s->rgb565_buffer, &s->program_cache);
+        s->options.upload = tuning.strategy;
+
+        char name[32];
+        upload_strategy_name(tuning.strategy, name, sizeof(name));
+        app_log("Upload %s, %.3f ms a frame (%s)", name, tuning.frame_ns / 1.0e6,
+            tuning.from_cache ? "cached" : "probed");
+    }
+    gl_presenter_init(&s->gl, s->texture_buffer, s->rgb565_buffer, s->options.upload, s->options.scale,
+        &s->program_cache);
+    gl_presenter_set_output(&s->gl, s->options.output_width, s->options.output_height);
+
+    app_log("EGL init took %.3f ms, program cache %s (%u hits, %u misses)",
+        (monotonic_nanoseconds() - init_start_ns) / 1.0e6,
+        gl_program_cache_enabled(&s->program_cache) ? "on" : "off", s->program_cache.hits, s->program_cache.misses);
+    return 1;
+}
+
+internal frame_poll
+poll_input(void *platform, game_input *new_input, game_input *old_input)
+{
+    linux_state *s = (linux_state *)platform;
+    frame_poll result = {};
+    if (s->options.synthetic_input)
+    {
+        synthetic_input_event synthetic_event;
+        while (synthetic_input_next(&s->synthetic_input, &synthetic_event))
+        {
+            ++result.input_events;
+            process_game_key(new_input, synthetic_event.keycode, synthetic_event.is_down);
+            latency_note_input(&s->latency, synthetic_event.event_ns);
+        }
+    }
+    return result;
+}
+
+internal bool32
+present(void *platform, bool32 *swapped)
+{
+    linux_state *s = (linux_state *)platform;
+    switch (s->options.present)
+    {
+        case PRESENT_HEADLESS:
+        {
+            return 0;
+        }
+        case PRESENT_OFFSCREEN:
+        {
+            memcpy(s->front_buffer, s->texture_buffer, 4 * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT);
+            return 1;
+        }
+        case PRESENT_EGL:
+        {
+            gl_presenter_draw(&s->gl, s->texture_buffer);
+            frame_pacer_swap(&s->pacer, s->egl.display, s->egl.surface);
+            *swapped = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Writes the last presented frame as a binary PPM.
+internal void
+dump_frame(linux_state *s, char *path)
+{
+    uint8_t *pixels = s->front_buffer;
+    int width = GAME_BUFFER_WIDTH;
+    int height = GAME_BUFFER_HEIGHT;
+    bool32 rgba = (s->options.present == PRESENT_EGL);
+    if (rgba)
+    {
+        // The whole surface, scaled as it was presented.
+        width = s->options.output_width;
+        height = s->options.output_height;
+        pixels = (uint8_t *)memory_allocate(&s->memory, 4 * width * height);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    else if (s->options.present == PRESENT_HEADLESS)
+    {
+        pixels = s->texture_buffer;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        app_log("Failed to open %s", path);
+        if (rgba)
+        {
+            memory_free(&s->memory, pixels);
+        }
+        return;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; ++y)
+    {
+        // glReadPixels rows run bottom to top.
+        int row = rgba ? (height - 1 - y) : y;
+        uint8_t *pixel = pixels + row * width * 4;
+        for (int x = 0; x < width; ++x, pixel += 4)
+        {
+            // The game writes BGRA; the shader's swizzle has already put
+            // what glReadPixels returns in RGB order.
+            uint8_t rgb[3] = {pixel[rgba ? 0 : 2], pixel[1], pixel[rgba ? 2 : 0]};
+            fwrite(rgb, 1, 3, file);
+        }
+    }
+    fclose(file);
+    if (rgba)
+    {
+        memory_free(&s->memory, pixels);
+    }
+}
+
+internal void
+write_frame_stats(linux_state *s)
+{
+    frame_stats_summary summary = frame_histogram_summarize(&s->frames.histograms[FRAME_STATS_INTERVAL]);
+    app_log("Frame interval over %" PRIu64 " frames: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f ms, %" PRIu64 " jank, %" PRIu64 " big jank",
+        summary.frames, summary.p50_ns / 1.0e6, summary.p90_ns / 1.0e6, summary.p99_ns / 1.0e6,
+        summary.p999_ns / 1.0e6, summary.max_ns / 1.0e6, summary.jank_count, summary.big_jank_count);
+    if (s->options.frame_stats_path && (!frame_stats_write(&s->frames, s->options.frame_stats_path) ||
+            !timed_blocks_write(&s->timed_blocks, s->options.frame_stats_path)))
+    {
+        app_log("Failed to write %s", s->options.frame_stats_path);
+    }
+}
+
+internal void
+usage(char *program)
+{
+    fprintf(stderr,
+        "usage: %s [--present headless|offscreen|egl] [--assets DIR] [--frames N]\n"
+        "          [--unpaced] [--late-latch] [--synthetic-input] [--overlay] [--audio OUT.wav]\n"
+        "          [--pacing manual|vsync|vsync-half] [--upload rgba8|rgb565|auto|STRATEGY]\n"
+        "          [--upload-cache FILE] [--program-cache DIR] [--dump OUT.ppm]\n"
+        "          [--output WIDTHxHEIGHT] [--scale stretch|integer|sharp]\n"
+        "          [--frame-stats OUT.txt] [--game LIB.so]... [--game-swap N]\n"
+        "          [--persist FILE] [--flight FILE] [--profile OUT.folded] [--profile-hz N]\n"
+        "          [--counters] [--hot-path]\n", program);
+}
+
+internal bool32
+parse_options(int argc, char **argv, linux_options *options)
+{
+    options->present = PRESENT_OFFSCREEN;
+    options->asset_root = (char *)"mobile/src/main/assets";
+    options->output_width = GAME_BUFFER_WIDTH;
+    options->output_height = GAME_BUFFER_HEIGHT;
+    options->profile_hz = 1000;
+    for (int i = 1; i < argc; ++i)
+    {
+        char *arg = argv[i];
+        char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+        if (!strcmp(arg, "--present") && value)
+        {
+            if (!strcmp(value, "headless"))
+            {
+                options->present = PRESENT_HEADLESS;
+            }
+            else if (!strcmp(value, "offscreen"))
+            {
+                options->present = PRESENT_OFFSCREEN;
+            }
+            else if (!strcmp(value, "egl"))
+            {
+                options->present = PRESENT_EGL;
+            }
+            else
+            {
+                return 0;
+            }
+            ++i;
+        }
+        else if (!strcmp(arg, "--assets") && value)
+        {
+            options->asset_root = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--frames") && value)
+        {
+            options->frame_limit = strtoull(value, 0, 10);
+            ++i;
+        }
+        else if (!strcmp(arg, "--audio") && value)
+        {
+            options->audio_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--dump") && value)
+        {
+            options->dump_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--pacing") && value)
+        {
+            uint32 mode = 0;
+            while ((mode < PACING_MODE_COUNT) && strcmp(value, pacing_mode_names[mode]))
+            {
+                ++mode;
+            }
+            if (mode == PACING_MODE_COUNT)
+            {
+                return 0;
+            }
+            options->pacing = (pacing_mode)mode;
+            ++i;
+        }
+        else if (!strcmp(arg, "--upload") && value)
+        {
+            if (!strcmp(value, "auto"))
+            {
+                options->upload_tuning = 1;
+            }
+            else if (!strcmp(value, "rgba8"))
+            {
+                options->upload = make_upload_strategy(UPLOAD_RGBA8, UPDATE_SUB_IMAGE);
+            }
+            else if (!strcmp(value, "rgb565"))
+            {
+                options->upload = make_upload_strategy(UPLOAD_RGB565, UPDATE_SUB_IMAGE);
+            }
+            else if (!upload_strategy_parse(value, &options->upload))
+            {
+                return 0;
+            }
+            ++i;
+        }
+        else if (!strcmp(arg, "--output") && value)
+        {
+            if ((sscanf(value, "%dx%d", &options->output_width, &options->output_height) != 2) ||
+                (options->output_width <= 0) || (options->output_height <= 0))
+            {
+                return 0;
+            }
+            ++i;
+        }
+        else if (!strcmp(arg, "--scale") && value)
+        {
+            if (!scale_mode_parse(value, &options->scale))
+            {
+                return 0;
+            }
+            ++i;
+        }
+        else if (!strcmp(arg, "--upload-cache") && value)
+        {
+            options->upload_cache_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--program-cache") && value)
+        {
+            options->program_cache_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--frame-stats") && value)
+        {
+            options->frame_stats_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--persist") && value)
+        {
+            options->persist_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--counters"))
+        {
+            options->counters = 1;
+        }
+        else if (!strcmp(arg, "--hot-path"))
+        {
+            options->hot_path = 1;
+        }
+        else if (!strcmp(arg, "--profile") && value)
+        {
+            options->profile_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--profile-hz") && value)
+        {
+            options->profile_hz = (uint32)strtoul(value, 0, 10);
+            if (!options->profile_hz || (options->profile_hz > 100000))
+            {
+                return 0;
+            }
+            ++i;
+        }
+        else if (!strcmp(arg, "--flight") && value)
+        {
+            options->flight_path = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--game") && value)
+        {
+            if (options->game_path_count == ArrayCount(options->game_paths))
+            {
+                return 0;
+            }
+            options->game_paths[options->game_path_count++] = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--game-swap") && value)
+        {
+            options->game_swap_frames = strtoull(value, 0, 10);
+            ++i;
+        }
+        else if (!strcmp(arg, "--unpaced"))
+        {
+            options->unpaced = 1;
+        }
+        else if (!strcmp(arg, "--overlay"))
+        {
+            options->overlay = 1;
+        }
+        else if (!strcmp(arg, "--late-latch"))
+        {
+            options->late_latch = 1;
+        }
+        else if (!strcmp(arg, "--synthetic-input"))
+        {
+            options->synthetic_input = 1;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    // Big enough that it doesn't fit in the stack comfortably.
+    static linux_state s = {};
+    if (!parse_options(argc, argv, &s.options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    global_asset_root = s.options.asset_root;
+
+#if HANDMADE_SLOW
+    bool32 poison = 1;
+#else
+    bool32 poison = 0;
+#endif
+    if (!platform_memory_init(&s.memory, 8 * 1024 * 1024, 1024 * 1024, poison))
+    {
+        return 1;
+    }
+    global_file_memory = &s.memory;
+    s.texture_buffer = (uint8_t *)memory_push_permanent(&s.memory, 4 * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT,
+        MEMORY_PAGE);
+    s.front_buffer = (uint8_t *)memory_push_permanent(&s.memory, 4 * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT,
+        MEMORY_PAGE);
+    s.rgb565_buffer = (uint16 *)memory_push_permanent(&s.memory, GAME_BUFFER_RGB565_SIZE, MEMORY_PAGE);
+
+    int monitor_refresh_hz = 60;
+    frame_pacer_init(&s.pacer, s.options.pacing, monitor_refresh_hz);
+
+    if ((s.options.present == PRESENT_EGL) && !egl_init(&s))
+    {
+        app_log("Failed to set up EGL presentation");
+        return 1;
+    }
+
+    detect_cpu_topology(&s.topology);
+    s.game_thread = place_current_thread(&s.topology, THREAD_ROLE_GAME);
+    thread_sched_stats_begin(&s.game_thread_sched);
+
+    game_memory m = {};
+    m.PermanentStorageSize = 64 * 1024 * 1024;
+    m.TransientStorageSize = 64 * 1024 * 1024;
+    uint64_t total_size = m.PermanentStorageSize + m.TransientStorageSize;
+    if (s.options.persist_path)
+    {
+        char build_id[] = __DATE__ " " __TIME__;
+        uint64 build_hash = persist_checksum(build_id, sizeof(build_id));
+        if (!persist_open(&s.persist, s.options.persist_path, m.PermanentStorageSize, build_hash))
+        {
+            return 1;
+        }
+        app_log("Persistent storage %s in %.3f ms", s.persist.restored ? "restored" : "started",
+            s.persist.open_ns / 1.0e6);
+    }
+    if (persist_enabled(&s.persist))
+    {
+        m.PermanentStorage = s.persist.storage;
+        m.IsInitialized = s.persist.restored;
+        m.TransientStorage = (uint8_t *)calloc(m.TransientStorageSize, sizeof(uint8));
+    }
+    else
+    {
+        void *game_memory_block = calloc(total_size, sizeof(uint8));
+        m.PermanentStorage = (uint8 *)game_memory_block;
+        m.TransientStorage =
+            (uint8_t *)m.PermanentStorage + m.TransientStorageSize;
+    }
+
+#if HANDMADE_INTERNAL
+    m.DEBUGPlatformReadEntireFile = debug_read_entire_file;
+    m.DEBUGPlatformFreeFileMemory = debug_free_file_memory;
+#endif
+
+    thread_context t = {};
+
+    game_code_init(&s.games, GameUpdateAndRender, GameGetSoundSamples);
+    for (uint32 i = 0; i < s.options.game_path_count; ++i)
+    {
+        if (game_code_add_library(&s.games, s.options.game_paths[i]) < 0)
+        {
+            return 1;
+        }
+    }
+    timed_blocks_init(&s.timed_blocks);
+    timed_blocks_attach(&s.timed_blocks, &s.games);
+
+    game_input input[2] = {};
+    s.new_input = &input[0];
+    s.old_input = &input[1];
+
+    real32 game_update_hz = frame_pacer_update_hz(&s.pacer); // Should almost always be an int...
+    long target_nanoseconds_per_frame = (1000 * 1000 * 1000) / game_update_hz;
+    overlay_init(&s.overlay, target_nanoseconds_per_frame, game_update_hz, s.options.overlay);
+
+    uint32 game_samples_per_second = 48000;
+    uint32 audio_samples_per_second = 48000;
+    uint32 audio_frames_per_update = audio_samples_per_second / game_update_hz;
+    if (s.options.audio_path)
+    {
+        memory_arena *permanent = &s.memory.permanent;
+        if (!audio_allocate(&s.audio, permanent, audio_samples_per_second, 240, 3840, 2 * audio_frames_per_update) ||
+            !mixer_init(&s.mixer, permanent, audio_samples_per_second, 2 * audio_frames_per_update) ||
+            !(s.game_sound = mixer_add_stream(&s.mixer, permanent, game_samples_per_second, 1.0f)) ||
+            !audio_start(&s.audio, s.options.audio_path))
+        {
+            app_log("Failed to start audio output to %s", s.options.audio_path);
+            s.game_sound = 0;
+        }
+    }
+
+    s.latch.enabled = s.options.late_latch && frame_pacer_sleeps(&s.pacer);
+    if (s.options.late_latch && !s.latch.enabled)
+    {
+        app_log("Late latching needs manual pacing, not %s; it's off", pacing_mode_names[s.pacer.mode]);
+    }
+    s.latch.frame_ns = s.pacer.frame_ns;
+    s.latch.margin_ns = 2 * 1000000;
+
+    if (s.options.synthetic_input)
+    {
+        synthetic_input_start(&s.synthetic_input, 22, 50 * 1000000, 400 * 1000000);
+    }
+
+    frame_stats_init(&s.frames, target_nanoseconds_per_frame);
+    if (s.options.flight_path)
+    {
+        char previous_path[1024];
+        snprintf(previous_path, sizeof(previous_path), "%s.prev", s.options.flight_path);
+        flight_open(&s.flight, s.options.flight_path, previous_path);
+    }
+    if (s.options.counters)
+    {
+        perf_counters_open(&s.counters);
+    }
+    if (s.options.hot_path)
+    {
+        hot_path_start(&s.hot_path);
+    }
+    if (s.options.profile_path)
+    {
+        s.profiler = (sampling_profiler *)memory_push_permanent(&s.memory, sizeof(sampling_profiler),
+            MEMORY_CACHE_LINE);
+        if (!s.profiler || !profiler_start(s.profiler, s.options.profile_hz, s.options.profile_path))
+        {
+            app_log("Not profiling");
+        }
+    }
+
+    frame_loop loop = {};
+    loop.platform = &s;
+    loop.poll = poll_input;
+    loop.present = present;
+    loop.thread = &t;
+    loop.storage = &m;
+    loop.memory = &s.memory;
+    loop.texture_buffer = s.texture_buffer;
+    loop.games = &s.games;
+    loop.persist = &s.persist;
+    loop.audio = &s.audio;
+    loop.mixer = &s.mixer;
+    loop.game_sound = s.game_sound;
+    loop.game_samples_per_second = game_samples_per_second;
+    loop.audio_frames_per_update = audio_frames_per_update;
+    loop.overlay = &s.overlay;
+    loop.counters = &s.counters;
+    loop.hot_path = &s.hot_path;
+    loop.timed_blocks = &s.timed_blocks;
+    loop.sched = &s.game_thread_sched;
+    loop.latency = &s.latency;
+    loop.latch = &s.latch;
+    loop.pacer = &s.pacer;
+    loop.frames = &s.frames;
+    loop.flight = &s.flight;
+    loop.target_ns_per_frame = target_nanoseconds_per_frame;
+    loop.game_swap_frames = s.options.game_swap_frames;
+    loop.unpaced = s.options.unpaced;
+
+    int64_t run_start = get_nanoseconds(CLOCK_MONOTONIC_RAW);
+    while (!s.options.frame_limit || (loop.frame_count < s.options.frame_limit))
+    {
+        s.overlay.upload_bytes = (s.options.present == PRESENT_EGL) ? gl_presenter_upload_bytes(&s.gl) :
+            ((s.options.present == PRESENT_OFFSCREEN) ? 4 * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT : 0);
+        frame_step(&loop, s.new_input, s.old_input);
+        if (frame_stats_dump_requested())
+        {
+            write_frame_stats(&s);
+        }
+
+        game_input *temp_input = s.new_input;
+        s.new_input = s.old_input;
+        s.old_input = temp_input;
+    }
+
+    int64_t run_ns = get_nanoseconds(CLOCK_MONOTONIC_RAW) - run_start;
+    profiler_stop(s.profiler);
+    perf_counters_log(&s.counters, overlay_stage_names, OVERLAY_STAGE_COUNT);
+    perf_counters_close(&s.counters);
+    timed_blocks_log(&s.timed_blocks);
+    hot_path_log(&s.hot_path, overlay_stage_names, OVERLAY_STAGE_COUNT);
+
+    if (s.options.synthetic_input)
+    {
+        synthetic_input_stop(&s.synthetic_input);
+    }
+    if (s.game_sound)
+    {
+        app_log("Audio: period %u frames, %u underruns", s.audio.period_frames, s.audio.underruns_seen);
+        audio_stop(&s.audio);
+    }
+    if (s.options.dump_path)
+    {
+        dump_frame(&s, s.options.dump_path);
+    }
+    write_frame_stats(&s);
+    if (persist_enabled(&s.persist))
+    {
+        persist_seal(&s.persist);
+        app_log("Sealed persistent storage in %.3f ms", s.persist.seal_ns / 1.0e6);
+        persist_close(&s.persist);
+    }
+
+    app_log("%" PRIu64 " frames in %.3f s: work avg %.3f ms, max %.3f ms, %" PRIu64 " over budget",
+        loop.frame_count, run_ns / 1.0e9, loop.frame_count ? (loop.total_work_ns / 1.0e6) / loop.frame_count : 0.0,
+        loop.max_work_ns / 1.0e6, loop.over_budget_frames);
+    platform_memory_log(&s.memory);
+    thread_sched_stats_sample(&s.game_thread_sched);
+    app_log("Game thread: %" PRIu64 " migrations, %" PRIu64 " frames on a new cpu, %" PRIu64 " involuntary switches",
+        s.game_thread_sched.window_migrations, s.game_thread_sched.window_migrated_frames,
+        s.game_thread_sched.window_involuntary_switches);
+    if (s.latency.history_count)
+    {
+        latency_summary latency = latency_summarize(&s.latency);
+        app_log("Input latency over %u frames: min %" PRId64 " p50 %" PRId64 " p95 %" PRId64 " max %" PRId64 " us",
+            latency.sample_count, latency.min_ns / 1000, latency.p50_ns / 1000,
+            latency.p95_ns / 1000, latency.max_ns / 1000);
+    }
+    if (s.games.count > 1)
+    {
+        game_code_log_stats(&s.games);
+    }
+
+    return 0;
+}
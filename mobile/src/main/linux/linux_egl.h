@@ -0,0 +1,95 @@
+#ifndef LINUX_EGL_H
+#define LINUX_EGL_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// A GLES2 context on an offscreen pbuffer, for running the device's GL path
+// on a host.
+
+struct linux_egl
+{
+    EGLDisplay display;
+    EGLConfig config;
+    EGLSurface surface;
+    EGLContext context;
+};
+
+internal bool32
+linux_egl_init(linux_egl *egl, int width, int height)
+{
+    // The surfaceless platform needs no X or Wayland server, which is what
+    // we want on build machines.
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    egl->display = EGL_NO_DISPLAY;
+    if (get_platform_display)
+    {
+        egl->display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+    }
+    if (egl->display == EGL_NO_DISPLAY)
+    {
+        egl->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (!eglInitialize(egl->display, 0, 0))
+    {
+        return 0;
+    }
+
+    int attrib_list[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+
+    int num_config;
+    if (!eglChooseConfig(egl->display, attrib_list, &egl->config, 1, &num_config) || !num_config)
+    {
+        return 0;
+    }
+
+    int surface_attribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+    egl->surface = eglCreatePbufferSurface(egl->display, egl->config, surface_attribs);
+
+    const int context_attribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+    eglBindAPI(EGL_OPENGL_ES_API);
+    egl->context = eglCreateContext(egl->display, egl->config, EGL_NO_CONTEXT, context_attribs);
+    if (!eglMakeCurrent(egl->display, egl->surface, egl->surface, egl->context))
+    {
+        return 0;
+    }
+    return 1;
+}
+
+// A new pbuffer of another size for the same context, as a window of another
+// size would be; objects made in the context carry over.
+internal bool32
+linux_egl_resize(linux_egl *egl, int width, int height)
+{
+    int surface_attribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+    EGLSurface surface = eglCreatePbufferSurface(egl->display, egl->config, surface_attribs);
+    if ((surface == EGL_NO_SURFACE) || !eglMakeCurrent(egl->display, surface, surface, egl->context))
+    {
+        return 0;
+    }
+    eglDestroySurface(egl->display, egl->surface);
+    egl->surface = surface;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef LINUX_FILES_H
+#define LINUX_FILES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app_memory.h"
+
+// The host's stand-in for the APK's asset manager: files are read from a
+// directory holding the same tree as mobile/src/main/assets.  The game only
+// reads files in HANDMADE_INTERNAL builds, as the calls are debug ones.
+
+global_variable char *global_asset_root;
+// Where file contents come from; malloc when unset.  The pools aren't
+// thread safe, so the soak runner leaves it unset.
+global_variable platform_memory *global_file_memory;
+
+#if HANDMADE_INTERNAL
+
+internal void *
+allocate_file_memory(size_t size)
+{
+    return global_file_memory ? memory_allocate(global_file_memory, size) : malloc(size);
+}
+
+DEBUG_PLATFORM_READ_ENTIRE_FILE(debug_read_entire_file)
+{
+    debug_read_file_result result = {};
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", global_asset_root, Filename);
+    FILE *file = fopen(path, "rb");
+    if (file == 0)
+    {
+        app_log("Failed to open file %s", path);
+        return result;
+    }
+
+    fseek(file, 0, SEEK_END);
+    uint64_t file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buf = (char *)allocate_file_memory(file_size + 1);
+    if (fread(buf, 1, file_size, file) != file_size)
+    {
+        app_log("Short read on %s", path);
+    }
+    fclose(file);
+
+    buf[file_size] = 0;
+
+    result.Contents = buf;
+    result.ContentsSize = file_size;
+
+    return(result);
+}
+
+DEBUG_PLATFORM_FREE_FILE_MEMORY(debug_free_file_memory)
+{
+    if (global_file_memory)
+    {
+        memory_free(global_file_memory, Memory);
+    }
+    else
+    {
+        free(Memory);
+    }
+}
+
+#endif
+
+#endif
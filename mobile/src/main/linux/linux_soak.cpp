@@ -0,0 +1,386 @@
+// Many game instances at once, for soak and throughput testing.
+//
+// Each instance is a thread with its own game_memory, thread_context,
+// game_input and offscreen buffer, running the game headless and unpaced
+// under a scripted input sequence.  The script is seeded per instance, so a
+// run can be repeated exactly.  At the end the aggregate frame rate and each
+// instance's work time percentiles are printed.
+//
+// With --scaling the same run is repeated with 1, 2, 4, ... instances up to
+// --instances, and each pass's aggregate rate is reported against the
+// single-instance one.  Where that efficiency falls off before the core
+// count runs out, the instances are usually fighting over memory bandwidth
+// (each frame writes a 2 MB buffer and touches game memory).
+//
+// The game code must not keep mutable globals for this to be meaningful;
+// everything it keeps should live in game_memory.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "handmade_platform.h"
+
+#include "handmade.cpp"
+
+#include "app_frame_stats.h"
+#include "app_gl.h"
+#include "app_input.h"
+#include "app_log.h"
+#include "app_time.h"
+
+#include "linux_files.h"
+
+#define SOAK_MAX_INSTANCES 256
+
+struct soak_options
+{
+    char *asset_root;
+    uint32 instance_count;
+    uint64_t frame_count;
+    uint32 seed;
+    bool32 pin;
+    bool32 sound;
+    bool32 scaling;
+    bool32 verbose;
+};
+
+struct soak_instance
+{
+    uint32 index;
+    soak_options *options;
+    pthread_barrier_t *start_barrier;
+    pthread_t thread;
+
+    game_memory memory;
+    thread_context context;
+    game_input input[2];
+    uint8_t *buffer;
+    int16 *samples;
+    uint32 random;
+
+    bool32 pinned;
+    uint64_t frames;
+    int64_t run_ns;
+    frame_histogram work;
+};
+
+struct soak_pass
+{
+    uint32 instance_count;
+    int64_t wall_ns;
+    uint64_t frames;
+    real64 frames_per_second;
+    int64_t worst_p99_ns;
+    int64_t worst_max_ns;
+};
+
+// xorshift32; the script has to be the same on every run and platform.
+inline uint32
+soak_random(soak_instance *instance)
+{
+    uint32 x = instance->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    instance->random = x;
+    return x;
+}
+
+// Holds a direction for a while, then another, with the odd frame of
+// nothing, like a player wandering about.
+internal void
+soak_script_input(soak_instance *instance, game_input *input)
+{
+    int keycodes[] = {19, 20, 21, 22};
+    if ((soak_random(instance) % 8) == 0)
+    {
+        for (uint32 i = 0; i < ArrayCount(keycodes); ++i)
+        {
+            process_game_key(input, keycodes[i], 0);
+        }
+        if (soak_random(instance) % 4)
+        {
+            process_game_key(input, keycodes[soak_random(instance) % ArrayCount(keycodes)], 1);
+        }
+    }
+}
+
+internal void *
+soak_run_instance(void *data)
+{
+    soak_instance *instance = (soak_instance *)data;
+    soak_options *options = instance->options;
+
+    if (options->pin)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(instance->index % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+        instance->pinned = (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0);
+    }
+
+    // The budget only decides what counts as jank.
+    real32 game_update_hz = 30;
+    int64_t target_nanoseconds_per_frame = (int64_t)(1.0e9 / game_update_hz);
+    uint32 samples_per_second = 48000;
+    uint32 samples_per_update = samples_per_second / game_update_hz;
+
+    game_input *new_input = &instance->input[0];
+    game_input *old_input = &instance->input[1];
+
+    pthread_barrier_wait(instance->start_barrier);
+    int64_t run_start_ns = monotonic_nanoseconds();
+    for (uint64_t frame = 0; frame < options->frame_count; ++frame)
+    {
+        int64_t start_ns = monotonic_nanoseconds();
+
+        begin_keyboard_controller(new_input, old_input);
+        soak_script_input(instance, new_input);
+        new_input->dtForFrame = 1.0f / game_update_hz;
+
+        game_offscreen_buffer game_buffer = {};
+        game_buffer.Memory = instance->buffer;
+        game_buffer.Width = GAME_BUFFER_WIDTH;
+        game_buffer.Height = GAME_BUFFER_HEIGHT;
+        game_buffer.Pitch = GAME_BUFFER_WIDTH * 4;
+        game_buffer.BytesPerPixel = 4;
+        GameUpdateAndRender(&instance->context, &instance->memory, new_input, &game_buffer);
+
+        if (options->sound)
+        {
+            game_sound_output_buffer sound_buffer = {};
+            sound_buffer.SamplesPerSecond = samples_per_second;
+            sound_buffer.SampleCount = samples_per_update;
+            sound_buffer.Samples = instance->samples;
+            GameGetSoundSamples(&instance->context, &instance->memory, &sound_buffer);
+        }
+
+        frame_histogram_add(&instance->work, target_nanoseconds_per_frame, monotonic_nanoseconds() - start_ns);
+        ++instance->frames;
+
+        game_input *temp_input = new_input;
+        new_input = old_input;
+        old_input = temp_input;
+    }
+    instance->run_ns = monotonic_nanoseconds() - run_start_ns;
+    return 0;
+}
+
+internal bool32
+soak_init_instance(soak_instance *instance, uint32 index, soak_options *options, pthread_barrier_t *start_barrier)
+{
+    *instance = {};
+    instance->index = index;
+    instance->options = options;
+    instance->start_barrier = start_barrier;
+    // Never zero, or xorshift stays there.
+    instance->random = (options->seed * 2654435761u + index + 1) | 1;
+
+    game_memory *m = &instance->memory;
+    m->PermanentStorageSize = 64 * 1024 * 1024;
+    m->TransientStorageSize = 64 * 1024 * 1024;
+    uint64_t total_size = m->PermanentStorageSize + m->TransientStorageSize;
+    m->PermanentStorage = calloc(total_size, sizeof(uint8));
+    m->TransientStorage = (uint8_t *)m->PermanentStorage + m->PermanentStorageSize;
+#if HANDMADE_INTERNAL
+    m->DEBUGPlatformReadEntireFile = debug_read_entire_file;
+    m->DEBUGPlatformFreeFileMemory = debug_free_file_memory;
+#endif
+
+    instance->buffer = (uint8_t *)calloc(4 * GAME_BUFFER_WIDTH * GAME_BUFFER_HEIGHT, 1);
+    // Stereo, with room for a long update.
+    instance->samples = (int16 *)calloc(2 * 48000, sizeof(int16));
+    return m->PermanentStorage && instance->buffer && instance->samples;
+}
+
+internal void
+soak_free_instance(soak_instance *instance)
+{
+    free(instance->memory.PermanentStorage);
+    free(instance->buffer);
+    free(instance->samples);
+}
+
+internal bool32
+soak_run_pass(soak_options *options, uint32 instance_count, soak_pass *pass)
+{
+    soak_instance *instances = (soak_instance *)calloc(instance_count, sizeof(soak_instance));
+    pthread_barrier_t start_barrier;
+    pthread_barrier_init(&start_barrier, 0, instance_count);
+
+    bool32 ok = (instances != 0);
+    for (uint32 i = 0; ok && (i < instance_count); ++i)
+    {
+        ok = soak_init_instance(&instances[i], i, options, &start_barrier);
+    }
+    if (!ok)
+    {
+        app_log("Failed to allocate %u instances", instance_count);
+    }
+
+    uint32 started = 0;
+    int64_t start_ns = monotonic_nanoseconds();
+    while (ok && (started < instance_count))
+    {
+        ok = (pthread_create(&instances[started].thread, 0, soak_run_instance, &instances[started]) == 0);
+        started += ok ? 1 : 0;
+    }
+    if (!ok && started)
+    {
+        // The rest are waiting at the barrier for threads that will never
+        // come; there's no getting them out cleanly.
+        app_log("Failed to start instance %u", started);
+        exit(1);
+    }
+    for (uint32 i = 0; i < started; ++i)
+    {
+        pthread_join(instances[i].thread, 0);
+    }
+
+    *pass = {};
+    pass->instance_count = instance_count;
+    pass->wall_ns = monotonic_nanoseconds() - start_ns;
+    for (uint32 i = 0; ok && (i < instance_count); ++i)
+    {
+        soak_instance *instance = &instances[i];
+        frame_stats_summary work = frame_histogram_summarize(&instance->work);
+        pass->frames += instance->frames;
+        if (work.p99_ns > pass->worst_p99_ns)
+        {
+            pass->worst_p99_ns = work.p99_ns;
+        }
+        if (work.max_ns > pass->worst_max_ns)
+        {
+            pass->worst_max_ns = work.max_ns;
+        }
+        if (options->verbose || !options->scaling)
+        {
+            app_log("Instance %u%s: %" PRIu64 " frames at %.1f/s, work p50 %.2f p99 %.2f p99.9 %.2f max %.2f ms",
+                i, instance->pinned ? " (pinned)" : "", instance->frames,
+                instance->frames / (instance->run_ns / 1.0e9), work.p50_ns / 1.0e6, work.p99_ns / 1.0e6,
+                work.p999_ns / 1.0e6, work.max_ns / 1.0e6);
+        }
+    }
+    pass->frames_per_second = pass->frames / (pass->wall_ns / 1.0e9);
+
+    for (uint32 i = 0; instances && (i < instance_count); ++i)
+    {
+        soak_free_instance(&instances[i]);
+    }
+    free(instances);
+    pthread_barrier_destroy(&start_barrier);
+    return ok;
+}
+
+internal void
+usage(char *program)
+{
+    fprintf(stderr,
+        "usage: %s [--instances N] [--frames N] [--assets DIR] [--seed N]\n"
+        "          [--pin] [--no-sound] [--scaling] [--verbose]\n", program);
+}
+
+internal bool32
+parse_options(int argc, char **argv, soak_options *options)
+{
+    options->asset_root = (char *)"mobile/src/main/assets";
+    options->instance_count = (uint32)sysconf(_SC_NPROCESSORS_ONLN);
+    options->frame_count = 1000;
+    options->sound = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        char *arg = argv[i];
+        char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+        if (!strcmp(arg, "--instances") && value)
+        {
+            options->instance_count = (uint32)strtoul(value, 0, 10);
+            ++i;
+        }
+        else if (!strcmp(arg, "--frames") && value)
+        {
+            options->frame_count = strtoull(value, 0, 10);
+            ++i;
+        }
+        else if (!strcmp(arg, "--assets") && value)
+        {
+            options->asset_root = value;
+            ++i;
+        }
+        else if (!strcmp(arg, "--seed") && value)
+        {
+            options->seed = (uint32)strtoul(value, 0, 10);
+            ++i;
+        }
+        else if (!strcmp(arg, "--pin"))
+        {
+            options->pin = 1;
+        }
+        else if (!strcmp(arg, "--no-sound"))
+        {
+            options->sound = 0;
+        }
+        else if (!strcmp(arg, "--scaling"))
+        {
+            options->scaling = 1;
+        }
+        else if (!strcmp(arg, "--verbose"))
+        {
+            options->verbose = 1;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    return (options->instance_count >= 1) && (options->instance_count <= SOAK_MAX_INSTANCES);
+}
+
+int main(int argc, char **argv)
+{
+    soak_options options = {};
+    if (!parse_options(argc, argv, &options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    global_asset_root = options.asset_root;
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    app_log("Soak: %u instances of %" PRIu64 " frames on %ld cpus, seed %u", options.instance_count,
+        options.frame_count, cpu_count, options.seed);
+
+    soak_pass single = {};
+    for (uint32 count = options.scaling ? 1 : options.instance_count; count; )
+    {
+        soak_pass pass;
+        if (!soak_run_pass(&options, count, &pass))
+        {
+            return 1;
+        }
+        if (count == 1)
+        {
+            single = pass;
+        }
+        real64 efficiency = single.frames_per_second ?
+            pass.frames_per_second / (count * single.frames_per_second) : 1.0;
+        app_log("%u instances: %" PRIu64 " frames in %.3f s, %.1f frames/s, worst p99 %.2f max %.2f ms",
+            count, pass.frames, pass.wall_ns / 1.0e9, pass.frames_per_second,
+            pass.worst_p99_ns / 1.0e6, pass.worst_max_ns / 1.0e6);
+        if (options.scaling)
+        {
+            app_log("%u instances: scaling efficiency %.0f%%", count, 100.0 * efficiency);
+        }
+
+        if (count == options.instance_count)
+        {
+            break;
+        }
+        count = (2 * count < options.instance_count) ? 2 * count : options.instance_count;
+    }
+    return 0;
+}